@@ -0,0 +1,22 @@
+#version 450
+
+// copies an already tonemapped image to the swapchain
+
+layout(location = 0) in vec2 v_texCoord;
+
+layout(location = 0) out vec4 outColor;
+
+layout(push_constant) uniform PushConstants {
+	int decodeSRGB; // for images holding sRGB encoded values in a linear format, as the post-processing chain's output does; storage images can't have sRGB formats
+} pcs;
+
+layout(binding = 0) uniform sampler2D textur;
+
+vec3 decodeSRGB(vec3 encoded) {
+	return mix(encoded/12.92, pow((encoded + 0.055)/1.055, vec3(2.4)), greaterThan(encoded, vec3(0.04045)));
+}
+
+void main() {
+	vec3 colour = texture(textur, v_texCoord).xyz;
+	outColor = vec4(pcs.decodeSRGB != 0 ? decodeSRGB(colour) : colour, 1.0);
+}
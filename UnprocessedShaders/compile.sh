@@ -1,12 +1,29 @@
-/Users/eprager/VulkanSDK/1.3.268.1/macOS/bin/glslc mainInstanced.vert -o ../Resources/Shaders/vertMainInstanced.spv
-/Users/eprager/VulkanSDK/1.3.268.1/macOS/bin/glslc mainOnce.vert -o ../Resources/Shaders/vertMainOnce.spv
-/Users/eprager/VulkanSDK/1.3.268.1/macOS/bin/glslc main.frag -o ../Resources/Shaders/fragMain.spv
-/Users/eprager/VulkanSDK/1.3.268.1/macOS/bin/glslc hud.vert -o ../Resources/Shaders/vertHud.spv
-/Users/eprager/VulkanSDK/1.3.268.1/macOS/bin/glslc hud.frag -o ../Resources/Shaders/fragHud.spv
-/Users/eprager/VulkanSDK/1.3.268.1/macOS/bin/glslc shadowInstanced.vert -o ../Resources/Shaders/vertShadowInstanced.spv
-/Users/eprager/VulkanSDK/1.3.268.1/macOS/bin/glslc shadowOnce.vert -o ../Resources/Shaders/vertShadowOnce.spv
-/Users/eprager/VulkanSDK/1.3.268.1/macOS/bin/glslc skybox.vert -o ../Resources/Shaders/vertSkybox.spv
-/Users/eprager/VulkanSDK/1.3.268.1/macOS/bin/glslc skybox.frag -o ../Resources/Shaders/fragSkybox.spv
-/Users/eprager/VulkanSDK/1.3.268.1/macOS/bin/glslc final.vert -o ../Resources/Shaders/vertFinal.spv
-/Users/eprager/VulkanSDK/1.3.268.1/macOS/bin/glslc final.frag -o ../Resources/Shaders/fragFinal.spv
-/Users/eprager/VulkanSDK/1.3.268.1/macOS/bin/glslc histogram.comp -o ../Resources/Shaders/histogram.spv
+#!/bin/sh
+# Compiles every shader into ../Resources/Shaders; run after changing any of them. Uses glslc from $VULKAN_SDK if it's set, otherwise from PATH.
+set -e
+cd "$(dirname "$0")"
+GLSLC="${VULKAN_SDK:+$VULKAN_SDK/bin/}glslc"
+"$GLSLC" -I../include mainInstanced.vert -o ../Resources/Shaders/vertMainInstanced.spv
+"$GLSLC" -I../include main.frag -o ../Resources/Shaders/fragMain.spv
+"$GLSLC" -I../include -DALPHA_TEST main.frag -o ../Resources/Shaders/fragMainAlphaTested.spv
+"$GLSLC" -I../include -DVISIBILITY_RESOLVE main.frag -o ../Resources/Shaders/fragVisibilityResolve.spv
+"$GLSLC" -I../include visibility.frag -o ../Resources/Shaders/fragVisibility.spv
+"$GLSLC" -I../include depthPrepass.vert -o ../Resources/Shaders/vertDepthPrepass.spv
+"$GLSLC" hud.vert -o ../Resources/Shaders/vertHud.spv
+"$GLSLC" hud.frag -o ../Resources/Shaders/fragHud.spv
+"$GLSLC" -I../include shadowInstanced.vert -o ../Resources/Shaders/vertShadowInstanced.spv
+"$GLSLC" -I../include shadowMultiview.vert -o ../Resources/Shaders/vertShadowMultiview.spv
+"$GLSLC" shadowComposite.frag -o ../Resources/Shaders/fragShadowComposite.spv
+"$GLSLC" skybox.vert -o ../Resources/Shaders/vertSkybox.spv
+"$GLSLC" -I../include skybox.frag -o ../Resources/Shaders/fragSkybox.spv
+"$GLSLC" final.vert -o ../Resources/Shaders/vertFinal.spv
+"$GLSLC" final.frag -o ../Resources/Shaders/fragFinal.spv
+"$GLSLC" blit.frag -o ../Resources/Shaders/fragBlit.spv
+"$GLSLC" histogram.comp -o ../Resources/Shaders/histogram.spv
+"$GLSLC" exposureAverage.comp -o ../Resources/Shaders/exposureAverage.spv
+"$GLSLC" -I../include depthReduce.comp -o ../Resources/Shaders/depthReduce.spv
+"$GLSLC" -I../include -DHORIZONTAL evsmBlur.comp -o ../Resources/Shaders/evsmBlurHorizontal.spv
+"$GLSLC" -I../include evsmBlur.comp -o ../Resources/Shaders/evsmBlurVertical.spv
+"$GLSLC" -I../include clusters.comp -o ../Resources/Shaders/clusters.spv
+"$GLSLC" post.comp -o ../Resources/Shaders/postHdr.spv
+"$GLSLC" -DOUTPUT_LDR post.comp -o ../Resources/Shaders/postLdr.spv
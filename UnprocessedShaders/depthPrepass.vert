@@ -0,0 +1,35 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "SharedConstants.hpp"
+
+layout(set = 0, binding = 0) uniform UBO_Global {
+	mat4 lightMat[SHADOW_MAP_CASCADE_COUNT_MAX];
+	mat4 viewInv;
+	mat4 proj;
+	vec4 lightColour;
+	vec4 cascadeSplits[SHADOW_MAP_CASCADE_COUNT_MAX/4];
+	vec4 lightDir;
+	vec4 cameraPosition;
+	int cascadeCount;
+	int shadowFilter;
+	vec2 viewportScale;
+	int pcfHalfRange;
+	int fog;
+} ubo_g;
+
+layout(location = 0) in vec3 a_position;
+layout(location = 1) in vec3 a_normal;
+layout(location = 2) in vec2 a_texCoord;
+layout(location = 3) in mat4 a_model;
+layout(location = 7) in mat4 a_modelInvT;
+
+// ! computed exactly as in mainInstanced.vert, so the main pass's `EQUAL` depth test passes
+invariant gl_Position;
+
+void main() {
+	vec4 positionWorld = a_model * vec4(a_position, 1.0);
+	vec4 positionView = ubo_g.viewInv * positionWorld;
+	
+	gl_Position = ubo_g.proj * positionView;
+}
@@ -6,14 +6,45 @@ layout(location = 0) out vec4 outColor;
 
 layout(binding = 0) uniform sampler2D textur;
 
+// the scene may only fill the top left of its target, with dynamic resolution, so is upsampled from there
+layout(push_constant) uniform PushConstants {
+	vec2 uvScale; // the fraction of the target drawn to
+	float sharpness; // of the upsampling, from 0 for plain bilinear to 1
+} pcs;
+
+// written by the auto-exposure passes this frame
+layout(std430, binding = 1) readonly buffer ExposureSBO {
+	uint bins[256];
+	float adaptedLuminance;
+	float exposure;
+} exposure;
+
+// bilinear, sharpened by how far the centre stands out from its four neighbours a source texel away, clamped to their range so bright HDR edges don't ring
+vec3 upsample(){
+	vec2 texel = 1.0/vec2(textureSize(textur, 0));
+	// kept inside what was drawn, so nothing is filtered in from beyond its edges
+	vec2 lo = 0.5*texel;
+	vec2 hi = pcs.uvScale - 0.5*texel;
+	vec2 uv = clamp(v_texCoord*pcs.uvScale, lo, hi);
+	vec3 centre = texture(textur, uv).xyz;
+	if(pcs.sharpness <= 0.0) return centre;
+	
+	vec3 n = texture(textur, clamp(uv - vec2(0.0, texel.y), lo, hi)).xyz;
+	vec3 s = texture(textur, clamp(uv + vec2(0.0, texel.y), lo, hi)).xyz;
+	vec3 e = texture(textur, clamp(uv + vec2(texel.x, 0.0), lo, hi)).xyz;
+	vec3 w = texture(textur, clamp(uv - vec2(texel.x, 0.0), lo, hi)).xyz;
+	vec3 sharpened = centre + pcs.sharpness*(centre - 0.25*(n + s + e + w));
+	return clamp(sharpened, min(centre, min(min(n, s), min(e, w))), max(centre, max(max(n, s), max(e, w))));
+}
+
 float RTR(float hdrVal){
 	float whiteSquared = 25.0;
 	return hdrVal*(1.0 + hdrVal/whiteSquared)/(1.0 + hdrVal);
 }
 
 void main() {
-	vec3 colour = texture(textur, v_texCoord).xyz;
+	vec3 colour = exposure.exposure * upsample();
 	
-	float L = dot(vec3(0.2126, 0.7152, 0.0722), colour);
+	float L = max(dot(vec3(0.2126, 0.7152, 0.0722), colour), 0.0001);
 	outColor = vec4(colour*RTR(L)/L, 1.0);
 }
@@ -1,20 +1,43 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
 
-#define PNGS_N 4
-#define SHADOW_MAP_CASCADE_COUNT 4
-#define FOG_MAX 0.003
-#define FOG_DECREASE 0.004
-#define LIGHT_STRENGTH 3.0
-#define AMBIENT 0.3
+#include "SharedConstants.hpp"
+#define SHADOW_BIAS 0.005
+
+// ! must match `ShadowFilter`
+#define SHADOW_FILTER_PCF 0
+#define SHADOW_FILTER_HARDWARE 1
+#define SHADOW_FILTER_GATHER9 2
+#define SHADOW_FILTER_GATHER16 3
+#define SHADOW_FILTER_EVSM 4
+
+#define EVSM_BIAS 0.01
+#define EVSM_LIGHT_BLEED_REDUCTION 0.3
+
+struct Light {
+	vec4 positionRange;
+	vec4 colourCosInner;
+	vec4 directionCosOuter;
+};
+
+struct Cluster {
+	uint count;
+	uint indices[CLUSTER_LIGHTS_MAX];
+};
 
 layout(set = 0, binding = 0) uniform UBO_Global {
-	mat4 lightMat[SHADOW_MAP_CASCADE_COUNT];
+	mat4 lightMat[SHADOW_MAP_CASCADE_COUNT_MAX];
 	mat4 viewInv;
 	mat4 proj;
 	vec4 lightColour;
-	vec4 cascadeSplits;
+	vec4 cascadeSplits[SHADOW_MAP_CASCADE_COUNT_MAX/4];
 	vec4 lightDir;
 	vec4 cameraPosition;
+	int cascadeCount;
+	int shadowFilter;
+	vec2 viewportScale;
+	int pcfHalfRange;
+	int fog;
 } ubo_g;
 
 layout(push_constant) uniform PushConstants {
@@ -26,15 +49,60 @@ layout(push_constant) uniform PushConstants {
 } pcs;
 
 layout(set = 0, binding = 1) uniform sampler texSampler;
-layout(set = 0, binding = 2) uniform texture2D textur[PNGS_N]; // ! must equal the number of different textures (`IMGS_N`)
+layout(set = 0, binding = 2) uniform texture2D textur[PNGS_N];
 
 layout(set = 0, binding = 3) uniform sampler2DArray shadowMap;
+layout(set = 0, binding = 4) uniform sampler2DArrayShadow shadowMapCompare; // the same image
+layout(set = 0, binding = 5) uniform sampler2DArray evsmMoments;
+
+layout(std430, set = 0, binding = 6) readonly buffer LightsSBO {
+	uint count;
+	Light lights[LIGHTS_MAX];
+} lights;
+layout(std430, set = 0, binding = 7) readonly buffer ClustersSBO {
+	Cluster clusters[CLUSTERS_N];
+} clusters;
+
+#ifdef VISIBILITY_RESOLVE
+struct Vertex {
+	float data[8]; // position, normal and texture coordinates, tightly packed
+};
 
+struct Record {
+	mat4 model;
+	mat4 modelInvT;
+	uint firstVertex;
+	int textureID;
+	float shininess;
+	uint padding;
+};
+
+layout(set = 0, binding = 8) uniform usampler2D visibility;
+layout(std430, set = 0, binding = 9) readonly buffer GeometrySBO {
+	Vertex vertices[GEOMETRY_STORAGE_VERTICES];
+} geometry;
+layout(std430, set = 0, binding = 10) readonly buffer RecordsSBO {
+	Record records[];
+} records;
+
+// reconstructed from the visibility buffer by `resolveVisibility`, in place of the vertex shader's outputs
+vec3 v_normal;
+vec2 v_texCoord;
+vec3 v_surfaceToCamera;
+vec3 v_viewPos;
+vec3 v_position;
+// screen space derivatives of `v_texCoord`; implicit ones would be wrong wherever neighbouring pixels are of other triangles
+vec2 texCoordDx;
+vec2 texCoordDy;
+int textureID;
+float shininess;
+#else
 layout(location = 0) in vec3 v_normal;
 layout(location = 1) in vec2 v_texCoord;
 layout(location = 2) in vec3 v_surfaceToCamera;
 layout(location = 3) in vec3 v_viewPos;
 layout(location = 4) in vec3 v_position;
+#endif
 
 layout(location = 0) out vec4 outColor;
 
@@ -46,13 +114,10 @@ const mat4 biasMat = mat4(
 );
 float textureProj(vec4 shadowCoord, vec2 offset, uint cascadeIndex){
 	float shadow = 1.0;
-	float bias = 0.005;
-
-	if(shadowCoord.z > -1.0 && shadowCoord.z < 1.0){
-		float dist = texture(shadowMap, vec3(shadowCoord.xy + offset, cascadeIndex)).r;
-		if(shadowCoord.w > 0 && dist < shadowCoord.z - bias){
-			shadow = 0;
-		}
+	
+	float dist = texture(shadowMap, vec3(shadowCoord.xy + offset, cascadeIndex)).r;
+	if(shadowCoord.w > 0 && dist < shadowCoord.z - SHADOW_BIAS){
+		shadow = 0;
 	}
 	return shadow;
 }
@@ -63,42 +128,220 @@ float filterPCF(vec4 shadowCoord, uint cascadeIndex){
 	float dy = scale * 1.0 / float(texDim.y);
 
 	float shadowFactor = 0.0;
-	int halfRange = 2;
 	
-	for(int x=-halfRange; x<=halfRange; x++){
-		for (int y=-halfRange; y<=halfRange; y++){
+	for(int x=-ubo_g.pcfHalfRange; x<=ubo_g.pcfHalfRange; x++){
+		for (int y=-ubo_g.pcfHalfRange; y<=ubo_g.pcfHalfRange; y++){
 			shadowFactor += textureProj(shadowCoord, vec2(dx*x, dy*y), cascadeIndex);
 		}
 	}
 	
-	int range = halfRange + halfRange + 1;
+	int range = ubo_g.pcfHalfRange + ubo_g.pcfHalfRange + 1;
 	return shadowFactor / float(range*range);
 }
+
+// how much of texels `k` and `k + 1` (relative to the one below the sample) a box of half width `halfWidth` centred `f` texels above that texel covers
+vec2 boxCoverage(float k, float f, float halfWidth){
+	vec2 texels = vec2(k, k + 1.0);
+	return clamp(min(texels + 0.5, f + halfWidth) - max(texels - 0.5, f - halfWidth), 0.0, 1.0);
+}
+// fraction of a box of (2*taps - 1) texels square around the sample that is lit. Each tap gathers the comparisons of 2x2 texels, so `taps` per axis cover the box and its partly covered edge texels.
+float filterGather(vec4 shadowCoord, uint cascadeIndex, int taps){
+	vec2 texDim = vec2(textureSize(shadowMapCompare, 0).xy);
+	vec2 texel = shadowCoord.xy*texDim - 0.5; // texel centres at integers
+	vec2 base = floor(texel);
+	vec2 f = texel - base;
+	float halfWidth = float(taps) - 0.5;
+	float reference = shadowCoord.z - SHADOW_BIAS;
+	
+	float shadowFactor = 0.0;
+	for(int y=0; y<taps; y++){
+		float ky = float(2*y - taps + 1);
+		vec2 wy = boxCoverage(ky, f.y, halfWidth);
+		for(int x=0; x<taps; x++){
+			float kx = float(2*x - taps + 1);
+			vec2 wx = boxCoverage(kx, f.x, halfWidth);
+			// sampling at the corner shared by the four texels gathers exactly those
+			vec4 lit = textureGather(shadowMapCompare, vec3((base + vec2(kx, ky) + 1.0)/texDim, cascadeIndex), reference);
+			// gathered in the order (0, 1), (1, 1), (1, 0), (0, 0)
+			shadowFactor += dot(lit, vec4(wx.x*wy.y, wx.y*wy.y, wx.y*wy.x, wx.x*wy.x));
+		}
+	}
+	return shadowFactor / (4.0*halfWidth*halfWidth);
+}
+
+// upper bound on the fraction of the filtered region lit at depth `mean`, from its first two moments
+float chebyshevUpperBound(vec2 moments, float mean, float minVariance){
+	float variance = max(moments.y - moments.x*moments.x, minVariance);
+	float d = mean - moments.x;
+	float pMax = variance / (variance + d*d);
+	// cutting off the tail of the bound reduces light bleeding where casters overlap
+	pMax = clamp((pMax - EVSM_LIGHT_BLEED_REDUCTION) / (1.0 - EVSM_LIGHT_BLEED_REDUCTION), 0.0, 1.0);
+	return mean <= moments.x ? 1.0 : pMax;
+}
+float filterEVSM(vec4 shadowCoord, uint cascadeIndex){
+	vec4 moments = texture(evsmMoments, vec3(shadowCoord.xy, cascadeIndex));
+	float depth = 2.0*shadowCoord.z - 1.0;
+	vec2 warped = vec2(exp(EVSM_EXPONENT_POSITIVE*depth), -exp(-EVSM_EXPONENT_NEGATIVE*depth));
+	// the variance floor scales with the warp's derivative, so it's the same in unwarped depth
+	vec2 depthScale = EVSM_BIAS * vec2(EVSM_EXPONENT_POSITIVE, EVSM_EXPONENT_NEGATIVE) * warped;
+	vec2 minVariance = depthScale*depthScale;
+	return min(chebyshevUpperBound(moments.xy, warped.x, minVariance.x), chebyshevUpperBound(moments.zw, warped.y, minVariance.y));
+}
+
+float shadowFactor(vec4 shadowCoord, uint cascadeIndex){
+	if(shadowCoord.z <= -1.0 || shadowCoord.z >= 1.0) return 1.0;
+	
+	// uniform across the draw, so the branch is coherent
+	switch(ubo_g.shadowFilter){
+		case SHADOW_FILTER_HARDWARE:
+			return texture(shadowMapCompare, vec4(shadowCoord.xy, cascadeIndex, shadowCoord.z - SHADOW_BIAS));
+		case SHADOW_FILTER_GATHER9:
+			return filterGather(shadowCoord, cascadeIndex, 3);
+		case SHADOW_FILTER_GATHER16:
+			return filterGather(shadowCoord, cascadeIndex, 4);
+		case SHADOW_FILTER_EVSM:
+			return filterEVSM(shadowCoord, cascadeIndex);
+		default:
+			return filterPCF(shadowCoord, cascadeIndex);
+	}
+}
 vec2 ilumination(uint cascadeIndex, float l, float h, float m){
 	if(l > 0.0){
 		vec4 shadowCoord = biasMat * ubo_g.lightMat[cascadeIndex] * vec4(v_position, 1.0);
-		float shade = filterPCF(shadowCoord / shadowCoord.w, cascadeIndex);
+		float shade = shadowFactor(shadowCoord / shadowCoord.w, cascadeIndex);
 		return shade*LIGHT_STRENGTH*vec2(l, pow(max(0.0, h), m));
 	} else return vec2(0.0);
 }
 
+// the index of the cluster this fragment is in, found as clusters.comp slices the frustum
+uint clusterIndex(){
+	vec4 clip = ubo_g.proj * vec4(v_viewPos, 1.0);
+	ivec2 tile = clamp(ivec2((0.5*clip.xy/clip.w + 0.5)*vec2(CLUSTERS_X, CLUSTERS_Y)), ivec2(0), ivec2(CLUSTERS_X - 1, CLUSTERS_Y - 1));
+	int slice = clamp(int(log(-v_viewPos.z/CAMERA_Z_NEAR)/log(CAMERA_Z_FAR/CAMERA_Z_NEAR)*float(CLUSTERS_Z)), 0, CLUSTERS_Z - 1);
+	return uint(tile.x + CLUSTERS_X*(tile.y + CLUSTERS_Y*slice));
+}
+// diffuse and specular light from the point and spot lights of this fragment's cluster, which cast no shadows
+void localIlumination(vec3 normal, vec3 surfaceToCamera, float m, out vec3 diffuse, out vec3 specular){
+	diffuse = vec3(0.0);
+	specular = vec3(0.0);
+	uint index = clusterIndex();
+	for(uint i=0; i<clusters.clusters[index].count; i++){
+		Light light = lights.lights[clusters.clusters[index].indices[i]];
+		vec3 toLight = light.positionRange.xyz - v_position;
+		float dist = length(toLight);
+		if(dist >= light.positionRange.w) continue;
+		vec3 surfaceToLight = toLight/dist;
+		
+		// inverse square, windowed to reach zero at the light's range
+		float window = clamp(1.0 - pow(dist/light.positionRange.w, 4.0), 0.0, 1.0);
+		float strength = window*window/(1.0 + dist*dist);
+		if(light.directionCosOuter.w > -1.0){
+			strength *= smoothstep(light.directionCosOuter.w, light.colourCosInner.w, dot(-surfaceToLight, light.directionCosOuter.xyz));
+		}
+		
+		float l = dot(normal, surfaceToLight);
+		if(l <= 0.0) continue;
+		float h = dot(normal, normalize(surfaceToLight + surfaceToCamera));
+		diffuse += strength*l*light.colourCosInner.rgb;
+		specular += strength*pow(max(0.0, h), m)*light.colourCosInner.rgb;
+	}
+}
+
+#ifdef VISIBILITY_RESOLVE
+// perspective correct barycentric coordinates of `ndc` in the triangle with clip space corners `corners`
+vec3 barycentrics(vec4 corners[3], vec2 ndc){
+	vec3 invW = 1.0/vec3(corners[0].w, corners[1].w, corners[2].w);
+	vec2 ndc0 = corners[0].xy*invW.x;
+	vec2 ndc1 = corners[1].xy*invW.y;
+	vec2 ndc2 = corners[2].xy*invW.z;
+	float invDet = 1.0/determinant(mat2(ndc2 - ndc1, ndc0 - ndc1));
+	vec3 ddx = vec3(ndc1.y - ndc2.y, ndc2.y - ndc0.y, ndc0.y - ndc1.y)*invDet*invW;
+	vec3 ddy = vec3(ndc2.x - ndc1.x, ndc0.x - ndc2.x, ndc1.x - ndc0.x)*invDet*invW;
+	vec2 delta = ndc - ndc0;
+	float interpInvW = invW.x + delta.x*dot(ddx, vec3(1.0)) + delta.y*dot(ddy, vec3(1.0));
+	return (vec3(invW.x, 0.0, 0.0) + delta.x*ddx + delta.y*ddy)/interpInvW;
+}
+vec3 vertexAttribute3(uint index, uint offset){
+	return vec3(geometry.vertices[index].data[offset], geometry.vertices[index].data[offset + 1], geometry.vertices[index].data[offset + 2]);
+}
+// fills in what the vertex shader would have from this pixel's triangle; false if nothing opaque was drawn here
+bool resolveVisibility(){
+	uint id = texelFetch(visibility, ivec2(gl_FragCoord.xy), 0).r;
+	if(id == 0xFFFFFFFFu) return false;
+	Record record = records.records[id >> VISIBILITY_TRIANGLE_BITS];
+	uint first = record.firstVertex + 3u*(id & ((1u << VISIBILITY_TRIANGLE_BITS) - 1u));
+	
+	vec4 world[3];
+	vec4 clip[3];
+	for(uint k=0; k<3; k++){
+		world[k] = record.model * vec4(vertexAttribute3(first + k, 0), 1.0);
+		clip[k] = ubo_g.proj * ubo_g.viewInv * world[k];
+	}
+	vec2 size = vec2(textureSize(visibility, 0))*ubo_g.viewportScale; // of the viewport drawn to
+	vec2 ndc = 2.0*gl_FragCoord.xy/size - 1.0;
+	vec3 b = barycentrics(clip, ndc);
+	vec3 bDx = barycentrics(clip, ndc + vec2(2.0/size.x, 0.0)) - b;
+	vec3 bDy = barycentrics(clip, ndc + vec2(0.0, 2.0/size.y)) - b;
+	
+	v_position = (b.x*world[0] + b.y*world[1] + b.z*world[2]).xyz;
+	v_viewPos = (ubo_g.viewInv * vec4(v_position, 1.0)).xyz;
+	v_surfaceToCamera = ubo_g.cameraPosition.xyz - v_position;
+	v_normal = vec3(0.0);
+	mat3x2 texCoords;
+	for(uint k=0; k<3; k++){
+		v_normal += b[k]*(record.modelInvT * vec4(vertexAttribute3(first + k, 3), 0.0)).xyz;
+		texCoords[k] = vec2(geometry.vertices[first + k].data[6], geometry.vertices[first + k].data[7]);
+	}
+	v_texCoord = texCoords*b;
+	texCoordDx = texCoords*bDx;
+	texCoordDy = texCoords*bDy;
+	
+	textureID = record.textureID;
+	shininess = record.shininess;
+	return true;
+}
+#endif
+
 void main(){
+#ifdef VISIBILITY_RESOLVE
+	if(!resolveVisibility()) discard;
+#else
+	int textureID = pcs.textureID;
+	float shininess = pcs.shininess;
+#endif
+	
 	// Get cascade index for the current fragment's view position
 	uint cascadeIndex = 0;
-	for(uint i=0; i<SHADOW_MAP_CASCADE_COUNT - 1; i++){
-		if(v_viewPos.z < ubo_g.cascadeSplits[i]){
-			cascadeIndex = i + 1;
+	for(int i=0; i<ubo_g.cascadeCount - 1; i++){
+		if(v_viewPos.z < ubo_g.cascadeSplits[i/4][i%4]){
+			cascadeIndex = uint(i + 1);
 		}
 	}
 	
-	vec4 diffuseColour = texture(sampler2D(textur[pcs.textureID], texSampler), v_texCoord);
+#ifdef VISIBILITY_RESOLVE
+	// the texture can differ between neighbouring pixels, so it is picked from the array with constant indices
+	vec4 diffuseColour = vec4(0.0);
+	for(int i=0; i<PNGS_N; i++){
+		if(i == textureID) diffuseColour = textureGrad(sampler2D(textur[i], texSampler), v_texCoord, texCoordDx, texCoordDy);
+	}
+#else
+	vec4 diffuseColour = texture(sampler2D(textur[textureID], texSampler), v_texCoord);
+#endif
+#ifdef ALPHA_TEST
+	if(diffuseColour.a < ALPHA_CUTOFF) discard;
+#endif
 	vec3 a_normal = normalize(v_normal);
 	vec3 surfaceToLight = normalize(-ubo_g.lightDir.xyz);
 	vec3 surfaceToCamera = normalize(v_surfaceToCamera);
 	vec3 halfVector = normalize(surfaceToLight + surfaceToCamera);
-	vec2 ilu = ilumination(cascadeIndex, dot(a_normal, surfaceToLight), dot(a_normal, halfVector), pcs.shininess);
+	vec2 ilu = ilumination(cascadeIndex, dot(a_normal, surfaceToLight), dot(a_normal, halfVector), shininess);
 	outColor = vec4((ubo_g.lightColour * (diffuseColour * (ilu.x + AMBIENT) * pcs.colourMult + pcs.specular * ilu.y * pcs.specularFactor)).rgb, diffuseColour.a);
+	vec3 localDiffuse;
+	vec3 localSpecular;
+	localIlumination(a_normal, surfaceToCamera, shininess, localDiffuse, localSpecular);
+	outColor.rgb += (diffuseColour * pcs.colourMult).rgb * localDiffuse + (pcs.specular * pcs.specularFactor).rgb * localSpecular;
 	
+	if(ubo_g.fog == 0) return;
 	vec4 fogColour = vec4(vec3(AMBIENT), 1.0);
 	float fogginessSummedVertically = FOG_MAX*abs(exp(-ubo_g.cameraPosition.z*FOG_DECREASE) - exp(-v_position.z*FOG_DECREASE))/FOG_DECREASE;
 	float fogginessSummedTotal = fogginessSummedVertically*-v_viewPos.z/abs(ubo_g.cameraPosition.z - v_position.z);
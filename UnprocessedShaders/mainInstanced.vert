@@ -1,15 +1,21 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
 
-#define SHADOW_MAP_CASCADE_COUNT 4
+#include "SharedConstants.hpp"
 
 layout(set = 0, binding = 0) uniform UBO_Global {
-	mat4 lightMat[SHADOW_MAP_CASCADE_COUNT];
+	mat4 lightMat[SHADOW_MAP_CASCADE_COUNT_MAX];
 	mat4 viewInv;
 	mat4 proj;
 	vec4 lightColour;
-	vec4 cascadeSplits;
+	vec4 cascadeSplits[SHADOW_MAP_CASCADE_COUNT_MAX/4];
 	vec4 lightDir;
 	vec4 cameraPosition;
+	int cascadeCount;
+	int shadowFilter;
+	vec2 viewportScale;
+	int pcfHalfRange;
+	int fog;
 } ubo_g;
 
 layout(location = 0) in vec3 a_position;
@@ -23,6 +29,10 @@ layout(location = 1) out vec2 v_texCoord;
 layout(location = 2) out vec3 v_surfaceToCamera;
 layout(location = 3) out vec3 v_viewPos;
 layout(location = 4) out vec3 v_position;
+layout(location = 5) flat out int v_instance; // for the visibility buffer
+
+// ! computed exactly as in depthPrepass.vert, so the main pass's `EQUAL` depth test passes after a pre-pass
+invariant gl_Position;
 
 void main() {
 	vec4 positionWorld = a_model * vec4(a_position, 1.0);
@@ -32,6 +42,7 @@ void main() {
 	v_surfaceToCamera = ubo_g.cameraPosition.xyz - positionWorld.xyz;
 	v_viewPos = positionView.xyz;
 	v_position = positionWorld.xyz;
+	v_instance = gl_InstanceIndex;
 	
 	gl_Position = ubo_g.proj * positionView;
 }
@@ -0,0 +1,14 @@
+#version 450
+
+layout(location = 0) in vec2 v_texCoord;
+
+layout(binding = 0) uniform sampler2DArray staticCascades;
+
+layout(push_constant) uniform PCs {
+	int cascadeLayer;
+} pcs;
+
+void main() {
+	// an exact copy of the cached depth, so it's fetched rather than filtered
+	gl_FragDepth = texelFetch(staticCascades, ivec3(gl_FragCoord.xy, pcs.cascadeLayer), 0).r;
+}
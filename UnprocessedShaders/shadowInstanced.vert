@@ -1,9 +1,10 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
 
-#define SHADOW_MAP_CASCADE_COUNT 4
+#include "SharedConstants.hpp"
 
 layout(set = 0, binding = 0) uniform UBO_Global {
-	mat4 viewInvProj[SHADOW_MAP_CASCADE_COUNT];
+	mat4 viewInvProj[SHADOW_MAP_CASCADE_COUNT_MAX];
 } ubo_g;
 
 layout(push_constant) uniform PCs {
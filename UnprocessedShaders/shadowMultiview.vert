@@ -0,0 +1,21 @@
+#version 450
+#extension GL_EXT_multiview : require
+#extension GL_GOOGLE_include_directive : require
+
+#include "SharedConstants.hpp"
+
+layout(set = 0, binding = 0) uniform UBO_Global {
+	mat4 viewInvProj[SHADOW_MAP_CASCADE_COUNT_MAX];
+} ubo_g;
+
+layout(location = 0) in vec3 a_position;
+layout(location = 1) in vec3 a_normal;
+layout(location = 2) in vec2 a_texCoord;
+layout(location = 3) in mat4 a_model;
+layout(location = 7) in mat4 a_modelInvT;
+
+void main() {
+	// each view is a layer of the cascade image
+	gl_Position = ubo_g.viewInvProj[gl_ViewIndex] * a_model * vec4(a_position, 1.0);
+}
+
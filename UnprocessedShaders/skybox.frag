@@ -1,13 +1,13 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
 
-#define FOG_MAX 0.003
-#define FOG_DECREASE 0.004
-#define AMBIENT 0.3
+#include "SharedConstants.hpp"
 
 layout(binding = 0) uniform UBO_Global {
 	mat4 viewInv;
 	mat4 proj;
 	vec4 cameraPosition;
+	int fog;
 } ubo_g;
 
 layout(binding = 1) uniform samplerCube u_cubemap;
@@ -22,6 +22,7 @@ void main(){
 	if(v_UVW.z < 0.0) outColor = fogColour;
 	else {
 		outColor = texture(u_cubemap, v_UVW);
+		if(ubo_g.fog == 0) return;
 		
 		float lh = length(v_UVW.xy);
 		float fogginessSummedVertically = FOG_MAX*exp(-ubo_g.cameraPosition.z*FOG_DECREASE)/FOG_DECREASE;
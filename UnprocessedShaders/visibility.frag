@@ -0,0 +1,26 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "SharedConstants.hpp"
+
+layout(push_constant) uniform PushConstants {
+	uint firstRecord;
+	uint firstInstance;
+	int textureID;
+	int alphaTest;
+} pcs;
+
+layout(set = 0, binding = 1) uniform sampler texSampler;
+layout(set = 0, binding = 2) uniform texture2D textur[PNGS_N];
+
+layout(location = 1) in vec2 v_texCoord;
+layout(location = 5) flat in int v_instance;
+
+layout(location = 0) out uint outId;
+
+void main(){
+	if(pcs.alphaTest != 0 && texture(sampler2D(textur[pcs.textureID], texSampler), v_texCoord).a < ALPHA_CUTOFF) discard;
+	
+	uint record = pcs.firstRecord + uint(v_instance) - pcs.firstInstance;
+	outId = (record << VISIBILITY_TRIANGLE_BITS) | uint(gl_PrimitiveID);
+}
@@ -3,8 +3,37 @@
 
 #include "PipelineShadow.hpp"
 #include "PipelineMain.hpp"
+#include "PipelineDepthReduce.hpp"
 
-// requires the camera projection and viewInverse matrices to be already set in the Main Global UBO
-void UpdateCascades(PipelineMain::UBO_Global *mainUboGlobal, PipelineShadow::UBO_Global *shadowUboGlobal);
+// where the visible samples of the main pass lie, to fit cascades to
+struct SampleBounds {
+	float viewDepthMin; // positive distances from the camera
+	float viewDepthMax;
+	Bounds light[SHADOW_MAP_CASCADE_COUNT_MAX]; // of the samples in each cascade, in the light's view space without translation; `min.x > max.x` if there were none
+};
+
+// requires the camera projection and viewInverse matrices to be already set in the Main Global UBO. With `samples`, the splits and projections are fitted to them rather than to the whole camera frustum.
+void UpdateCascades(PipelineMain::UBO_Global *mainUboGlobal, PipelineShadow::UBO_Global *shadowUboGlobal, const SampleBounds *samples=nullptr);
+
+// whether a caster with world space bounds `bounds` can cast into cascade `cascade`. Casters between the light and the cascade are kept, so the near plane isn't tested; the shadow pipelines clamp their depth onto it.
+bool CasterInCascade(const PipelineShadow::UBO_Global *shadowUboGlobal, uint32_t cascade, const Bounds &bounds);
+
+#ifdef SHADOW_CACHE
+struct CascadeSchedule {
+	bool redraw[SHADOW_MAP_CASCADE_COUNT_MAX]; // the cascade is due this frame
+	bool redrawStatic[SHADOW_MAP_CASCADE_COUNT_MAX]; // the cascade has moved since its static casters were cached, so they need drawing again first
+};
+// call once per frame after `UpdateCascades`. Cascades either side of a split that has moved are always due. Cascades that aren't due have their matrices in both UBOs, and their splits, put back to the ones they were last drawn with, so they're still sampled where they were fitted.
+CascadeSchedule ScheduleCascades(PipelineMain::UBO_Global *mainUboGlobal, PipelineShadow::UBO_Global *shadowUboGlobal);
+#endif
+
+#ifdef SHADOW_SDSM
+// sets the depth reduction's inputs from those of the main pass, after `UpdateCascades`
+void UpdateDepthReduceUBO(PipelineDepthReduce::UBO *depthReduceUbo, const PipelineMain::UBO_Global *mainUboGlobal);
+// readies a result buffer for the reduction to write to
+void ResetDepthReduction(PipelineDepthReduce::SBO *result);
+// returns false if the reduction saw no samples, e.g. if only the skybox was visible
+bool ReadDepthReduction(const PipelineDepthReduce::SBO *result, SampleBounds &samplesOut);
+#endif
 
 #endif /* CascadedShadowMap_hpp */
@@ -0,0 +1,34 @@
+#ifndef FragmentCounter_hpp
+#define FragmentCounter_hpp
+
+#include <optional>
+
+#include "Header.hpp"
+
+// Counts fragment shader invocations between `CmdBegin` and `CmdEnd` with a pipeline statistics query, one per flight, read when the flight next comes round. Needs the device's `pipelineStatisticsQuery` feature.
+class FragmentCounter {
+public:
+	FragmentCounter(std::shared_ptr<EVK::Devices> _devices) : devices(_devices) {}
+	~FragmentCounter();
+	
+	// must be recorded outside a render pass, before `CmdBegin` in the flight; the flight's previous count can't be read after this
+	void CmdReset(VkCommandBuffer commandBuffer, uint32_t flight);
+	
+	// both must be outside a render pass, or in the same subpass
+	void CmdBegin(VkCommandBuffer commandBuffer, uint32_t flight);
+	void CmdEnd(VkCommandBuffer commandBuffer, uint32_t flight);
+	
+	// the count from when `flight` last ran; empty if it wasn't counted or the result isn't available
+	std::optional<uint64_t> Read(uint32_t flight) const;
+	
+private:
+	std::shared_ptr<EVK::Devices> devices;
+	
+	struct Flight {
+		VkQueryPool queryPool;
+		bool counted; // whether the query was ended since the last reset
+	};
+	std::map<uint32_t, Flight> flights; // created as each flight is first reset
+};
+
+#endif /* FragmentCounter_hpp */
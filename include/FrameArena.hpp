@@ -0,0 +1,115 @@
+#ifndef FrameArena_hpp
+#define FrameArena_hpp
+
+#include <cassert>
+#include <cstddef>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Header.hpp"
+
+#define FRAME_ARENA_BYTES (64*1024) // each flight's arena to begin with; grown once a frame has needed more
+
+// Counts general heap allocations on the thread recording frames, asserting there are none in a frame once `FRAME_HEAP_CHECK_WARMUP_FRAMES` have gone by and containers kept between frames have reached their sizes. Replaces the global `operator new`, so is only for debugging.
+//#define FRAME_HEAP_CHECK
+#define FRAME_HEAP_CHECK_WARMUP_FRAMES 300
+
+// A bump allocator for what is only needed while a frame is recorded, one per flight, reset at the start of the flight's frame. Nothing allocated is destructed, so only trivially destructible types can be put in it. Once the block is full allocations spill into further blocks from the heap, and the next reset replaces the block with one big enough for the whole frame.
+class FrameArena {
+public:
+	FrameArena(size_t _capacity=FRAME_ARENA_BYTES);
+	~FrameArena();
+	FrameArena(const FrameArena &) = delete;
+	FrameArena &operator=(const FrameArena &) = delete;
+	
+	// forgets everything allocated since the last reset
+	void Reset();
+	
+	void *Allocate(size_t bytes, size_t alignment);
+	
+	template <typename T, typename... args_t> requires std::is_trivially_destructible_v<T>
+	T *New(args_t &&...args){
+		return new (Allocate(sizeof(T), alignof(T))) T(std::forward<args_t>(args)...);
+	}
+	
+	// `n` value initialised `T`s
+	template <typename T> requires std::is_trivially_destructible_v<T>
+	std::span<T> NewSpan(size_t n){
+		T *const ret = static_cast<T *>(Allocate(n*sizeof(T), alignof(T)));
+		for(size_t i=0; i<n; ++i) new (ret + i) T();
+		return {ret, n};
+	}
+	
+	size_t GetCapacity() const { return capacity; }
+	size_t GetUsed() const { return used + spilt; }
+	
+private:
+	std::byte *block;
+	size_t capacity;
+	size_t used = 0;
+	std::vector<std::byte *> spills; // blocks from the heap since the last reset, once `block` was full
+	size_t spilt = 0; // bytes in `spills`
+};
+
+// the arena of the flight being recorded, set by `BeginFrameArena`
+extern FrameArena *frameArena;
+// resets `flight`'s arena, creating it the first time, and makes it `frameArena`; call once the flight's fence has been waited on
+void BeginFrameArena(uint32_t flight);
+
+// A list of up to a fixed number of elements in a `FrameArena`, for building a frame's lists without the heap.
+template <typename T> requires std::is_trivially_destructible_v<T>
+class ArenaVector {
+public:
+	ArenaVector() = default;
+	ArenaVector(FrameArena &arena, size_t _capacity) : elements(static_cast<T *>(arena.Allocate(_capacity*sizeof(T), alignof(T)))), capacity(_capacity) {}
+	
+	void push_back(const T &value){
+		assert(size < capacity);
+		new (elements + size++) T(value);
+	}
+	void clear(){ size = 0; }
+	
+	T &operator[](size_t i){ return elements[i]; }
+	const T &operator[](size_t i) const { return elements[i]; }
+	T *begin(){ return elements; }
+	T *end(){ return elements + size; }
+	const T *begin() const { return elements; }
+	const T *end() const { return elements + size; }
+	size_t Size() const { return size; }
+	bool Empty() const { return size == 0; }
+	std::span<T> Span() const { return {elements, size}; }
+	
+private:
+	T *elements = nullptr;
+	size_t size = 0;
+	size_t capacity = 0;
+};
+
+// A callable kept in a `FrameArena`, so a frame can hold on to lambdas capturing any amount by reference without the heap.
+template <typename> class ArenaFunction;
+template <typename return_t, typename... args_t>
+class ArenaFunction<return_t(args_t...)> {
+public:
+	ArenaFunction() = default;
+	template <typename function_t> requires std::is_trivially_destructible_v<function_t> && std::is_invocable_r_v<return_t, function_t &, args_t...>
+	ArenaFunction(FrameArena &arena, function_t function) : object(arena.New<function_t>(std::move(function))), invoke([](void *object, args_t... args) -> return_t {
+		return (*static_cast<function_t *>(object))(std::forward<args_t>(args)...);
+	}) {}
+	
+	return_t operator()(args_t... args) const { return invoke(object, std::forward<args_t>(args)...); }
+	explicit operator bool() const { return invoke != nullptr; }
+	
+private:
+	void *object = nullptr;
+	return_t (*invoke)(void *, args_t...) = nullptr;
+};
+
+#ifdef FRAME_HEAP_CHECK
+// general heap allocations made by this thread so far
+uint64_t HeapAllocations();
+#endif
+
+#endif /* FrameArena_hpp */
@@ -0,0 +1,100 @@
+#ifndef FrameGraph_hpp
+#define FrameGraph_hpp
+
+#include <initializer_list>
+#include <map>
+#include <string>
+#include <string_view>
+
+#include "FrameArena.hpp"
+
+// A frame as a list of passes, recorded in the order they're added, each declaring the resources it reads and writes. From those, `Compile` culls the passes nothing needs and puts a single memory barrier before each pass covering exactly the hazards its accesses have with earlier passes'. That is all it derives: EVK creates the render passes and allocates every image, so subpass dependencies are written by hand in the render passes, and transient resources never share memory.
+// Resources that aren't `transient` carry what they were last accessed with into the next frame's graph, by name, so a frame's first accesses are synchronised with the last frame's; those with a copy per flight carry it to the same flight's next frame. Image layouts stay with the render passes and the passes' own barriers; accesses those already synchronise are declared `synchronised`, so aren't synchronised again.
+// Declared again every frame, so nothing is allocated from the heap once the lists it keeps have reached their sizes: passes' callables and everything `Compile` works out are in the frame's arena.
+class FrameGraph {
+public:
+	using ResourceId = uint32_t;
+	
+	struct Access {
+		ResourceId resource;
+		VkPipelineStageFlags stages;
+		VkAccessFlags access; // any write bit makes this a write, any other bit a read; both for read-modify-write
+		// Set where the pass synchronises this access with what came before itself, e.g. an attachment by its render pass's subpass dependencies. What it writes is then already visible to `visibleStages` with `visibleAccess`, e.g. by the dependency to `VK_SUBPASS_EXTERNAL`.
+		bool synchronised = false;
+		VkPipelineStageFlags visibleStages = 0;
+		VkAccessFlags visibleAccess = 0;
+	};
+	
+	// given the command buffer and flight
+	using Record = ArenaFunction<void(VkCommandBuffer, uint32_t)>;
+	
+	// forgets every resource and pass, for declaring `flight`'s next frame, which is compiled in `arena`
+	void Clear(FrameArena &arena, uint32_t flight);
+	
+	// A `transient` resource's contents needn't outlive the passes using it in the frame, so nothing is carried into the next. Names are kept between frames, so must be string literals.
+	ResourceId AddResource(const char *name, bool transient=false);
+	// one with a copy per flight, e.g. a buffer indexed by flight, whose accesses only need synchronising with the same flight's
+	ResourceId AddFlightResource(const char *name);
+	// `record` may be empty, e.g. for the host reading results back. With `sideEffects` the pass is kept even if no later pass reads what it writes, e.g. drawing to the swapchain or something read back by the host.
+	void AddPass(const char *name, std::initializer_list<Access> passAccesses, Record record, bool sideEffects=false);
+	// adds to the last pass added, for accesses that depend on settings
+	void AddAccess(const Access &access);
+	
+	// culls and places barriers; call once every pass has been added
+	void Compile();
+	
+	// records the passes kept, each after its barrier, for the flight given to `Clear`
+	void Execute(VkCommandBuffer commandBuffer) const;
+	
+	// the compiled frame, a line per pass
+	std::string Describe() const;
+	
+private:
+	struct Resource {
+		const char *name;
+		bool transient;
+		bool perFlight;
+	};
+	struct Pass {
+		const char *name;
+		uint32_t firstAccess; // in `accesses`
+		uint32_t accessesN;
+		Record record;
+		bool sideEffects;
+	};
+	// what a resource's accesses since it was last written still need waiting for
+	struct State {
+		bool written = false;
+		VkPipelineStageFlags writeStages = 0;
+		VkAccessFlags writeAccess = 0;
+		VkPipelineStageFlags readStages = 0; // since the write, which a new write has to wait for
+		VkPipelineStageFlags visibleStages = 0; // that the write has been made visible to
+		VkAccessFlags visibleAccess = 0;
+	};
+	struct Barrier {
+		VkPipelineStageFlags srcStages = 0;
+		VkPipelineStageFlags dstStages = 0;
+		VkAccessFlags srcAccess = 0;
+		VkAccessFlags dstAccess = 0;
+	};
+	
+	FrameArena *arena = nullptr;
+	uint32_t flight = 0;
+	// cleared each frame, keeping their capacity
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+	std::vector<Access> accesses;
+	// by pass, set by `Compile`
+	std::span<bool> kept;
+	std::span<Barrier> barriers; // before each pass; none where `srcStages` is 0
+	std::map<std::pair<std::string_view, uint32_t>, State> carried; // of the last frame's resources that aren't transient, by name and flight; `sharedFlight` for those without a copy per flight
+	static constexpr uint32_t sharedFlight = UINT32_MAX;
+	
+	std::span<const Access> Accesses(const Pass &pass) const { return {accesses.data() + pass.firstAccess, pass.accessesN}; }
+	
+	void Cull();
+	void PlaceBarriers();
+	std::pair<std::string_view, uint32_t> CarriedKey(const Resource &resource) const { return {resource.name, resource.perFlight ? flight : sharedFlight}; }
+};
+
+#endif /* FrameGraph_hpp */
@@ -0,0 +1,124 @@
+#ifndef GeometryArena_hpp
+#define GeometryArena_hpp
+
+#include <functional>
+#include <optional>
+#include <set>
+#include <unordered_map>
+
+#include "PipelineMain.hpp"
+
+#define GEOMETRY_ARENA_VERTICES (1 << 20) // 32 MB of `PipelineMain::Vertex`
+#define GEOMETRY_ARENA_DEFRAGMENT_AT 0.5f // the arena is compacted when it's flushed with at least this `RangeAllocator::Statistics::Fragmentation()`
+
+// the first `GEOMETRY_STORAGE_VERTICES` vertices of the arena, for shaders that fetch vertices themselves
+struct GeometryStorage {
+	PipelineMain::Vertex vertices[GEOMETRY_STORAGE_VERTICES];
+};
+
+// Two-level segregated fit allocator over `capacity` elements. Free ranges are listed by size class, a power of two split linearly into `slN`, and the lists with anything in are marked in two levels of bitmaps, so allocating and freeing take constant time however many ranges there are. Freed ranges are merged with their neighbours.
+class RangeAllocator {
+public:
+	RangeAllocator(uint32_t _capacity);
+	
+	// returns the offset of the first element of the allocated range
+	std::optional<uint32_t> Allocate(uint32_t count);
+	// `offset` and `count` must be those of an allocated range
+	void Free(uint32_t offset, uint32_t count);
+	
+	uint32_t GetCapacity() const { return capacity; }
+	uint32_t GetUsed() const { return used; }
+	// one past the last element that has ever been allocated and not since freed at the end
+	uint32_t GetEnd() const;
+	
+	struct Statistics {
+		uint32_t allocations;
+		uint32_t freeRanges;
+		uint32_t free; // elements
+		uint32_t largestFree;
+		
+		// of the free space, the fraction outside the largest free range; an allocation of all of it would fail by this much
+		float Fragmentation() const { return free ? 1.0f - float(largestFree) / float(free) : 0.0f; }
+	};
+	// walks every range, so isn't for every frame
+	Statistics GetStatistics() const;
+	
+private:
+	static constexpr uint32_t slBits = 4;
+	static constexpr uint32_t slN = 1 << slBits; // linear classes per power of two; counts below this each have their own
+	static constexpr uint32_t flN = 32 - slBits + 1;
+	static constexpr uint32_t none = UINT32_MAX;
+	
+	// an allocated or free range; every range of the allocator is one, in order of offset through `prevPhysical` and `nextPhysical`
+	struct Block {
+		uint32_t offset;
+		uint32_t count;
+		bool free;
+		uint32_t prevPhysical; // indices in `blocks`, or `none`
+		uint32_t nextPhysical;
+		uint32_t prevFree; // in its class's free list, if free
+		uint32_t nextFree;
+	};
+	std::vector<Block> blocks;
+	std::vector<uint32_t> spareBlocks; // indices of unused entries of `blocks`
+	std::unordered_map<uint32_t, uint32_t> allocated; // offset -> block
+	uint32_t first; // the blocks at each end
+	uint32_t last;
+	
+	uint32_t flBitmap = 0; // bit `fl` set if any list of that power of two has a range
+	uint32_t slBitmaps[flN] = {}; // bit `sl` set if list `[fl][sl]` has a range
+	uint32_t freeLists[flN][slN]; // first block of each list
+	
+	uint32_t capacity;
+	uint32_t used = 0;
+	
+	static void Classify(uint32_t count, uint32_t &fl, uint32_t &sl);
+	// the first free block of the smallest class at or above `[fl][sl]` with one
+	uint32_t FindFree(uint32_t fl, uint32_t sl) const;
+	void InsertFree(uint32_t block);
+	void RemoveFree(uint32_t block);
+	uint32_t NewBlock(const Block &block);
+	void ReleaseBlock(uint32_t block);
+};
+
+// A single vertex buffer holding the vertices of every mesh, so it only needs binding once per pass, and so that however many meshes are loaded they take one device allocation per flight. Meshes are ranges within it, drawn with `firstVertex` offset to their start.
+class GeometryArena {
+public:
+	GeometryArena(std::shared_ptr<EVK::Devices> _devices, uint32_t vertexCapacity=GEOMETRY_ARENA_VERTICES);
+	
+	// copies the vertices into the arena, returning the index of the first one; if the arena is defragmented, `moved` is called with the range's new first vertex
+	std::optional<uint32_t> AddVertices(const PipelineMain::Vertex *data, uint32_t count, std::function<void(uint32_t)> moved={});
+	void FreeVertices(uint32_t first, uint32_t count);
+	
+	// Uploads the arena to `flight`'s vertex buffer if anything was added or moved since that flight's last upload, defragmenting it first if it's reached `GEOMETRY_ARENA_DEFRAGMENT_AT`. Each flight has its own buffer, only written once its previous frame has finished, so the other frames in flight keep drawing from theirs undisturbed. Must happen in `flight`'s frame before the arena is bound, and before draws are gathered.
+	void Flush(uint32_t flight);
+	
+	// packs every range down to the start of the arena, in order, so the free space is all at the end
+	void Defragment();
+	
+	RangeAllocator::Statistics GetStatistics() const { return allocator.GetStatistics(); }
+	
+	bool CmdBind(VkCommandBuffer commandBuffer, uint32_t flight);
+	
+	// Also keeps a host visible copy of the arena per flight, readable as a storage buffer (the visibility buffer resolve fetches vertices this way). Off unless enabled, for the memory it takes.
+	void EnableStorage();
+	// copies the arena into `flight`'s storage buffer if it has changed since the flight's last copy
+	void FlushStorage(uint32_t flight);
+	const std::shared_ptr<EVK::StorageBufferObject<GeometryStorage>> &GetStorage() const { return storage; }
+	
+private:
+	std::shared_ptr<EVK::Devices> devices;
+	std::map<uint32_t, std::shared_ptr<EVK::VertexBufferObject>> vbos; // by flight, created as each flight is first flushed
+	std::set<uint32_t> vbosCurrent; // flights whose vertex buffer is up to date
+	
+	// `EVK::VertexBufferObject` can only be filled as a whole, so a CPU copy is kept to re-upload from
+	std::vector<PipelineMain::Vertex> vertices;
+	RangeAllocator allocator;
+	std::map<uint32_t, std::pair<uint32_t, std::function<void(uint32_t)>>> ranges; // first vertex -> count and `moved`, in order for defragmenting
+	bool freed = false; // since fragmentation was last checked
+	
+	std::shared_ptr<EVK::StorageBufferObject<GeometryStorage>> storage;
+	std::set<uint32_t> storageCurrent; // flights whose storage copy is up to date
+};
+
+#endif /* GeometryArena_hpp */
@@ -0,0 +1,35 @@
+#ifndef GpuTimer_hpp
+#define GpuTimer_hpp
+
+#include <optional>
+
+#include "Header.hpp"
+
+// Times sections of a frame on the GPU with pairs of timestamp queries. Each flight has its own queries, which are read when the flight next comes round, once its fence has been waited on.
+class GpuTimer {
+public:
+	GpuTimer(std::shared_ptr<EVK::Devices> _devices, uint32_t _sectionsN);
+	~GpuTimer();
+	
+	// must be recorded outside a render pass, before any other commands of this timer in the flight; the flight's previous results can't be read after this
+	void CmdReset(VkCommandBuffer commandBuffer, uint32_t flight);
+	
+	void CmdBegin(VkCommandBuffer commandBuffer, uint32_t flight, uint32_t section);
+	void CmdEnd(VkCommandBuffer commandBuffer, uint32_t flight, uint32_t section);
+	
+	// milliseconds `section` took when `flight` last ran; empty if it wasn't timed or the results aren't available
+	std::optional<double> Read(uint32_t flight, uint32_t section) const;
+	
+private:
+	std::shared_ptr<EVK::Devices> devices;
+	uint32_t sectionsN;
+	double millisecondsPerTick;
+	
+	struct Flight {
+		VkQueryPool queryPool;
+		std::vector<bool> timed; // whether each section had both its timestamps recorded since the last reset
+	};
+	std::map<uint32_t, Flight> flights; // created as each flight is first reset
+};
+
+#endif /* GpuTimer_hpp */
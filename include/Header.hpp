@@ -2,6 +2,8 @@
 #define Header_hpp
 
 #include <map>
+#include <string>
+#include <vector>
 #include <sys/time.h>
 
 #include <mattresses.h>
@@ -12,16 +14,16 @@
 #include <evk/Resources.hpp>
 
 #include <ReadProcessedObj.hpp>
+#include "SharedConstants.hpp"
 
 
 #define GRAPHICS_PIPELINES_N 7
 enum class GraphicsPipeline {mainInstanced, mainOnce, hud, shadowInstanced, shadowOnce, skybox, finall};
 
-#define SAMPLERS_N 3
-enum class Sampler {main, cube, shadow, _COUNT_};
+#define SAMPLERS_N 6
+enum class Sampler {main, cube, shadow, shadowCompare, evsm, point, _COUNT_};
 
-enum class UBO {mainGlobal, mainPerObject, hud, shadow, skybox, histogram};
-enum class SBO {histogram};
+enum class UBO {mainGlobal, mainPerObject, hud, shadow, skybox};
 
 #define BUFFERED_RENDER_PASSES_N 1
 enum class BRP {finall};
@@ -33,24 +35,220 @@ enum class VertexBufferBinding {vertex, instance}; // binding locations for vert
 
 #define MAX_INSTANCES 10000
 
-#define FINAL_FORMAT VK_FORMAT_R32G32B32A32_SFLOAT
+#define STATIC_BATCH_CELL_SIZE 250.0f // side length of the square world-space cells static geometry is split into for culling
+
+// The scene is drawn into an HDR colour target, tonemapped by the final pass. It is written, blended and sampled every frame, so its format is chosen at startup to trade precision for bandwidth.
+enum class HdrFormat {
+	r11g11b10, // `VK_FORMAT_B10G11R11_UFLOAT_PACK32`, 4 bytes per pixel; no alpha or negative values, which nothing reads back
+	rgba16, // `VK_FORMAT_R16G16B16A16_SFLOAT`, 8 bytes per pixel
+	rgba32, // `VK_FORMAT_R32G32B32A32_SFLOAT`, 16 bytes per pixel; the original format, kept as a reference
+	_COUNT_
+};
 
 // texture images:
 #define OTHER_IMAGES_N 4
 enum class OtherImage {skybox, shadow_cascades, colour, depth};
 
-#define PNGS_N 4 // debug, chair, chainsaw, concrete
+enum class MaterialClass {opaque, alphaTested, transparent}; // by the alpha of a material's texture: all 1; all 0 or 1; or anything else. Drawn in this order.
+
+// Render every cascade in one render pass with multiview (`VK_KHR_multiview`, core in Vulkan 1.1), selecting the cascade by `gl_ViewIndex`.
+// Requires the device's `multiview` feature, which is enabled through `DeviceFeatures` and checked at startup; without this defined, each cascade gets its own render pass.
+//#define SHADOW_MULTIVIEW
+
+// shadow casters are culled into one instance list per cascade, or a single list for all of them when they're drawn together
+#ifdef SHADOW_MULTIVIEW
+#define SHADOW_CULL_LISTS_N 1
+#else
+#define SHADOW_CULL_LISTS_N SHADOW_MAP_CASCADE_COUNT_MAX
+#endif
+
+// The nearest cascade is redrawn every frame and the others every `SHADOW_CASCADE_INTERVAL` frames, staggered so only one far cascade is redrawn at a time.
+// Static casters are cached in their own depth layers, only redrawn when their cascade moves by a texel, and copied into the cascade under the dynamic casters.
+#define SHADOW_CACHE
+#define SHADOW_CASCADE_INTERVAL 4
+#if defined(SHADOW_CACHE) && defined(SHADOW_MULTIVIEW)
+#error "SHADOW_CACHE schedules cascades individually, so can't be used with SHADOW_MULTIVIEW"
+#endif
+
+// Sample distribution shadow maps: the main pass depth is reduced on the GPU to the visible depth range and per cascade light space bounds, which are read back a frame later to fit the cascade splits and projections to
+#define SHADOW_SDSM
 
-#define SHADOW_MAP_CASCADE_COUNT 4 // current implementation requires this to be 4, as cascade split values are passed to shader as a vec4.
-#define SHADOWMAP_DIM 2048
 // 16 bits of depth is enough for such a small scene
 #define DEPTH_FORMAT VK_FORMAT_D16_UNORM
 
+// EVSM moments take four times the memory of the depth they're made from, so are made at most this size, point sampling the cascades if they're bigger
+#define EVSM_DIM_MAX 2048
+#define EVSM_FORMAT VK_FORMAT_R16G16B16A16_SFLOAT // the warp exponents (`EVSM_EXPONENT_*`) are the largest whose squares fit in half floats
+
+// The visibility buffer holds, per pixel, the index of an instance record in its upper bits and the triangle of that instance's draw in the rest; all ones means nothing was drawn
+#define VISIBILITY_FORMAT VK_FORMAT_R32_UINT
+#define VISIBILITY_RECORDS_MAX ((1u << (32 - VISIBILITY_TRIANGLE_BITS)) - 1u) // the last is reserved for nothing
+
+
+// Shadow settings, fixed at startup
+struct ShadowQuality {
+	uint32_t cascadeCount; // 1 to `SHADOW_MAP_CASCADE_COUNT_MAX`
+	uint32_t mapDim; // width and height of each cascade
+	uint32_t pcfHalfRange; // samples either side of the centre with `ShadowFilter::pcf`, so 2 is a 5x5 grid
+	
+	enum class Tier {low, medium, high, ultra, _COUNT_};
+	static const ShadowQuality tiers[int(Tier::_COUNT_)];
+	static constexpr const char *tierNames[int(Tier::_COUNT_)] = {"low", "medium", "high", "ultra"};
+	static constexpr Tier defaultTier = Tier::high;
+	
+	// reads "--shadows=<tier>", "--shadow-cascades=<n>" and "--shadow-dim=<n>"; later arguments override earlier ones
+	static ShadowQuality FromArguments(int argc, const char *argv[]);
+	
+	uint32_t EvsmDim() const { return mapDim < EVSM_DIM_MAX ? mapDim : EVSM_DIM_MAX; }
+};
+extern ShadowQuality shadowQuality;
+
+// how the main pass filters its shadow map lookups; values are those of the `SHADOW_FILTER_` defines in main.frag
+enum class ShadowFilter {
+	pcf, // manual comparisons over a grid `ShadowQuality::pcfHalfRange` either side of the centre; the original filter
+	hardware, // one bilinear comparison by the sampler
+	gather9, // a 5x5 texel box from 9 comparison gathers
+	gather16, // 7x7 texels from 16 comparison gathers
+	evsm, // exponential variance shadow maps, prefiltered with a separable blur
+	_COUNT_
+};
+
+// can change while running (the F key cycles the filter)
+struct ShadowFilterSettings {
+	ShadowFilter filter = ShadowFilter::gather9;
+	bool benchmark = false; // time the main pass with each filter in turn
+	
+	static constexpr const char *filterNames[int(ShadowFilter::_COUNT_)] = {"pcf", "hardware", "gather9", "gather16", "evsm"};
+	
+	// reads "--shadow-filter=<name>" and "--shadow-benchmark"
+	static ShadowFilterSettings FromArguments(int argc, const char *argv[]);
+};
+extern ShadowFilterSettings shadowFilterSettings;
+
+// auto-exposure, in log2 luminance for the range the histogram covers
+#define EXPOSURE_MIN_LOG_LUMINANCE -8.0f
+#define EXPOSURE_MAX_LOG_LUMINANCE 4.0f
+#define EXPOSURE_KEY_VALUE 0.18f // mid grey, which the adapted average luminance is exposed to
+#define EXPOSURE_ADAPTATION_RATE 1.5f // per second; the adapted luminance closes 1 - e^(-rate*t) of the gap to the current average in t seconds
+
+struct HdrSettings {
+	HdrFormat format = HdrFormat::rgba16;
+	bool benchmark = false; // time the passes that touch the HDR target and estimate its traffic
+	
+	static constexpr const char *formatNames[int(HdrFormat::_COUNT_)] = {"r11g11b10", "rgba16f", "rgba32f"};
+	static constexpr VkFormat vkFormats[int(HdrFormat::_COUNT_)] = {VK_FORMAT_B10G11R11_UFLOAT_PACK32, VK_FORMAT_R16G16B16A16_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT};
+	static constexpr uint32_t bytesPerPixel[int(HdrFormat::_COUNT_)] = {4, 8, 16};
+	
+	VkFormat ColourFormat() const { return vkFormats[int(format)]; }
+	uint32_t BytesPerPixel() const { return bytesPerPixel[int(format)]; }
+	
+	// reads "--hdr-format=<name>" and "--hdr-benchmark"
+	static HdrSettings FromArguments(int argc, const char *argv[]);
+	
+	// falls back to "rgba16f" if the chosen format can't be rendered to, blended and sampled
+	void Validate(const std::shared_ptr<EVK::Devices> &devices);
+};
+extern HdrSettings hdrSettings;
+
+// compute post-processing effects; values are bits of `PipelinePost::PushConstants::effects`, applied in this order within a dispatch
+enum class PostEffect {
+	sharpen, // contrast adaptive sharpening; needs its input in memory, so comes first in a dispatch
+	grade, // lift, gamma and gain, then contrast and saturation
+	tonemap, // exposure and the curve of final.frag; always ends a chain
+	_COUNT_
+};
+
+struct PostSettings {
+	std::vector<PostEffect> chain {}; // empty to tonemap in the final pass
+	bool fuse = true; // run consecutive effects in one dispatch where they can be
+	bool timing = false; // print each effect's mean GPU time each second; turns fusing off
+	
+	static constexpr const char *effectNames[int(PostEffect::_COUNT_)] = {"sharpen", "grade", "tonemap"};
+	
+	// reads "--post=<effect,...>", "--post-unfused" and "--post-timing", adding "tonemap" to a chain without it
+	static PostSettings FromArguments(int argc, const char *argv[]);
+};
+extern PostSettings postSettings;
+
+// dynamic resolution: the scene is drawn at a scale of the window chosen each frame to hold a GPU frame time, then upsampled
+struct ResolutionSettings {
+	float targetMs = 0.0f; // GPU milliseconds per frame to aim for; 0 always draws at full resolution
+	float minScale = 0.5f; // the smallest fraction of the window's width and height drawn
+	float sharpness = 0.5f; // of the upsampling at `minScale`, from 0 to 1, falling to none at full resolution
+	
+	bool Dynamic() const { return targetMs > 0.0f; }
+	
+	// reads "--dynamic-resolution=<target ms>", "--min-resolution-scale=<scale>" and "--upsample-sharpness=<sharpness>"
+	static ResolutionSettings FromArguments(int argc, const char *argv[]);
+};
+extern ResolutionSettings resolutionSettings;
+
+// choices that depend on what's being drawn
+struct SceneSettings {
+	bool depthPrepass = true; // lay down depth first, so the main pass only shades visible fragments (the P key toggles it)
+	bool pipelineStatistics = false; // print the main pass's mean fragment shader invocations each second
+	uint32_t localLights = 256; // point and spot lights scattered over the level, up to `LIGHTS_MAX`
+	bool visibilityBuffer = false; // draw IDs for opaque geometry, then shade each pixel once in a resolve; fixed at startup
+	bool fog = true; // height fog over the scene and sky
+	bool printFrameGraph = false; // print the frame's passes, barriers and culling whenever they change
+	bool printArena = false; // print what the geometry arena moved whenever it is defragmented, and each frame arena's growth
+	
+	// reads "--depth-prepass=<on|off>", "--pipeline-statistics", "--lights=<n>", "--renderer=<forward|visibility>", "--fog=<on|off>", "--frame-graph" and "--arena-statistics"
+	static SceneSettings FromArguments(int argc, const char *argv[]);
+};
+extern SceneSettings sceneSettings;
+
+// optional device features, enabled at device creation where the physical device has them; each is only true if it was enabled
+struct DeviceFeatures {
+	bool multiview; // for `SHADOW_MULTIVIEW`; not requested without it
+	bool pipelineStatisticsQuery; // for `FragmentCounter`
+	bool depthClamp; // for the shadow casters' pipelines, so casters in front of a cascade are flattened onto it rather than clipped
+	bool dynamicDepthState; // the depth compare op and write enable set while recording, for the depth pre-pass; from `VK_EXT_extended_dynamic_state`
+	
+	// set by `Load` to the extension's functions; null without `dynamicDepthState`
+	PFN_vkCmdSetDepthCompareOp cmdSetDepthCompareOp = nullptr;
+	PFN_vkCmdSetDepthWriteEnable cmdSetDepthWriteEnable = nullptr;
+	
+	// passed to `EVK::Devices` to add to its device create info; what `deviceCI` is pointed to is kept in here
+	void Request(VkPhysicalDevice physicalDevice, VkDeviceCreateInfo &deviceCI);
+	
+	// once the device is created
+	void Load(VkDevice device);
+	
+private:
+	std::vector<const char *> extensionNames;
+	VkPhysicalDeviceFeatures2 features2;
+	VkPhysicalDeviceMultiviewFeatures multiviewFeatures;
+	VkPhysicalDeviceExtendedDynamicStateFeaturesEXT extendedDynamicStateFeatures;
+};
+extern DeviceFeatures deviceFeatures;
+
 
 // Tools
 unsigned long UTime();
 uint32_t GetTextureIdFromMtl(const char *usemtl);
 
+// axis-aligned box
+struct Bounds {
+	vec<3> min;
+	vec<3> max;
+	
+	void Expand(const vec<3> &point){
+		min = {fminf(min.x, point.x), fminf(min.y, point.y), fminf(min.z, point.z)};
+		max = {fmaxf(max.x, point.x), fmaxf(max.y, point.y), fmaxf(max.z, point.z)};
+	}
+	void Expand(const Bounds &box){
+		Expand(box.min);
+		Expand(box.max);
+	}
+	
+	vec<3> Centre() const { return 0.5f*(min + max); }
+};
+// conservative: only returns true if every corner of the box is outside the same clip plane of `viewProjection`. Without `nearPlane`, boxes in front of the near plane count as inside (e.g. shadow casters between the light and a cascade).
+bool BoxOutsideFrustum(const mat<4, 4> &viewProjection, const Bounds &box, bool nearPlane=true);
+// the axis-aligned box containing `box` after transformation
+Bounds TransformBounds(const mat<4, 4> &transform, const Bounds &box);
+
 
 // -----
 // Pipelines
@@ -103,24 +301,6 @@ VkVertexInputAttributeDescription{
 }
 >>;
 
-using AttributesOnce = EVK::Attributes<EVK::BindingDescriptionPack<
-VkVertexInputBindingDescription{
-	0, // binding
-	32,//sizeof(Vertex), // stride
-	VK_VERTEX_INPUT_RATE_VERTEX // input rate
-}
->, EVK::AttributeDescriptionPack<
-VkVertexInputAttributeDescription{
-	0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0//offsetof(Vertex, position)
-},
-VkVertexInputAttributeDescription{
-	1, 0, VK_FORMAT_R32G32B32_SFLOAT, 12//offsetof(Vertex, normal)
-},
-VkVertexInputAttributeDescription{
-	2, 0, VK_FORMAT_R32G32_SFLOAT, 24//offsetof(Vertex, texCoord)
-}
->>;
-
 struct PerObject {
 	mat<4, 4, float32_t> model;
 	mat<4, 4, float32_t> modelInvT;
@@ -144,25 +324,6 @@ struct PushConstants_Frag {
 
 
 
-struct Pipeline_Histogram {
-	struct UBO {
-		float32_t params[4];
-		
-		static const int binding = 0;
-	};
-	static const int ubosN = 1;
-	
-	struct SBO {
-		uint32_t bin[256];
-		
-		static const int binding = 2;
-	};
-	
-	static const int hdrImageBinding = 1;
-};
-
-
-
 
 // Global constants
 struct Globals {
@@ -171,8 +332,8 @@ struct Globals {
 		static const int indexedN = 0;													// number of objects that are rendered indexed (each of which gets an index buffer)
 	};
 	struct MainOnce {
-		static const int renderedN = 3;
 		static const int indexedN = 0;
+		static const size_t maxN = MAX_INSTANCES; // `Once` objects are registered at runtime, each taking a slot in the shared per-object instance buffer
 	};
 	struct HUD {
 		static const int renderedN = 1;
@@ -192,9 +353,10 @@ struct Globals {
 //	static constexpr int ubosN = Shared_Main::ubosN + Pipeline_Hud::ubosN + Shared_Shadow::ubosN + Pipeline_Skybox::ubosN + Pipeline_Histogram::ubosN;										// total number of uniform buffer objects required (across all pipelines)
 	
 	static constexpr vec<3> lightDirection = (vec<3>){-0.700140042f, 0.1400280084f, -0.700140042f};
-	static constexpr float cameraZNear = 0.1f;
-	static constexpr float cameraZFar = 1000.0f;
+	static constexpr float cameraZNear = CAMERA_Z_NEAR;
+	static constexpr float cameraZFar = CAMERA_Z_FAR;
 	static constexpr float cascadeSplitLambda = 0.5f;
+	static constexpr float sdsmMargin = 0.05f; // fraction that read back sample bounds are grown by, as they're a frame old
 };
 
 #endif /* Header_hpp */
@@ -0,0 +1,43 @@
+#ifndef Lights_hpp
+#define Lights_hpp
+
+#include <optional>
+
+#include "Header.hpp"
+#include "PipelineClusters.hpp"
+
+// The local (point and spot) lights, kept on the CPU and copied into a host visible buffer for each flight, which the cluster pass bins and the main pass shades from. Handles stay valid until removed, however other lights are added and removed.
+class LightBuffer {
+public:
+	using Handle = uint32_t;
+	
+	LightBuffer(std::shared_ptr<EVK::Devices> _devices);
+	
+	// both return empty once there are `LIGHTS_MAX` lights
+	std::optional<Handle> AddPoint(const vec<3> &position, float range, const vec<3> &colour);
+	// `innerAngle` and `outerAngle` are cone half-angles in radians; the light fades out between them
+	std::optional<Handle> AddSpot(const vec<3> &position, float range, const vec<3> &colour, const vec<3> &direction, float innerAngle, float outerAngle);
+	void Remove(Handle handle);
+	
+	// changes show from the next `Upload`
+	PipelineClusters::Light &Get(Handle handle){ return slots[handle].light; }
+	
+	// copies the lights into `flight`'s buffer, packed so there are no gaps
+	void Upload(uint32_t flight);
+	
+	const std::shared_ptr<EVK::StorageBufferObject<PipelineClusters::LightsSBO>> &GetSBO() const { return sbo; }
+	
+private:
+	std::optional<Handle> Add(const PipelineClusters::Light &light);
+	
+	std::shared_ptr<EVK::StorageBufferObject<PipelineClusters::LightsSBO>> sbo; // host visible, one per flight
+	
+	struct Slot {
+		PipelineClusters::Light light;
+		bool used;
+	};
+	std::vector<Slot> slots; // indexed by handle
+	std::vector<Handle> freeHandles;
+};
+
+#endif /* Lights_hpp */
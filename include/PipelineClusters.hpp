@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Header.hpp"
+
+namespace PipelineClusters {
+
+static constexpr uint32_t groupSize = 64; // threads per work group, one per cluster, as in clusters.comp
+
+struct UBO {
+	mat<4, 4, float32_t> clipToView; // inverse of the camera projection
+	mat<4, 4, float32_t> view; // as `PipelineMain::UBO_Global::viewInv`
+};
+
+struct Light {
+	vec<4, float32_t> positionRange; // world space position, and the distance at which the light has faded to nothing
+	vec<4, float32_t> colourCosInner; // rgb pre-multiplied by intensity; w is the cosine of a spot light's inner cone half-angle, inside which it is at full strength
+	vec<4, float32_t> directionCosOuter; // a spot light's unit direction, and the cosine of its outer cone half-angle; point lights have w = -1
+};
+
+// written by the CPU every frame
+struct LightsSBO {
+	uint32_t count;
+	uint32_t padding[3];
+	Light lights[LIGHTS_MAX];
+};
+
+// written by the cluster pass every frame
+struct ClustersSBO {
+	struct Cluster {
+		uint32_t count;
+		uint32_t indices[CLUSTER_LIGHTS_MAX]; // into `LightsSBO::lights`
+	};
+	Cluster clusters[CLUSTERS_N]; // x fastest, then y, then z
+};
+
+namespace ComputeShader {
+
+static constexpr char computeFilename[] = "../Resources/Shaders/clusters.spv";
+
+using type = EVK::Shader<VK_SHADER_STAGE_COMPUTE_BIT, computeFilename, EVK::NoPushConstants,
+EVK::UBOUniform<0, 0, UBO>,
+EVK::SBOUniform<0, 1, LightsSBO>,
+EVK::SBOUniform<0, 2, ClustersSBO>
+>;
+static_assert(EVK::shader_c<type>);
+
+} // namespace ComputeShader
+
+using type = EVK::ComputePipeline<ComputeShader::type>;
+
+inline std::shared_ptr<type> Build(std::shared_ptr<EVK::Devices> devices){
+	return std::make_shared<type>(devices);
+}
+
+} // namespace PipelineClusters
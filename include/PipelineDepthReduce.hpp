@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Header.hpp"
+
+namespace PipelineDepthReduce {
+
+static constexpr uint32_t groupSize = 16; // threads in x and y per work group, as in depthReduce.comp
+
+struct UBO {
+	mat<4, 4, float32_t> clipToView; // inverse of the camera projection
+	mat<4, 4, float32_t> viewToLight; // from camera view space to the light's view space without translation
+	float32_t cascadeSplits[SHADOW_MAP_CASCADE_COUNT_MAX]; // as in `PipelineMain::UBO_Global`, but those past the cascades in use are `-FLT_MAX`, so no depth selects them
+	int32_t padding0;
+	int32_t padding1;
+	vec<2, float32_t> viewportScale; // as in `PipelineMain::UBO_Global`; only the depth drawn to is reduced
+};
+
+// every value is a float encoded with `EncodeOrderedFloat`, so atomic min and max on the integers give those of the floats
+struct SBO {
+	uint32_t lightMin[SHADOW_MAP_CASCADE_COUNT_MAX][4]; // xyz, w unused
+	uint32_t lightMax[SHADOW_MAP_CASCADE_COUNT_MAX][4];
+	uint32_t depthMin; // positive view depth
+	uint32_t depthMax;
+};
+
+inline uint32_t EncodeOrderedFloat(float f){
+	uint32_t u;
+	memcpy(&u, &f, sizeof(float));
+	return (u & 0x80000000u) ? ~u : u | 0x80000000u;
+}
+inline float DecodeOrderedFloat(uint32_t u){
+	u = (u & 0x80000000u) ? u & 0x7fffffffu : ~u;
+	float f;
+	memcpy(&f, &u, sizeof(float));
+	return f;
+}
+
+namespace ComputeShader {
+
+static constexpr char computeFilename[] = "../Resources/Shaders/depthReduce.spv";
+
+using type = EVK::Shader<VK_SHADER_STAGE_COMPUTE_BIT, computeFilename, EVK::NoPushConstants,
+EVK::UBOUniform<0, 0, UBO>,
+EVK::CombinedImageSamplersUniform<0, 1, 1>,
+EVK::SBOUniform<0, 2, SBO>
+>;
+static_assert(EVK::shader_c<type>);
+
+} // namespace ComputeShader
+
+using type = EVK::ComputePipeline<ComputeShader::type>;
+
+inline std::shared_ptr<type> Build(std::shared_ptr<EVK::Devices> devices){
+	return std::make_shared<type>(devices);
+}
+
+} // namespace PipelineDepthReduce
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "Header.hpp"
+
+namespace PipelineEvsm {
+
+static constexpr uint32_t groupSize = 16; // threads in x and y per work group, as in evsmBlur.comp
+
+struct PushConstants {
+	int32_t layer; // the cascade being prefiltered
+};
+using PCS = EVK::PushConstants<0, PushConstants>;
+static_assert(EVK::pushConstants_c<PCS>);
+
+// warps a cascade's depth into moments, blurring them horizontally into a single layer intermediate image
+namespace Horizontal {
+
+namespace ComputeShader {
+
+static constexpr char computeFilename[] = "../Resources/Shaders/evsmBlurHorizontal.spv";
+
+using type = EVK::Shader<VK_SHADER_STAGE_COMPUTE_BIT, computeFilename, PCS,
+EVK::CombinedImageSamplersUniform<0, 0, 1>, // shadow map
+EVK::StorageImagesUniform<0, 1, 1> // intermediate
+>;
+static_assert(EVK::shader_c<type>);
+
+} // namespace ComputeShader
+
+using type = EVK::ComputePipeline<ComputeShader::type>;
+
+inline std::shared_ptr<type> Build(std::shared_ptr<EVK::Devices> devices){
+	return std::make_shared<type>(devices);
+}
+
+} // namespace Horizontal
+
+// blurs the intermediate vertically into the cascade's layer of the moments image
+namespace Vertical {
+
+namespace ComputeShader {
+
+static constexpr char computeFilename[] = "../Resources/Shaders/evsmBlurVertical.spv";
+
+using type = EVK::Shader<VK_SHADER_STAGE_COMPUTE_BIT, computeFilename, PCS,
+EVK::CombinedImageSamplersUniform<0, 0, 1>, // intermediate
+EVK::StorageImagesUniform<0, 1, 1> // moments
+>;
+static_assert(EVK::shader_c<type>);
+
+} // namespace ComputeShader
+
+using type = EVK::ComputePipeline<ComputeShader::type>;
+
+inline std::shared_ptr<type> Build(std::shared_ptr<EVK::Devices> devices){
+	return std::make_shared<type>(devices);
+}
+
+} // namespace Vertical
+
+} // namespace PipelineEvsm
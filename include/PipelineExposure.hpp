@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Header.hpp"
+
+// Auto-exposure: a histogram of the HDR target's log luminance (`Histogram`) is reduced by a single work group to an average that adapts over time (`Average`), which the final pass exposes by. Everything stays on the GPU.
+namespace PipelineExposure {
+
+static constexpr uint32_t binsN = 256; // as in histogram.comp and exposureAverage.comp
+static constexpr uint32_t histogramGroupSize = 16; // threads in x and y per work group of the histogram, as in histogram.comp; each thread covers 2x2 pixels
+
+struct UBO {
+	float32_t minLogLuminance; // log2 of the dimmest luminance binned; anything dimmer goes in bin 0, which the average ignores
+	float32_t inverseLogLuminanceRange;
+	float32_t logLuminanceRange; // log2 of the brightest luminance binned, less `minLogLuminance`
+	float32_t adaptation; // how far to move the adapted luminance towards this frame's average, from 0 to 1, for the time since the flight last ran
+	float32_t keyValue; // the luminance the adapted average is exposed to
+	float32_t padding;
+	vec<2, float32_t> viewportScale; // as in `PipelineMain::UBO_Global`; only the part of the HDR target drawn to is binned
+};
+
+// one per flight, written only by the GPU after being initialised; the histogram is cleared by the average pass once it's read
+struct SBO {
+	uint32_t bins[binsN];
+	float32_t adaptedLuminance;
+	float32_t exposure; // what the final pass multiplies the scene colour by
+};
+
+// bins the luminance of the HDR target into the flight's histogram
+namespace Histogram {
+
+namespace ComputeShader {
+
+static constexpr char computeFilename[] = "../Resources/Shaders/histogram.spv";
+
+using type = EVK::Shader<VK_SHADER_STAGE_COMPUTE_BIT, computeFilename, EVK::NoPushConstants,
+EVK::UBOUniform<0, 0, UBO>,
+EVK::CombinedImageSamplersUniform<0, 1, 1>, // the HDR target
+EVK::SBOUniform<0, 2, SBO>
+>;
+static_assert(EVK::shader_c<type>);
+
+} // namespace ComputeShader
+
+using type = EVK::ComputePipeline<ComputeShader::type>;
+
+inline std::shared_ptr<type> Build(std::shared_ptr<EVK::Devices> devices){
+	return std::make_shared<type>(devices);
+}
+
+} // namespace Histogram
+
+// a single work group that reduces the histogram to its mean, adapting the exposure towards it and clearing the histogram
+namespace Average {
+
+namespace ComputeShader {
+
+static constexpr char computeFilename[] = "../Resources/Shaders/exposureAverage.spv";
+
+using type = EVK::Shader<VK_SHADER_STAGE_COMPUTE_BIT, computeFilename, EVK::NoPushConstants,
+EVK::UBOUniform<0, 0, UBO>,
+EVK::SBOUniform<0, 1, SBO>
+>;
+static_assert(EVK::shader_c<type>);
+
+} // namespace ComputeShader
+
+using type = EVK::ComputePipeline<ComputeShader::type>;
+
+inline std::shared_ptr<type> Build(std::shared_ptr<EVK::Devices> devices){
+	return std::make_shared<type>(devices);
+}
+
+} // namespace Average
+
+} // namespace PipelineExposure
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "Header.hpp"
+#include "PipelineState.hpp"
+#include "PipelineExposure.hpp"
 
 namespace PipelineFinal {
 
@@ -38,88 +40,50 @@ namespace FragmentShader {
 
 static constexpr char fragmentFilename[] = "../Resources/Shaders/fragFinal.spv";
 
-using type = EVK::Shader<VK_SHADER_STAGE_FRAGMENT_BIT, fragmentFilename, EVK::NoPushConstants,
-EVK::CombinedImageSamplersUniform<0, 0, 1>
+// the scene is upsampled from the part of its target drawn to, with `ResolutionSettings`
+struct PushConstants {
+	vec<2, float32_t> uvScale; // as `PipelineMain::UBO_Global::viewportScale`
+	float32_t sharpness; // 0 for plain bilinear upsampling, up to 1
+};
+using PCS = EVK::PushConstants<0, PushConstants>;
+static_assert(EVK::pushConstants_c<PCS>);
+
+using type = EVK::Shader<VK_SHADER_STAGE_FRAGMENT_BIT, fragmentFilename, PCS,
+EVK::CombinedImageSamplersUniform<0, 0, 1>,
+EVK::SBOUniform<0, 1, PipelineExposure::SBO> // the exposure
 >;
 static_assert(EVK::shader_c<type>);
 
+// after the post-processing chain, which tonemaps, the swapchain pass only copies its output
+struct BlitPushConstants {
+	int32_t decodeSRGB; // whether the image holds sRGB encoded values in a linear format, as the post-processing chain's output does
+};
+using BlitPCS = EVK::PushConstants<0, BlitPushConstants>;
+static_assert(EVK::pushConstants_c<BlitPCS>);
+
+static constexpr char blitFragmentFilename[] = "../Resources/Shaders/fragBlit.spv";
+using blitType = EVK::Shader<VK_SHADER_STAGE_FRAGMENT_BIT, blitFragmentFilename, BlitPCS,
+EVK::CombinedImageSamplersUniform<0, 0, 1>
+>;
+static_assert(EVK::shader_c<blitType>);
+
 } // namespace FragmentShader
 
 using type = EVK::RenderPipeline<VertexShader::type, FragmentShader::type>;
+using blitType = EVK::RenderPipeline<VertexShader::type, FragmentShader::blitType>;
+
+// a full screen quad
+template <typename pipeline_t>
+inline std::shared_ptr<pipeline_t> BuildWithShaders(std::shared_ptr<EVK::Devices> devices, VkRenderPass renderPassHandle){
+	return BuildPipeline<pipeline_t>(devices, {
+		.renderPass = renderPassHandle,
+		.samples = SCENE_SAMPLES,
+		.depthTest = false
+	});
+}
 
 inline std::shared_ptr<type> Build(std::shared_ptr<EVK::Devices> devices, VkRenderPass renderPassHandle){
-	
-	VkPipelineRasterizationStateCreateInfo rasterizer{};
-	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	rasterizer.depthClampEnable = VK_FALSE;
-	rasterizer.rasterizerDiscardEnable = VK_FALSE;
-	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-	rasterizer.lineWidth = 1.0f;
-	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-	
-	// ----- Multisampling behaviour -----
-	VkPipelineMultisampleStateCreateInfo multisampling{};
-	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multisampling.sampleShadingEnable = VK_FALSE;
-	
-	// ----- Colour blending behaviour -----
-	VkPipelineColorBlendStateCreateInfo colourBlending{};
-	VkPipelineColorBlendAttachmentState colourBlendAttachment{};
-	colourBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	colourBlendAttachment.blendEnable = VK_TRUE;
-	colourBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-	colourBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-	colourBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-	colourBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-	colourBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-	colourBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-	
-	colourBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	colourBlending.logicOpEnable = VK_FALSE;
-	colourBlending.pAttachments = &colourBlendAttachment;
-	
-	// ----- Depth stencil behaviour -----
-	VkPipelineDepthStencilStateCreateInfo depthStencil{};
-	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-	depthStencil.depthTestEnable = VK_TRUE;
-	depthStencil.depthWriteEnable = VK_TRUE;
-	depthStencil.depthBoundsTestEnable = VK_FALSE;
-	depthStencil.stencilTestEnable = VK_FALSE;
-	
-	// ----- Dynamic state -----
-	VkPipelineDynamicStateCreateInfo dynamicState{};
-	VkDynamicState dynamicStates[3] = {
-		VK_DYNAMIC_STATE_VIEWPORT,
-		VK_DYNAMIC_STATE_SCISSOR,
-		VK_DYNAMIC_STATE_DEPTH_BIAS
-	};
-	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	dynamicState.pDynamicStates = dynamicStates;
-	
-	const EVK::RenderPipelineBlueprint blueprint = {
-		.primitiveTopology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-		.pRasterisationStateCI = &rasterizer,
-		.pMultisampleStateCI = &multisampling,
-		.pDepthStencilStateCI = &depthStencil,
-		.pColourBlendStateCI = &colourBlending,
-		.pDynamicStateCI = &dynamicState,
-		.renderPassHandle = renderPassHandle
-	};
-	
-	
-	rasterizer.cullMode = VK_CULL_MODE_NONE;
-	rasterizer.depthBiasEnable = VK_FALSE;
-#ifdef MSAA
-	multisampling.rasterizationSamples = interface->devices->GetMSAASamples();
-#else
-	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-#endif
-	colourBlending.attachmentCount = 1;
-	depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
-	dynamicState.dynamicStateCount = 2;
-	depthStencil.depthTestEnable = VK_FALSE;
-	
-	return std::make_shared<type>(devices, &blueprint);
+	return BuildWithShaders<type>(devices, renderPassHandle);
 }
 
 } // namespace PipelineFinal
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "Header.hpp"
+#include "PipelineState.hpp"
+#include "PipelineClusters.hpp"
 
 namespace PipelineMain {
 
@@ -11,29 +13,47 @@ struct Vertex {
 };
 
 struct UBO_Global {
-	mat<4, 4, float32_t> lightMat[SHADOW_MAP_CASCADE_COUNT];
+	mat<4, 4, float32_t> lightMat[SHADOW_MAP_CASCADE_COUNT_MAX];
 	mat<4, 4, float32_t> viewInv;
 	mat<4, 4, float32_t> proj;
 	vec<4, float32_t> lightColour;
-	float32_t cascadeSplits[SHADOW_MAP_CASCADE_COUNT]; // currently implemented as a vec4
+	float32_t cascadeSplits[SHADOW_MAP_CASCADE_COUNT_MAX]; // implemented as an array of vec4s, so must be a multiple of 4 long
 	vec<4, float32_t> lightDir; // only using first three components
 	vec<4, float32_t> cameraPosition; // only using first three components
+	int32_t cascadeCount; // how many of the above cascades are in use
+	int32_t shadowFilter; // a `ShadowFilter`
+	vec<2, float32_t> viewportScale; // the fraction of the targets' width and height drawn to, from the top left, with dynamic resolution
+	int32_t pcfHalfRange; // `ShadowQuality::pcfHalfRange`
+	int32_t fog; // `SceneSettings::fog`
+	int32_t padding0;
+	int32_t padding1;
 };
+static_assert(SHADOW_MAP_CASCADE_COUNT_MAX % 4 == 0);
 
 namespace FragmentShader {
 
 static constexpr char fragmentFilename[] = "../Resources/Shaders/fragMain.spv";
+static constexpr char alphaTestedFilename[] = "../Resources/Shaders/fragMainAlphaTested.spv"; // main.frag compiled with `ALPHA_TEST`
 
 using PCS = EVK::PushConstants<16, Shared_Main::PushConstants_Frag>;
 static_assert(EVK::pushConstants_c<PCS>);
 
-using type = EVK::Shader<VK_SHADER_STAGE_FRAGMENT_BIT, fragmentFilename, PCS,
+template <const char *filename>
+using type_t = EVK::Shader<VK_SHADER_STAGE_FRAGMENT_BIT, filename, PCS,
 EVK::UBOUniform<0, 0, UBO_Global>,
 EVK::TextureSamplersUniform<0, 1, 1>,
 EVK::TextureImagesUniform<0, 2, PNGS_N>,
-EVK::CombinedImageSamplersUniform<0, 3, 1>
+EVK::CombinedImageSamplersUniform<0, 3, 1>, // shadow map
+EVK::CombinedImageSamplersUniform<0, 4, 1>, // the same, with a comparison sampler
+EVK::CombinedImageSamplersUniform<0, 5, 1>, // EVSM moments
+EVK::SBOUniform<0, 6, PipelineClusters::LightsSBO>,
+EVK::SBOUniform<0, 7, PipelineClusters::ClustersSBO>
 >;
+
+using type = type_t<fragmentFilename>;
 static_assert(EVK::shader_c<type>);
+using alphaTestedType = type_t<alphaTestedFilename>;
+static_assert(EVK::shader_c<alphaTestedType>);
 
 } // namespace FragmentShader
 
@@ -53,174 +73,64 @@ static_assert(EVK::vertexShader_c<type>);
 
 using type = EVK::RenderPipeline<VertexShader::type, FragmentShader::type>;
 
-inline std::shared_ptr<type> Build(std::shared_ptr<EVK::Devices> devices, VkRenderPass renderPassHandle){
-	
-	VkPipelineRasterizationStateCreateInfo rasterizer{};
-	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	rasterizer.depthClampEnable = VK_FALSE;
-	rasterizer.rasterizerDiscardEnable = VK_FALSE;
-	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-	rasterizer.lineWidth = 1.0f;
-	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-	
-	// ----- Multisampling behaviour -----
-	VkPipelineMultisampleStateCreateInfo multisampling{};
-	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multisampling.sampleShadingEnable = VK_FALSE;
-	
-	// ----- Colour blending behaviour -----
-	VkPipelineColorBlendStateCreateInfo colourBlending{};
-	VkPipelineColorBlendAttachmentState colourBlendAttachment{};
-	colourBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	colourBlendAttachment.blendEnable = VK_TRUE;
-	colourBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-	colourBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-	colourBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-	colourBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-	colourBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-	colourBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-	
-	colourBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	colourBlending.logicOpEnable = VK_FALSE;
-	colourBlending.pAttachments = &colourBlendAttachment;
-	
-	// ----- Depth stencil behaviour -----
-	VkPipelineDepthStencilStateCreateInfo depthStencil{};
-	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-	depthStencil.depthTestEnable = VK_TRUE;
-	depthStencil.depthWriteEnable = VK_TRUE;
-	depthStencil.depthBoundsTestEnable = VK_FALSE;
-	depthStencil.stencilTestEnable = VK_FALSE;
-	
-	// ----- Dynamic state -----
-	VkPipelineDynamicStateCreateInfo dynamicState{};
-	VkDynamicState dynamicStates[3] = {
-		VK_DYNAMIC_STATE_VIEWPORT,
-		VK_DYNAMIC_STATE_SCISSOR,
-		VK_DYNAMIC_STATE_DEPTH_BIAS
+// Shared by every pipeline that draws scene geometry with the main shaders. Only transparent geometry is drawn with `blend`; it is drawn last, and without depth writes. Opaque geometry is tested `EQUAL` without writes after a depth pre-pass, and `LESS` with writes otherwise; transparent geometry is tested `LESS` without writes, so the depth state is dynamic where the device allows. Without that there's no pre-pass, and the static state below is right for every class.
+inline PipelineState State(VkRenderPass renderPassHandle, bool blend){
+	return {
+		.renderPass = renderPassHandle,
+		.cullMode = VK_CULL_MODE_BACK_BIT,
+		.samples = SCENE_SAMPLES,
+		.blend = blend ? PipelineState::Blend::alpha : PipelineState::Blend::none,
+		.depthWrite = !blend,
+		.dynamic = PipelineState::dynamicViewport | PipelineState::dynamicScissor | (deviceFeatures.dynamicDepthState ? PipelineState::dynamicDepthCompareOp | PipelineState::dynamicDepthWriteEnable : 0)
 	};
-	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	dynamicState.pDynamicStates = dynamicStates;
-	
-	
-	rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-	rasterizer.depthBiasEnable = VK_FALSE;
-	colourBlending.attachmentCount = 1;
-	depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
-	dynamicState.dynamicStateCount = 2;
-#ifdef MSAA
-	multisampling.rasterizationSamples = interface->devices->GetMSAASamples();
-#else
-	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-#endif
-	
-	const EVK::RenderPipelineBlueprint blueprint = {
-		.primitiveTopology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-		.pRasterisationStateCI = &rasterizer,
-		.pMultisampleStateCI = &multisampling,
-		.pDepthStencilStateCI = &depthStencil,
-		.pColourBlendStateCI = &colourBlending,
-		.pDynamicStateCI = &dynamicState,
-		.renderPassHandle = renderPassHandle
-	};
-	
-	return std::make_shared<type>(devices, &blueprint);
+}
+
+inline std::shared_ptr<type> Build(std::shared_ptr<EVK::Devices> devices, VkRenderPass renderPassHandle, bool blend=false, const void *owner=nullptr){
+	return BuildPipeline<type>(devices, State(renderPassHandle, blend), owner);
 }
 
 } // namespace Instanced
 
-namespace Once {
+// As `Instanced`, but discarding fragments whose texture is transparent enough; for cut-out materials, which are never blended
+namespace AlphaTested {
+
+using type = EVK::RenderPipeline<Instanced::VertexShader::type, FragmentShader::alphaTestedType>;
+
+inline std::shared_ptr<type> Build(std::shared_ptr<EVK::Devices> devices, VkRenderPass renderPassHandle, const void *owner=nullptr){
+	return BuildPipeline<type>(devices, Instanced::State(renderPassHandle, false), owner);
+}
+
+} // namespace AlphaTested
+
+// Writes the depth of the opaque geometry the main pass draws, without shading, so the main pass can then shade only the visible fragments with an `EQUAL` depth test
+namespace DepthPrepass {
 
 namespace VertexShader {
 
-static constexpr char vertexFilename[] = "../Resources/Shaders/vertMainOnce.spv";
+static constexpr char vertexFilename[] = "../Resources/Shaders/vertDepthPrepass.spv";
 
-using type = EVK::VertexShader<vertexFilename, EVK::NoPushConstants, AttributesOnce,
-EVK::UBOUniform<0, 0, UBO_Global>,
-EVK::UBOUniform<1, 0, PerObject, true>
+// positions must come out bitwise identical to those of `Instanced::VertexShader`
+using type = EVK::VertexShader<vertexFilename, EVK::NoPushConstants, AttributesInstanced,
+EVK::UBOUniform<0, 0, UBO_Global>
 >;
 
 static_assert(EVK::vertexShader_c<type>);
 
 } // namespace VertexShader
 
-using type = EVK::RenderPipeline<VertexShader::type, FragmentShader::type>;
+using type = EVK::DepthPipeline<VertexShader::type>;
 
+// the subpass has a colour attachment, which is left untouched
 inline std::shared_ptr<type> Build(std::shared_ptr<EVK::Devices> devices, VkRenderPass renderPassHandle){
-	
-	VkPipelineRasterizationStateCreateInfo rasterizer{};
-	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	rasterizer.depthClampEnable = VK_FALSE;
-	rasterizer.rasterizerDiscardEnable = VK_FALSE;
-	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-	rasterizer.lineWidth = 1.0f;
-	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-	
-	// ----- Multisampling behaviour -----
-	VkPipelineMultisampleStateCreateInfo multisampling{};
-	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multisampling.sampleShadingEnable = VK_FALSE;
-	
-	// ----- Colour blending behaviour -----
-	VkPipelineColorBlendStateCreateInfo colourBlending{};
-	VkPipelineColorBlendAttachmentState colourBlendAttachment{};
-	colourBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	colourBlendAttachment.blendEnable = VK_TRUE;
-	colourBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-	colourBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-	colourBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-	colourBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-	colourBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-	colourBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-	
-	colourBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	colourBlending.logicOpEnable = VK_FALSE;
-	colourBlending.pAttachments = &colourBlendAttachment;
-	
-	// ----- Depth stencil behaviour -----
-	VkPipelineDepthStencilStateCreateInfo depthStencil{};
-	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-	depthStencil.depthTestEnable = VK_TRUE;
-	depthStencil.depthWriteEnable = VK_TRUE;
-	depthStencil.depthBoundsTestEnable = VK_FALSE;
-	depthStencil.stencilTestEnable = VK_FALSE;
-	
-	// ----- Dynamic state -----
-	VkPipelineDynamicStateCreateInfo dynamicState{};
-	VkDynamicState dynamicStates[3] = {
-		VK_DYNAMIC_STATE_VIEWPORT,
-		VK_DYNAMIC_STATE_SCISSOR,
-		VK_DYNAMIC_STATE_DEPTH_BIAS
-	};
-	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	dynamicState.pDynamicStates = dynamicStates;
-	
-	
-	rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-	rasterizer.depthBiasEnable = VK_FALSE;
-#ifdef MSAA
-	multisampling.rasterizationSamples = interface->devices->GetMSAASamples();
-#else
-	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-#endif
-	colourBlending.attachmentCount = 1;
-	depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
-	dynamicState.dynamicStateCount = 2;
-	
-	const EVK::RenderPipelineBlueprint blueprint = {
-		.primitiveTopology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-		.pRasterisationStateCI = &rasterizer,
-		.pMultisampleStateCI = &multisampling,
-		.pDepthStencilStateCI = &depthStencil,
-		.pColourBlendStateCI = &colourBlending,
-		.pDynamicStateCI = &dynamicState,
-		.renderPassHandle = renderPassHandle
-	};
-	
-	return std::make_shared<type>(devices, &blueprint);
+	return BuildPipeline<type>(devices, {
+		.renderPass = renderPassHandle,
+		.cullMode = VK_CULL_MODE_BACK_BIT, // as the main pass
+		.samples = SCENE_SAMPLES,
+		.colourWriteMask = 0
+	});
 }
 
-} // namespace Once
+} // namespace DepthPrepass
 
 } // namespace PipelineMain
 
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "Header.hpp"
+#include "PipelineExposure.hpp"
+
+namespace PipelinePost {
+
+static constexpr uint32_t groupSize = 16; // threads in x and y per work group, as in post.comp
+
+struct PushConstants {
+	uint32_t effects; // a bit for each `PostEffect` to apply
+};
+using PCS = EVK::PushConstants<0, PushConstants>;
+static_assert(EVK::pushConstants_c<PCS>);
+
+// the parameters of every effect
+struct UBO {
+	vec<4, float32_t> lift; // added after `gain`
+	vec<4, float32_t> gamma;
+	vec<4, float32_t> gain;
+	float32_t contrast; // about mid grey; 1 for none
+	float32_t saturation; // 1 for none
+	float32_t sharpness; // from 0 to 1
+};
+
+namespace ComputeShader {
+
+template <const char *filename>
+using type_t = EVK::Shader<VK_SHADER_STAGE_COMPUTE_BIT, filename, PCS,
+EVK::CombinedImageSamplersUniform<0, 0, 1>, // input
+EVK::StorageImagesUniform<0, 1, 1>, // output
+EVK::SBOUniform<0, 2, PipelineExposure::SBO>,
+EVK::UBOUniform<0, 3, UBO>
+>;
+
+// writing an intermediate for a later dispatch
+static constexpr char hdrFilename[] = "../Resources/Shaders/postHdr.spv";
+using hdrType = type_t<hdrFilename>;
+static_assert(EVK::shader_c<hdrType>);
+
+// the last dispatch, writing the tonemapped output
+static constexpr char ldrFilename[] = "../Resources/Shaders/postLdr.spv";
+using ldrType = type_t<ldrFilename>;
+static_assert(EVK::shader_c<ldrType>);
+
+} // namespace ComputeShader
+
+using hdrType = EVK::ComputePipeline<ComputeShader::hdrType>;
+using ldrType = EVK::ComputePipeline<ComputeShader::ldrType>;
+
+template <typename pipeline_t>
+inline std::shared_ptr<pipeline_t> Build(std::shared_ptr<EVK::Devices> devices){
+	return std::make_shared<pipeline_t>(devices);
+}
+
+} // namespace PipelinePost
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "Header.hpp"
+#include "PipelineState.hpp"
+#include "PipelineFinal.hpp"
 
 namespace PipelineShadow {
 
@@ -8,7 +10,7 @@ using PCS = EVK::PushConstants<0, Shared_Main::PushConstants_Vert>;
 static_assert(EVK::pushConstants_c<PCS>);
 
 struct UBO_Global {
-	mat<4, 4, float32_t> viewInvProj[SHADOW_MAP_CASCADE_COUNT];
+	mat<4, 4, float32_t> viewInvProj[SHADOW_MAP_CASCADE_COUNT_MAX];
 };
 
 namespace Instanced {
@@ -27,87 +29,33 @@ static_assert(EVK::vertexShader_c<type>);
 
 using type = EVK::DepthPipeline<VertexShader::type>;
 
-inline std::shared_ptr<type> Build(std::shared_ptr<EVK::Devices> devices, VkRenderPass renderPassHandle){
-	
-	VkPipelineRasterizationStateCreateInfo rasterizer{};
-	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	rasterizer.depthClampEnable = VK_FALSE;
-	rasterizer.rasterizerDiscardEnable = VK_FALSE;
-	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-	rasterizer.lineWidth = 1.0f;
-	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-	
-	// ----- Multisampling behaviour -----
-	VkPipelineMultisampleStateCreateInfo multisampling{};
-	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multisampling.sampleShadingEnable = VK_FALSE;
-	
-	// ----- Colour blending behaviour -----
-	VkPipelineColorBlendStateCreateInfo colourBlending{};
-	VkPipelineColorBlendAttachmentState colourBlendAttachment{};
-	colourBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	colourBlendAttachment.blendEnable = VK_TRUE;
-	colourBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-	colourBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-	colourBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-	colourBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-	colourBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-	colourBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-	
-	colourBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	colourBlending.logicOpEnable = VK_FALSE;
-	colourBlending.pAttachments = &colourBlendAttachment;
-	
-	// ----- Depth stencil behaviour -----
-	VkPipelineDepthStencilStateCreateInfo depthStencil{};
-	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-	depthStencil.depthTestEnable = VK_TRUE;
-	depthStencil.depthWriteEnable = VK_TRUE;
-	depthStencil.depthBoundsTestEnable = VK_FALSE;
-	depthStencil.stencilTestEnable = VK_FALSE;
-	
-	// ----- Dynamic state -----
-	VkPipelineDynamicStateCreateInfo dynamicState{};
-	VkDynamicState dynamicStates[3] = {
-		VK_DYNAMIC_STATE_VIEWPORT,
-		VK_DYNAMIC_STATE_SCISSOR,
-		VK_DYNAMIC_STATE_DEPTH_BIAS
-	};
-	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	dynamicState.pDynamicStates = dynamicStates;
-	
-	
-	rasterizer.cullMode = VK_CULL_MODE_NONE;
-	rasterizer.depthBiasEnable = VK_TRUE;
-	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-	colourBlending.attachmentCount = 0;
-	depthStencil.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-	dynamicState.dynamicStateCount = 3;
-	
-	const EVK::RenderPipelineBlueprint blueprint = {
-		.primitiveTopology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-		.pRasterisationStateCI = &rasterizer,
-		.pMultisampleStateCI = &multisampling,
-		.pDepthStencilStateCI = &depthStencil,
-		.pColourBlendStateCI = &colourBlending,
-		.pDynamicStateCI = &dynamicState,
-		.renderPassHandle = renderPassHandle
+// depth only, biased by the dynamic depth bias, and clamped so casters behind the cascade's near plane still cast
+inline PipelineState State(VkRenderPass renderPassHandle){
+	return {
+		.renderPass = renderPassHandle,
+		.depthClamp = deviceFeatures.depthClamp,
+		.depthBias = true,
+		.colourAttachments = 0,
+		.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL,
+		.dynamic = PipelineState::dynamicViewport | PipelineState::dynamicScissor | PipelineState::dynamicDepthBias
 	};
-	
-	return std::make_shared<type>(devices, &blueprint);
+}
+
+inline std::shared_ptr<type> Build(std::shared_ptr<EVK::Devices> devices, VkRenderPass renderPassHandle){
+	return BuildPipeline<type>(devices, State(renderPassHandle));
 }
 
 } // namespace Instanced
 
-namespace Once {
+namespace Multiview {
 
 namespace VertexShader {
 
-static constexpr char vertexFilename[] = "../Resources/Shaders/vertShadowOnce.spv";
+static constexpr char vertexFilename[] = "../Resources/Shaders/vertShadowMultiview.spv";
 
-using type = EVK::VertexShader<vertexFilename, PCS, AttributesOnce,
-EVK::UBOUniform<0, 0, UBO_Global>,
-EVK::UBOUniform<1, 0, PerObject, true>
+// no push constants: the cascade is `gl_ViewIndex`
+using type = EVK::VertexShader<vertexFilename, EVK::NoPushConstants, AttributesInstanced,
+EVK::UBOUniform<0, 0, UBO_Global>
 >;
 
 static_assert(EVK::vertexShader_c<type>);
@@ -116,77 +64,38 @@ static_assert(EVK::vertexShader_c<type>);
 
 using type = EVK::DepthPipeline<VertexShader::type>;
 
+// `renderPassHandle` must be a multiview render pass, such as from `BuildShadowMapMultiviewRenderPass`
 inline std::shared_ptr<type> Build(std::shared_ptr<EVK::Devices> devices, VkRenderPass renderPassHandle){
-	
-	VkPipelineRasterizationStateCreateInfo rasterizer{};
-	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	rasterizer.depthClampEnable = VK_FALSE;
-	rasterizer.rasterizerDiscardEnable = VK_FALSE;
-	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-	rasterizer.lineWidth = 1.0f;
-	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-	
-	// ----- Multisampling behaviour -----
-	VkPipelineMultisampleStateCreateInfo multisampling{};
-	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multisampling.sampleShadingEnable = VK_FALSE;
-	
-	// ----- Colour blending behaviour -----
-	VkPipelineColorBlendStateCreateInfo colourBlending{};
-	VkPipelineColorBlendAttachmentState colourBlendAttachment{};
-	colourBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	colourBlendAttachment.blendEnable = VK_TRUE;
-	colourBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-	colourBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-	colourBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-	colourBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-	colourBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-	colourBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-	
-	colourBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	colourBlending.logicOpEnable = VK_FALSE;
-	colourBlending.pAttachments = &colourBlendAttachment;
-	
-	// ----- Depth stencil behaviour -----
-	VkPipelineDepthStencilStateCreateInfo depthStencil{};
-	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-	depthStencil.depthTestEnable = VK_TRUE;
-	depthStencil.depthWriteEnable = VK_TRUE;
-	depthStencil.depthBoundsTestEnable = VK_FALSE;
-	depthStencil.stencilTestEnable = VK_FALSE;
-	
-	// ----- Dynamic state -----
-	VkPipelineDynamicStateCreateInfo dynamicState{};
-	VkDynamicState dynamicStates[3] = {
-		VK_DYNAMIC_STATE_VIEWPORT,
-		VK_DYNAMIC_STATE_SCISSOR,
-		VK_DYNAMIC_STATE_DEPTH_BIAS
-	};
-	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	dynamicState.pDynamicStates = dynamicStates;
-	
-	
-	rasterizer.cullMode = VK_CULL_MODE_NONE;
-	rasterizer.depthBiasEnable = VK_TRUE;
-	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-	colourBlending.attachmentCount = 0;
-	depthStencil.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-	dynamicState.dynamicStateCount = 3;
-	
-	const EVK::RenderPipelineBlueprint blueprint = {
-		.primitiveTopology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-		.pRasterisationStateCI = &rasterizer,
-		.pMultisampleStateCI = &multisampling,
-		.pDepthStencilStateCI = &depthStencil,
-		.pColourBlendStateCI = &colourBlending,
-		.pDynamicStateCI = &dynamicState,
-		.renderPassHandle = renderPassHandle
-	};
-	
-	return std::make_shared<type>(devices, &blueprint);
+	return BuildPipeline<type>(devices, Instanced::State(renderPassHandle));
+}
+
+} // namespace Multiview
+
+namespace Composite {
+
+namespace FragmentShader {
+
+static constexpr char fragmentFilename[] = "../Resources/Shaders/fragShadowComposite.spv";
+
+using type = EVK::Shader<VK_SHADER_STAGE_FRAGMENT_BIT, fragmentFilename, PCS,
+EVK::CombinedImageSamplersUniform<0, 0, 1>
+>;
+static_assert(EVK::shader_c<type>);
+
+} // namespace FragmentShader
+
+// copies a layer of the static caster cache into the cascade being drawn, as a full screen quad writing `gl_FragDepth`; the vertices are those of the final pass
+using type = EVK::RenderPipeline<PipelineFinal::VertexShader::type, FragmentShader::type>;
+
+inline std::shared_ptr<type> Build(std::shared_ptr<EVK::Devices> devices, VkRenderPass renderPassHandle){
+	return BuildPipeline<type>(devices, {
+		.renderPass = renderPassHandle,
+		.colourAttachments = 0,
+		.depthCompareOp = VK_COMPARE_OP_ALWAYS // the cached depth already has its bias
+	});
 }
 
-} // namespace Once
+} // namespace Composite
 
 } // namespace PipelineShadow
 
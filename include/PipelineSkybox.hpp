@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Header.hpp"
+#include "PipelineState.hpp"
 
 namespace PipelineSkybox {
 
@@ -12,6 +13,10 @@ struct UBO_Global {
 	mat<4, 4, float32_t> viewInv;
 	mat<4, 4, float32_t> proj;
 	vec<4, float32_t> cameraPosition; // only using first three components
+	int32_t fog; // `SceneSettings::fog`
+	int32_t padding0;
+	int32_t padding1;
+	int32_t padding2;
 };
 
 namespace VertexShader {
@@ -53,78 +58,12 @@ static_assert(EVK::shader_c<type>);
 using type = EVK::RenderPipeline<VertexShader::type, FragmentShader::type>;
 
 inline std::shared_ptr<type> Build(std::shared_ptr<EVK::Devices> devices, VkRenderPass renderPassHandle){
-	
-	VkPipelineRasterizationStateCreateInfo rasterizer{};
-	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	rasterizer.depthClampEnable = VK_FALSE;
-	rasterizer.rasterizerDiscardEnable = VK_FALSE;
-	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-	rasterizer.lineWidth = 1.0f;
-	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-	
-	// ----- Multisampling behaviour -----
-	VkPipelineMultisampleStateCreateInfo multisampling{};
-	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multisampling.sampleShadingEnable = VK_FALSE;
-	
-	// ----- Colour blending behaviour -----
-	VkPipelineColorBlendStateCreateInfo colourBlending{};
-	VkPipelineColorBlendAttachmentState colourBlendAttachment{};
-	colourBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	colourBlendAttachment.blendEnable = VK_TRUE;
-	colourBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-	colourBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-	colourBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-	colourBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-	colourBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-	colourBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-	
-	colourBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	colourBlending.logicOpEnable = VK_FALSE;
-	colourBlending.pAttachments = &colourBlendAttachment;
-	
-	// ----- Depth stencil behaviour -----
-	VkPipelineDepthStencilStateCreateInfo depthStencil{};
-	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-	depthStencil.depthTestEnable = VK_TRUE;
-	depthStencil.depthWriteEnable = VK_TRUE;
-	depthStencil.depthBoundsTestEnable = VK_FALSE;
-	depthStencil.stencilTestEnable = VK_FALSE;
-	
-	// ----- Dynamic state -----
-	VkPipelineDynamicStateCreateInfo dynamicState{};
-	VkDynamicState dynamicStates[3] = {
-		VK_DYNAMIC_STATE_VIEWPORT,
-		VK_DYNAMIC_STATE_SCISSOR,
-		VK_DYNAMIC_STATE_DEPTH_BIAS
-	};
-	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	dynamicState.pDynamicStates = dynamicStates;
-	
-	
-	rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-	rasterizer.depthBiasEnable = VK_FALSE;
-#ifdef MSAA
-	multisampling.rasterizationSamples = interface->devices->GetMSAASamples();
-#else
-	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-#endif
-	colourBlending.attachmentCount = 1;
-	depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
-	dynamicState.dynamicStateCount = 2;
-	depthStencil.depthTestEnable = VK_FALSE;
-	
-	const EVK::RenderPipelineBlueprint blueprint = {
-		.primitiveTopology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-		.pRasterisationStateCI = &rasterizer,
-		.pMultisampleStateCI = &multisampling,
-		.pDepthStencilStateCI = &depthStencil,
-		.pColourBlendStateCI = &colourBlending,
-		.pDynamicStateCI = &dynamicState,
-		.renderPassHandle = renderPassHandle
-	};
-	
-	return std::make_shared<type>(devices, &blueprint);
+	return BuildPipeline<type>(devices, {
+		.renderPass = renderPassHandle,
+		.cullMode = VK_CULL_MODE_BACK_BIT,
+		.samples = SCENE_SAMPLES,
+		.depthTest = false
+	});
 }
 
 } // namespace PipelineSkybox
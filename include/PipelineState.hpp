@@ -0,0 +1,143 @@
+#ifndef PipelineState_hpp
+#define PipelineState_hpp
+
+#include <functional>
+#include <typeindex>
+#include <unordered_map>
+
+#include "Header.hpp"
+
+// of the scene's colour and depth targets
+#ifdef MSAA
+#define SCENE_SAMPLES interface->devices->GetMSAASamples()
+#else
+#define SCENE_SAMPLES VK_SAMPLE_COUNT_1_BIT
+#endif
+
+// The fixed function state of a render pipeline, by value, so pipelines are described in a few lines and identical descriptions can be recognised. Defaults are those most pipelines here share: triangles, no culling, one opaque colour attachment, a `LESS` depth test with writes, and dynamic viewport and scissor.
+struct PipelineState {
+	enum class Blend : uint8_t {
+		none,
+		alpha // source over, by the source alpha; alpha is written unblended
+	};
+	
+	// states set while recording rather than fixed in the pipeline
+	enum Dynamic : uint32_t {
+		dynamicViewport = 1 << 0,
+		dynamicScissor = 1 << 1,
+		dynamicDepthBias = 1 << 2,
+		dynamicDepthCompareOp = 1 << 3, // as is the next, from `VK_EXT_extended_dynamic_state` (see `DeviceFeatures::dynamicDepthState`)
+		dynamicDepthWriteEnable = 1 << 4
+	};
+	static constexpr uint32_t dynamicStatesMax = 5;
+	
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	VkCullModeFlags cullMode = VK_CULL_MODE_NONE;
+	bool depthClamp = false; // depths beyond the near and far planes are clamped rather than clipped; needs `DeviceFeatures::depthClamp`
+	bool depthBias = false;
+	VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+	uint32_t colourAttachments = 1; // 0 or 1
+	VkColorComponentFlags colourWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	Blend blend = Blend::none;
+	bool depthTest = true;
+	bool depthWrite = true;
+	VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
+	uint32_t dynamic = dynamicViewport | dynamicScissor; // `Dynamic` bits
+	
+	bool operator==(const PipelineState &other) const = default;
+	
+	size_t Hash() const;
+	struct Hasher {
+		size_t operator()(const PipelineState &state) const { return state.Hash(); }
+	};
+};
+
+// The create infos `Blueprint` points into, filled from a state. They must outlive the pipeline's construction, so aren't copyable.
+class PipelineStateCreateInfos {
+public:
+	PipelineStateCreateInfos(const PipelineState &state);
+	PipelineStateCreateInfos(const PipelineStateCreateInfos &) = delete;
+	PipelineStateCreateInfos &operator=(const PipelineStateCreateInfos &) = delete;
+	
+	EVK::RenderPipelineBlueprint Blueprint() const;
+	
+private:
+	PipelineState state;
+	VkPipelineRasterizationStateCreateInfo rasterizer;
+	VkPipelineMultisampleStateCreateInfo multisampling;
+	VkPipelineColorBlendAttachmentState colourBlendAttachment;
+	VkPipelineColorBlendStateCreateInfo colourBlending;
+	VkPipelineDepthStencilStateCreateInfo depthStencil;
+	VkDynamicState dynamicStates[PipelineState::dynamicStatesMax];
+	VkPipelineDynamicStateCreateInfo dynamicState;
+};
+
+// Every render pipeline built for an owner, by type and state. EVK's pipeline objects own their descriptor sets, so a pipeline is only shared between requests from the same owner, which sets its descriptors for all of them: asking again for the same state gives the pipeline already built. Everything happens on the calling thread, as EVK isn't known to be safe to create objects with from several.
+class PipelineLibrary {
+public:
+	PipelineLibrary(std::shared_ptr<EVK::Devices> _devices) : devices(_devices) {}
+	
+	// The pipeline, built here if it hasn't been built yet. `owner` identifies who binds its descriptor sets, e.g. the address of the pointer it is kept in; with none the pipeline is built for the caller alone, and not kept.
+	template <typename pipeline_t>
+	std::shared_ptr<pipeline_t> Get(const PipelineState &state, const void *owner){
+		if(!owner) return std::static_pointer_cast<pipeline_t>(BuildFunction<pipeline_t>(state)());
+		Entry &entry = Find<pipeline_t>(state, owner);
+		if(!entry.pipeline) entry.pipeline = entry.build();
+		return std::static_pointer_cast<pipeline_t>(entry.pipeline);
+	}
+	
+	// how many pipelines it has built
+	size_t Size() const { return built; }
+	
+private:
+	std::shared_ptr<EVK::Devices> devices;
+	
+	struct Key {
+		std::type_index type;
+		PipelineState state;
+		const void *owner;
+		bool operator==(const Key &other) const = default;
+	};
+	struct KeyHasher {
+		size_t operator()(const Key &key) const { return key.type.hash_code() ^ (key.state.Hash() << 1) ^ (std::hash<const void *>{}(key.owner) << 2); }
+	};
+	struct Entry {
+		std::function<std::shared_ptr<void>()> build;
+		std::shared_ptr<void> pipeline; // null until built
+	};
+	std::unordered_map<Key, Entry, KeyHasher> entries;
+	size_t built = 0;
+	
+	template <typename pipeline_t>
+	std::function<std::shared_ptr<void>()> BuildFunction(const PipelineState &state){
+		return [this, state](){
+			const PipelineStateCreateInfos createInfos {state};
+			const EVK::RenderPipelineBlueprint blueprint = createInfos.Blueprint();
+			++built;
+			return std::shared_ptr<void>(std::make_shared<pipeline_t>(devices, &blueprint));
+		};
+	}
+	
+	// the entry for the pipeline, made unbuilt if there wasn't one
+	template <typename pipeline_t>
+	Entry &Find(const PipelineState &state, const void *owner){
+		const auto [it, inserted] = entries.try_emplace({typeid(pipeline_t), state, owner});
+		if(inserted) it->second.build = BuildFunction<pipeline_t>(state);
+		return it->second;
+	}
+};
+
+// the library render pipelines are built through
+extern std::shared_ptr<PipelineLibrary> pipelineLibrary;
+
+// builds a render pipeline through `pipelineLibrary`, or by itself if there isn't one; `owner` as for `PipelineLibrary::Get`
+template <typename pipeline_t>
+std::shared_ptr<pipeline_t> BuildPipeline(std::shared_ptr<EVK::Devices> devices, const PipelineState &state, const void *owner=nullptr){
+	if(pipelineLibrary) return pipelineLibrary->Get<pipeline_t>(state, owner);
+	const PipelineStateCreateInfos createInfos {state};
+	const EVK::RenderPipelineBlueprint blueprint = createInfos.Blueprint();
+	return std::make_shared<pipeline_t>(devices, &blueprint);
+}
+
+#endif /* PipelineState_hpp */
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "Header.hpp"
+#include "PipelineState.hpp"
+#include "PipelineMain.hpp"
+#include "PipelineFinal.hpp"
+#include "GeometryArena.hpp"
+
+// Visibility buffer rendering: opaque geometry is rasterised once writing only IDs (`Pass`), then every pixel is shaded once by a full screen resolve (`Resolve`) that fetches its triangle's vertices and instance record itself
+namespace PipelineVisibility {
+
+// one per instance of each draw in the visibility buffer, written by the CPU every frame
+struct Record {
+	mat<4, 4, float32_t> model;
+	mat<4, 4, float32_t> modelInvT;
+	uint32_t firstVertex; // in the geometry arena
+	int32_t textureID;
+	float32_t shininess;
+	uint32_t padding;
+};
+
+struct RecordsSBO {
+	Record records[VISIBILITY_RECORDS_MAX];
+};
+
+namespace Pass {
+
+struct PushConstants {
+	uint32_t firstRecord; // the record of the draw's first instance
+	uint32_t firstInstance; // of the draw, so instance `firstInstance + i` has record `firstRecord + i`
+	int32_t textureID;
+	int32_t alphaTest; // whether to discard where the texture is transparent, as `PipelineMain::AlphaTested` does
+};
+
+namespace FragmentShader {
+
+static constexpr char fragmentFilename[] = "../Resources/Shaders/fragVisibility.spv";
+
+using PCS = EVK::PushConstants<0, PushConstants>;
+static_assert(EVK::pushConstants_c<PCS>);
+
+using type = EVK::Shader<VK_SHADER_STAGE_FRAGMENT_BIT, fragmentFilename, PCS,
+EVK::TextureSamplersUniform<0, 1, 1>,
+EVK::TextureImagesUniform<0, 2, PNGS_N>
+>;
+static_assert(EVK::shader_c<type>);
+
+} // namespace FragmentShader
+
+// the main vertex shader, which also passes on the instance index
+using type = EVK::RenderPipeline<PipelineMain::Instanced::VertexShader::type, FragmentShader::type>;
+
+// IDs can't be blended
+inline std::shared_ptr<type> Build(std::shared_ptr<EVK::Devices> devices, VkRenderPass renderPassHandle){
+	return BuildPipeline<type>(devices, {
+		.renderPass = renderPassHandle,
+		.cullMode = VK_CULL_MODE_BACK_BIT, // as the main pass
+		.colourWriteMask = VK_COLOR_COMPONENT_R_BIT
+	});
+}
+
+} // namespace Pass
+
+namespace Resolve {
+
+namespace FragmentShader {
+
+static constexpr char fragmentFilename[] = "../Resources/Shaders/fragVisibilityResolve.spv"; // main.frag compiled with `VISIBILITY_RESOLVE`
+
+// as `PipelineMain::FragmentShader`, with the textures and shininess taken from the records rather than push constants
+using type = EVK::Shader<VK_SHADER_STAGE_FRAGMENT_BIT, fragmentFilename, PipelineMain::FragmentShader::PCS,
+EVK::UBOUniform<0, 0, PipelineMain::UBO_Global>,
+EVK::TextureSamplersUniform<0, 1, 1>,
+EVK::TextureImagesUniform<0, 2, PNGS_N>,
+EVK::CombinedImageSamplersUniform<0, 3, 1>, // shadow map
+EVK::CombinedImageSamplersUniform<0, 4, 1>, // the same, with a comparison sampler
+EVK::CombinedImageSamplersUniform<0, 5, 1>, // EVSM moments
+EVK::SBOUniform<0, 6, PipelineClusters::LightsSBO>,
+EVK::SBOUniform<0, 7, PipelineClusters::ClustersSBO>,
+EVK::CombinedImageSamplersUniform<0, 8, 1>, // visibility buffer
+EVK::SBOUniform<0, 9, GeometryStorage>,
+EVK::SBOUniform<0, 10, RecordsSBO>
+>;
+static_assert(EVK::shader_c<type>);
+
+} // namespace FragmentShader
+
+// drawn over the whole screen with the final pass's quad
+using type = EVK::RenderPipeline<PipelineFinal::VertexShader::type, FragmentShader::type>;
+
+// pixels with nothing in the visibility buffer are discarded, leaving the skybox
+inline std::shared_ptr<type> Build(std::shared_ptr<EVK::Devices> devices, VkRenderPass renderPassHandle, const void *owner=nullptr){
+	return BuildPipeline<type>(devices, {
+		.renderPass = renderPassHandle,
+		.depthTest = false,
+		.depthWrite = false,
+		.depthCompareOp = VK_COMPARE_OP_ALWAYS
+	}, owner);
+}
+
+} // namespace Resolve
+
+} // namespace PipelineVisibility
@@ -8,8 +8,42 @@
 
 std::array<std::shared_ptr<EVK::TextureSampler>, int(Sampler::_COUNT_)> BuildSamplers(std::shared_ptr<EVK::Devices> devices);
 
-std::shared_ptr<EVK::LayeredBufferedRenderPass<SHADOW_MAP_CASCADE_COUNT>> BuildShadowMapRenderPass(std::shared_ptr<EVK::Devices> devices);
+// An `EVK::LayeredBufferedRenderPass` whose layer count is chosen at runtime, as the shadow cascade count is
+class LayeredRenderPass {
+public:
+	virtual ~LayeredRenderPass() = default;
+	
+	virtual VkRenderPass RenderPassHandle() const = 0;
+	virtual void SetImage(std::shared_ptr<EVK::TextureImage> image) = 0;
+	virtual bool CmdBegin(VkCommandBuffer commandBuffer, uint32_t flight, VkSubpassContents contents, const std::vector<VkClearValue> &clearValues, int layer) = 0;
+};
+
+template <uint32_t layersN>
+class LayeredRenderPassN : public LayeredRenderPass {
+public:
+	LayeredRenderPassN(std::shared_ptr<EVK::Devices> devices, const VkRenderPassCreateInfo *pRenderPassCI, VkImageAspectFlags aspectFlags)
+	: renderPass(std::make_shared<EVK::LayeredBufferedRenderPass<layersN>>(devices, pRenderPassCI, aspectFlags)) {}
+	
+	VkRenderPass RenderPassHandle() const override { return renderPass->RenderPassHandle(); }
+	void SetImage(std::shared_ptr<EVK::TextureImage> image) override { renderPass->SetImage(image); }
+	bool CmdBegin(VkCommandBuffer commandBuffer, uint32_t flight, VkSubpassContents contents, const std::vector<VkClearValue> &clearValues, int layer) override {
+		return renderPass->CmdBegin(commandBuffer, flight, contents, clearValues, layer);
+	}
+	
+private:
+	std::shared_ptr<EVK::LayeredBufferedRenderPass<layersN>> renderPass;
+};
+
+// one layer per cascade in `shadowQuality`
+std::shared_ptr<LayeredRenderPass> BuildShadowMapRenderPass(std::shared_ptr<EVK::Devices> devices);
+
+// one render pass writing every layer of the cascade image at once through multiview
+std::shared_ptr<EVK::BufferedRenderPass> BuildShadowMapMultiviewRenderPass(std::shared_ptr<EVK::Devices> devices);
+
+// with `loadDepth`, the depth written by the visibility render pass is kept rather than cleared
+std::shared_ptr<EVK::BufferedRenderPass> BuildFinalRenderPass(std::shared_ptr<EVK::Devices> devices, bool loadDepth=false);
 
-std::shared_ptr<EVK::BufferedRenderPass> BuildFinalRenderPass(std::shared_ptr<EVK::Devices> devices);
+// writes the visibility buffer and depth of opaque geometry, for the final render pass to resolve; single sampled, so not used with `MSAA`
+std::shared_ptr<EVK::BufferedRenderPass> BuildVisibilityRenderPass(std::shared_ptr<EVK::Devices> devices);
 	
 #endif /* Pipelines_hpp */
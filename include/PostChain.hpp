@@ -0,0 +1,58 @@
+#ifndef PostChain_hpp
+#define PostChain_hpp
+
+#include <functional>
+
+#include "Header.hpp"
+#include "PipelinePost.hpp"
+#include "GpuTimer.hpp"
+
+// The compute post-processing chain: a list of `PostEffect`s planned into as few dispatches as can apply them in order, each reading its input once into a shared memory tile and writing its output once. Intermediates between dispatches are `rgba16f`; the last dispatch tonemaps into an `rgba8` image of sRGB encoded values, for the swapchain pass to copy.
+class PostChain {
+public:
+	// without `fuse`, every effect gets its own dispatch, so its own timing. Creates everything but the pipelines.
+	PostChain(std::shared_ptr<EVK::Devices> _devices, const std::vector<PostEffect> &chain, bool fuse);
+	
+	// a job per dispatch building its pipeline, run with the other pipeline jobs at startup; all must have run before `SetImages`
+	std::vector<std::function<void()>> PipelineJobs();
+	
+	// (re)creates the intermediates and output at `size`, reading from `input`; call on resize
+	void SetImages(const vec<2, uint32_t> &size, std::shared_ptr<EVK::TextureImage> input, std::shared_ptr<EVK::TextureSampler> sampler);
+	void SetExposure(const std::shared_ptr<EVK::StorageBufferObject<PipelineExposure::SBO>> &sboExposure);
+	
+	// the effects' parameters; changes show from the next `CmdExecute`
+	PipelinePost::UBO &GetParameters(){ return parameters; }
+	
+	// `input` must be ready to sample by compute shaders; the exposure is synchronised here with the compute pass that wrote it. Afterwards the output is ready to sample by fragment shaders. With `timing`, also prints each dispatch's mean GPU time every second, which is each effect's if the chain isn't fused.
+	void CmdExecute(VkCommandBuffer commandBuffer, uint32_t flight, bool timing);
+	
+	const std::shared_ptr<EVK::TextureImage> &GetOutput() const { return output; }
+	
+private:
+	struct Dispatch {
+		uint32_t effects; // bits of `PostEffect`
+		std::string name; // its effects' names, for timings
+		std::shared_ptr<PipelinePost::hdrType> hdrPipeline; // one or the other, by whether this is the last dispatch
+		std::shared_ptr<PipelinePost::ldrType> ldrPipeline;
+		std::shared_ptr<EVK::TextureImage> target; // the intermediate written; the output for the last dispatch
+	};
+	
+	void StepTiming(uint32_t flight);
+	
+	std::shared_ptr<EVK::Devices> devices;
+	std::shared_ptr<EVK::UniformBufferObject<PipelinePost::UBO, false>> ubo;
+	PipelinePost::UBO parameters;
+	
+	std::vector<Dispatch> dispatches;
+	std::shared_ptr<EVK::TextureImage> intermediates[2]; // ping-ponged between, as needed
+	std::shared_ptr<EVK::TextureImage> output;
+	vec<2, uint32_t> size;
+	
+	std::shared_ptr<GpuTimer> timer; // a section per dispatch
+	std::map<uint32_t, bool> timed; // whether each flight has had its dispatches timed, so its results are valid to read
+	std::vector<double> timedMs; // summed since last printed
+	uint32_t timedFrames = 0;
+	unsigned long timedSince = UTime();
+};
+
+#endif /* PostChain_hpp */
@@ -1,12 +1,19 @@
 #ifndef RenderObjects_hpp
 #define RenderObjects_hpp
 
+#include <span>
+#include <tuple>
+
 #include "Header.hpp"
+#include "GeometryArena.hpp"
+#include "FrameArena.hpp"
 
 namespace Rendered {
 
 class Parent;
 class Once;
+class OnceBatcher;
+class StaticBatcher;
 class InstanceManager;
 class Instance;
 
@@ -22,21 +29,174 @@ struct Info {
 		uint32_t firstInstance = 0;
 	};
 	std::function<Draw(uint32_t)> drawFunction;
+	Bounds bounds; // in world space, of everything drawn, for sorting draws by distance
+	const PerObject *instances = nullptr; // the instance data draws' `firstInstance` indexes, for passes that read it themselves
+	const Bounds *instanceBounds = nullptr; // in world space, indexed as `instances`, so transparent draws can be split and sorted by instance; null where there's one instance per draw
+};
+
+// A range of the geometry arena shared by every object that renders the same source; the range is freed with the mesh, and `firstVertex` follows it if the arena is defragmented
+struct Mesh {
+	~Mesh();
+	
+	GeometryArena *arena = nullptr; // null until the range is allocated
+	uint32_t firstVertex;
+	ObjectData objData;
+	Bounds bounds; // in model space
+};
+
+// A copy of some instance data compacted down to the instances that pass a visibility test, in its own instance buffer. Used to give each shadow cascade only the casters that can affect it.
+class InstanceList {
+public:
+	struct Range {
+		uint32_t firstInstance;
+		uint32_t instanceCount;
+	};
+	
+	InstanceList(std::shared_ptr<EVK::Devices> _devices);
+	
+	// `ranges[i]` are the instances of batch `i` in `instanceData`; afterwards `GetRange(i)` gives the visible ones within this list
+	void Build(const PerObject *instanceData, const Bounds *instanceBounds, std::span<const Range> ranges, const std::function<bool(const Bounds &)> &visible);
+	
+	// fails if nothing was visible, in which case there is nothing to draw
+	bool CmdBind(VkCommandBuffer commandBuffer);
+	
+	const Range &GetRange(uint32_t batchIndex) const { return culledRanges[batchIndex]; }
+	
+private:
+	std::shared_ptr<EVK::Devices> devices;
+	std::shared_ptr<EVK::VertexBufferObject> vbo;
+	
+	std::vector<PerObject> compacted;
+	std::vector<Range> culledRanges;
 };
 
+// Returns the mesh cached under `key` (the file the data was read from), adding `objData` to the arena if there isn't a live one. The cache doesn't keep meshes alive by itself. Returns `nullptr` if the arena is full, which callers must check, as `Once` and `InstanceManager` need a mesh.
+std::shared_ptr<Mesh> GetMesh(GeometryArena *arena, const std::string &key, const ObjectData &objData);
+
 class Once {
 public:
-	Once(std::shared_ptr<EVK::Devices> _devices, const ObjectData &_objData);
-	~Once() = default;
+	Once(OnceBatcher *_batcher, std::shared_ptr<Mesh> _mesh);
+	virtual ~Once();
 	
 	virtual void Update(float dT, PerObject *perObjectDataPtr) {}
 	
-	virtual Info Render(VkCommandBuffer commandBuffer);
+	const std::shared_ptr<Mesh> &GetMesh() const { return mesh; }
+	float GetShininess() const { return shininess; }
+	
+protected:
+	float shininess = 1.0f; // part of the material, so should be set on construction
 	
 private:
+	OnceBatcher *batcher;
+	std::shared_ptr<Mesh> mesh;
+};
+
+// Groups `Once` objects with the same mesh and material into single instanced draws. Per-object data is written into a transient instance buffer in batch order every frame.
+class OnceBatcher {
+public:
+	OnceBatcher(std::shared_ptr<EVK::Devices> _devices);
+	~OnceBatcher() = default;
+	
+	void AddOnce(Once *ptr);
+	void RemoveOnce(Once *ptr);
+	
+	void Update(float dT);
+	
+	uint32_t GetBatchCount() const { return uint32_t(batches.size()); }
+	
+	// binds the instance buffer; needs doing once per pass before any `Render` calls, along with binding the geometry arena
+	bool CmdBindInstances(VkCommandBuffer commandBuffer);
+	
+	Info Render(uint32_t batchIndex);
+	
+	// compacts the instances that pass `visible` into cull list `list` (of `SHADOW_CULL_LISTS_N`); must be called after `Update`, while a frame is recorded, as it works in `frameArena`
+	void Cull(uint32_t list, const std::function<bool(const Bounds &)> &visible);
+	
+	// as `CmdBindInstances` and `Render`, but for the instances in cull list `list`
+	bool CmdBindCulledInstances(VkCommandBuffer commandBuffer, uint32_t list);
+	Info RenderCulled(uint32_t list, uint32_t batchIndex);
+	
+private:
+	struct Batch {
+		Mesh *mesh;
+		float shininess;
+		uint32_t firstInstance;
+		uint32_t instanceCount;
+	};
+	
+	void RebuildBatches();
+	
 	std::shared_ptr<EVK::Devices> devices;
-	std::shared_ptr<EVK::VertexBufferObject> vbo;
-	ObjectData objData;
+	std::shared_ptr<EVK::VertexBufferObject> vboInstance;
+	
+	std::vector<Once *> onces; // sorted by mesh and material when batches are rebuilt, so each batch is contiguous
+	std::vector<PerObject> instanceData;
+	std::vector<Bounds> instanceBounds; // in world space
+	std::vector<Batch> batches;
+	bool batchesDirty = false;
+	
+	std::vector<InstanceList> cullLists;
+};
+
+// Geometry that never moves, pre-transformed into world space at load. It is merged by material into one arena range per square cell, so it draws with no per-object data and cells can be culled on the CPU.
+class StaticBatcher {
+public:
+	StaticBatcher(std::shared_ptr<EVK::Devices> _devices, GeometryArena *_arena, float _cellSize=STATIC_BATCH_CELL_SIZE);
+	~StaticBatcher();
+	
+	// `objData` is copied, so needn't outlive the call; nothing is drawn until `Build` is called
+	void Add(const ObjectData &objData, const mat<4, 4> &model, float shininess);
+	// moves everything added since the last call into the geometry arena; fails if any of it didn't fit, in which case that much isn't drawn
+	bool Build();
+	
+	uint32_t GetBatchCount() const { return uint32_t(batches.size()); }
+	
+	bool IsVisible(uint32_t batchIndex, const mat<4, 4> &viewProjection) const {
+		return !BoxOutsideFrustum(viewProjection, batches[batchIndex].bounds);
+	}
+	
+	// stores the indices of the batches that pass `visible` as cull list `list` (of `SHADOW_CULL_LISTS_N`)
+	void Cull(uint32_t list, const std::function<bool(const Bounds &)> &visible);
+	const std::vector<uint32_t> &GetCulled(uint32_t list) const { return cullLists[list]; }
+	
+	// binds an identity instance, which every static batch is drawn with
+	bool CmdBindInstances(VkCommandBuffer commandBuffer);
+	
+	Info Render(uint32_t batchIndex);
+	
+private:
+	struct Key {
+		int32_t cellX;
+		int32_t cellY;
+		uint32_t texture;
+		float shininess;
+		
+		bool operator<(const Key &other) const {
+			return std::tie(cellX, cellY, texture, shininess) < std::tie(other.cellX, other.cellY, other.texture, other.shininess);
+		}
+	};
+	struct Pending {
+		std::vector<PipelineMain::Vertex> vertices;
+		Bounds bounds;
+	};
+	struct Batch {
+		uint32_t texture;
+		float shininess;
+		uint32_t firstVertex;
+		uint32_t vertexCount;
+		Bounds bounds;
+	};
+	
+	std::shared_ptr<EVK::Devices> devices;
+	GeometryArena *arena;
+	float cellSize;
+	PerObject identity;
+	std::shared_ptr<EVK::VertexBufferObject> vboIdentity;
+	
+	std::map<Key, Pending> pending;
+	std::vector<Batch> batches;
+	
+	std::vector<uint32_t> cullLists[SHADOW_CULL_LISTS_N];
 };
 
 class Instance {
@@ -52,12 +212,20 @@ private:
 
 class InstanceManager {
 public:
-	InstanceManager(std::shared_ptr<EVK::Devices> _devices, const ObjectData &_objData);
+	InstanceManager(std::shared_ptr<EVK::Devices> _devices, std::shared_ptr<Mesh> _mesh);
 	~InstanceManager() = default;
 	
 	void Update(float dT);
 	
-	virtual Info Render(VkCommandBuffer commandBuffer);
+	// binds the instance buffer, which `Render`'s draws need
+	bool CmdBindInstances(VkCommandBuffer commandBuffer);
+	
+	virtual Info Render();
+	
+	// compacts the instances that pass `visible` into cull list `list` (of `SHADOW_CULL_LISTS_N`); must be called after `Update`
+	void Cull(uint32_t list, const std::function<bool(const Bounds &)> &visible);
+	// binds and draws cull list `list`; gives no draws if nothing in it was visible
+	Info RenderCulled(VkCommandBuffer commandBuffer, uint32_t list);
 	
 	void AddInstance(Instance *ptr){
 		instances[instanceCount++] = ptr;
@@ -76,13 +244,15 @@ public:
 	
 private:
 	std::shared_ptr<EVK::Devices> devices;
-	std::shared_ptr<EVK::VertexBufferObject> vboVertex;
+	std::shared_ptr<Mesh> mesh;
 	std::shared_ptr<EVK::VertexBufferObject> vboInstance;
-	ObjectData objData;
 	
 	PerObject instanceData[MAX_INSTANCES];
+	Bounds instanceBounds[MAX_INSTANCES]; // in world space
 	Instance *instances[MAX_INSTANCES];
 	int instanceCount = 0;
+	
+	std::vector<InstanceList> cullLists;
 };
 
 } // namespace Rendered
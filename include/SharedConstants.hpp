@@ -0,0 +1,39 @@
+#ifndef SharedConstants_hpp
+#define SharedConstants_hpp
+
+// Constants both the C++ and the shaders need, defined once here. The shaders include this too (compile.sh passes `-I../include`), so it must hold nothing but preprocessor definitions.
+
+// buffer layouts are sized for this many cascades; the number actually used, and the shadow map size, are chosen at startup (see `ShadowQuality`)
+#define SHADOW_MAP_CASCADE_COUNT_MAX 8
+
+// clip planes of the camera's projection; the cluster slices are spaced between them
+#define CAMERA_Z_NEAR 0.1f
+#define CAMERA_Z_FAR 1000.0f
+
+// Clustered lighting: the view frustum is split into froxels, tiled in screen space and sliced exponentially in view depth, and a compute pass lists the local lights that reach each one. The main pass then only loops over its fragment's cluster's lights.
+#define CLUSTERS_X 16
+#define CLUSTERS_Y 9
+#define CLUSTERS_Z 24
+#define CLUSTERS_N (CLUSTERS_X*CLUSTERS_Y*CLUSTERS_Z)
+#define CLUSTER_LIGHTS_MAX 31 // any more lights that reach a cluster are left out of it
+#define LIGHTS_MAX 1024
+
+// shading in main.frag and skybox.frag
+#define LIGHT_STRENGTH 3.0f // of the sun
+#define AMBIENT 0.3f // light, and the brightness of the fog
+#define FOG_MAX 0.003f // density at height 0
+#define FOG_DECREASE 0.004f // exponential falloff of the density with height
+
+#define PNGS_N 4 // texture images: debug, chair, chainsaw, concrete
+#define ALPHA_CUTOFF 0.5f // alpha tested fragments whose texture alpha is below this are discarded
+
+// EVSM warp exponents, used both to make the moments and to read them
+#define EVSM_EXPONENT_POSITIVE 5.54f
+#define EVSM_EXPONENT_NEGATIVE 5.54f
+
+// a visibility buffer texel is an instance record index shifted up by this, or'd with the triangle within that instance's draw
+#define VISIBILITY_TRIANGLE_BITS 19
+
+#define GEOMETRY_STORAGE_VERTICES (1 << 18) // how much of the geometry arena can be read as a storage buffer, which is copied per flight
+
+#endif /* SharedConstants_hpp */
@@ -1,30 +1,47 @@
+#include <cfloat>
+
 #include "CascadedShadowMap.hpp"
 
+// the light's view matrix without translation; cascades differ only in translation from this
+static mat<4, 4> LightRotation(){
+	return mat<4, 4>::LookAt(-1.0f*Globals::lightDirection, {0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}).Inverted();
+}
+
 // requires the camera projection and viewInverse matrices to be already set in the Main Global UBO
-void UpdateCascades(PipelineMain::UBO_Global *mainUboGlobal, PipelineShadow::UBO_Global *shadowUboGlobal){
-	float cascadeSplits[SHADOW_MAP_CASCADE_COUNT];
+void UpdateCascades(PipelineMain::UBO_Global *mainUboGlobal, PipelineShadow::UBO_Global *shadowUboGlobal, const SampleBounds *samples){
+	float cascadeSplits[SHADOW_MAP_CASCADE_COUNT_MAX];
+	
+	// split fractions are of the whole camera frustum, which the corners below span
+	const float cameraRange = Globals::cameraZFar - Globals::cameraZNear;
 	
+	// splits are spread over the visible depth range when it's known, rather than the whole frustum
 	float minZ = Globals::cameraZNear;
 	float maxZ = Globals::cameraZFar;
+	if(samples){
+		// quantised to eighths of an octave, so the splits stay put while the samples move a little; with `SHADOW_CACHE`, every cascade next to a moved split has to be redrawn
+		minZ = fmaxf(Globals::cameraZNear, exp2f(floorf(8.0f*log2f(samples->viewDepthMin*(1.0f - Globals::sdsmMargin)))/8.0f));
+		maxZ = fminf(Globals::cameraZFar, fmaxf(exp2f(ceilf(8.0f*log2f(samples->viewDepthMax*(1.0f + Globals::sdsmMargin)))/8.0f), 2.0f*minZ));
+	}
 	float range = maxZ - minZ;
 	float ratio = maxZ / minZ;
 
 	// Calculate split depths based on view camera frustum
 	// Based on method presented in https://developer.nvidia.com/gpugems/GPUGems3/gpugems3_ch10.html
-	const float smccInv = 1.0f/(float)SHADOW_MAP_CASCADE_COUNT;
+	const float smccInv = 1.0f/(float)shadowQuality.cascadeCount;
 	const float pThRootOfRatio = powf(ratio, smccInv);
 	float minZpThRootOfRatioToTheI = minZ * pThRootOfRatio;
-	for(int i=0; i<SHADOW_MAP_CASCADE_COUNT; i++){
+	for(uint32_t i=0; i<shadowQuality.cascadeCount; i++){
 		float uniform = minZ + range * float(i + 1) * smccInv;
 		float d = Globals::cascadeSplitLambda*(minZpThRootOfRatioToTheI - uniform) + uniform;
-		cascadeSplits[i] = (d - minZ) / range;
+		cascadeSplits[i] = (d - Globals::cameraZNear) / cameraRange;
 		
 		minZpThRootOfRatioToTheI *= pThRootOfRatio;
 	}
 	
 	// Calculate orthographic projection matrix for each cascade
-	float lastSplitDist = 0.0;
-	for(int i=0; i<SHADOW_MAP_CASCADE_COUNT; ++i){
+	float lastSplitDist = (minZ - Globals::cameraZNear) / cameraRange;
+	const mat<4, 4> lightRotation = LightRotation();
+	for(uint32_t i=0; i<shadowQuality.cascadeCount; ++i){
 		float splitDist = cascadeSplits[i];
 
 		vec<3> frustumCorners[8] = {
@@ -64,14 +81,109 @@ void UpdateCascades(PipelineMain::UBO_Global *mainUboGlobal, PipelineShadow::UBO
 		}
 		radius = ceilf(radius*16.0f)/16.0f;
 
+		// The projection's half width, fitted to the samples that fell in this cascade last frame when there were any, within the slice's bounding sphere.
+		// It's quantised to sixteenths of the sphere's radius, so it stays the same while the samples move a little.
+		float halfExtent = radius;
+		vec<4> centreLightSpace = lightRotation & (frustumCenter | 1.0f);
+		if(samples && samples->light[i].min.x <= samples->light[i].max.x){
+			const Bounds &fit = samples->light[i];
+			const vec<2> margin = Globals::sdsmMargin*(vec<2>){fit.max.x - fit.min.x, fit.max.y - fit.min.y};
+			const vec<2> fitMin = {fmaxf(fit.min.x - margin.x, centreLightSpace.x - radius), fmaxf(fit.min.y - margin.y, centreLightSpace.y - radius)};
+			const vec<2> fitMax = {fminf(fit.max.x + margin.x, centreLightSpace.x + radius), fminf(fit.max.y + margin.y, centreLightSpace.y + radius)};
+			if(fitMin.x < fitMax.x && fitMin.y < fitMax.y){
+				const float step = radius/16.0f;
+				halfExtent = fminf(radius, step*ceilf(0.5f*fmaxf(fitMax.x - fitMin.x, fitMax.y - fitMin.y)/step));
+				centreLightSpace.x = 0.5f*(fitMin.x + fitMax.x);
+				centreLightSpace.y = 0.5f*(fitMin.y + fitMax.y);
+			}
+		}
+		
+		// Snap the centre to whole texels in light space, so the cascade only moves in texel steps. This stops shadow edges shimmering, and means the matrix is unchanged until the camera has moved a texel.
+		const float texelSize = 2.0f*halfExtent/float(shadowQuality.mapDim);
+		centreLightSpace.x = floorf(centreLightSpace.x/texelSize)*texelSize;
+		centreLightSpace.y = floorf(centreLightSpace.y/texelSize)*texelSize;
+		centreLightSpace.z = floorf(centreLightSpace.z/texelSize)*texelSize;
+		const vec<4> snappedCentre = lightRotation.Inverted() & centreLightSpace;
+		frustumCenter = {snappedCentre.x, snappedCentre.y, snappedCentre.z};
+		
 		mat<4, 4> lightViewMatrix = mat<4, 4>::LookAt(frustumCenter - radius*Globals::lightDirection, frustumCenter, {0.0f, 0.0f, 1.0f}).Inverted();
-		mat<4, 4> lightOrthoMatrix = mat<4, 4>::OrthographicProjection(-radius, radius, -radius, radius, 0.0f, 2.0f*radius);
+		mat<4, 4> lightOrthoMatrix = mat<4, 4>::OrthographicProjection(-halfExtent, halfExtent, -halfExtent, halfExtent, 0.0f, 2.0f*radius);
 		
 		// Store split distance and matrix in cascade
-		mainUboGlobal->cascadeSplits[i] = (minZ + splitDist * range) * -1.0f;
+		mainUboGlobal->cascadeSplits[i] = (Globals::cameraZNear + splitDist * cameraRange) * -1.0f;
 		mainUboGlobal->lightMat[i] = lightOrthoMatrix & lightViewMatrix;
 		shadowUboGlobal->viewInvProj[i] = mainUboGlobal->lightMat[i];
 		
 		lastSplitDist = cascadeSplits[i];
 	}
 }
+
+bool CasterInCascade(const PipelineShadow::UBO_Global *shadowUboGlobal, uint32_t cascade, const Bounds &bounds){
+	return !BoxOutsideFrustum(shadowUboGlobal->viewInvProj[cascade], bounds, false);
+}
+
+#ifdef SHADOW_CACHE
+CascadeSchedule ScheduleCascades(PipelineMain::UBO_Global *mainUboGlobal, PipelineShadow::UBO_Global *shadowUboGlobal){
+	static uint32_t frame = 0;
+	static bool drawnAny = false;
+	static mat<4, 4, float32_t> drawnMats[SHADOW_MAP_CASCADE_COUNT_MAX];
+	static float32_t drawnSplits[SHADOW_MAP_CASCADE_COUNT_MAX]; // a cascade is only sampled where its matrix was fitted, so its split goes with it
+	
+	// A cascade covers the depths between its split and the one before it, so if either split has moved since it was drawn, it must be drawn again this frame, or it would no longer meet its neighbours
+	bool splitMoved[SHADOW_MAP_CASCADE_COUNT_MAX];
+	for(uint32_t i=0; i<shadowQuality.cascadeCount; ++i) splitMoved[i] = drawnAny && drawnSplits[i] != mainUboGlobal->cascadeSplits[i];
+	
+	CascadeSchedule ret;
+	for(uint32_t i=0; i<shadowQuality.cascadeCount; ++i){
+		ret.redraw[i] = !drawnAny || i == 0 || (frame + i) % SHADOW_CASCADE_INTERVAL == 0 || splitMoved[i] || (i > 0 && splitMoved[i - 1]);
+		if(ret.redraw[i]){
+			// matrices are texel-snapped, so are bitwise identical until the cascade has moved
+			ret.redrawStatic[i] = !drawnAny || memcmp(&drawnMats[i], &mainUboGlobal->lightMat[i], sizeof(mat<4, 4, float32_t>)) != 0;
+			drawnMats[i] = mainUboGlobal->lightMat[i];
+			drawnSplits[i] = mainUboGlobal->cascadeSplits[i];
+		} else {
+			ret.redrawStatic[i] = false;
+			mainUboGlobal->lightMat[i] = drawnMats[i];
+			mainUboGlobal->cascadeSplits[i] = drawnSplits[i];
+			shadowUboGlobal->viewInvProj[i] = drawnMats[i];
+		}
+	}
+	drawnAny = true;
+	++frame;
+	return ret;
+}
+#endif
+
+#ifdef SHADOW_SDSM
+void UpdateDepthReduceUBO(PipelineDepthReduce::UBO *depthReduceUbo, const PipelineMain::UBO_Global *mainUboGlobal){
+	depthReduceUbo->clipToView = mainUboGlobal->proj.Inverted();
+	depthReduceUbo->viewToLight = LightRotation() & mainUboGlobal->viewInv.Inverted();
+	for(uint32_t i=0; i<SHADOW_MAP_CASCADE_COUNT_MAX; ++i) depthReduceUbo->cascadeSplits[i] = i < shadowQuality.cascadeCount ? mainUboGlobal->cascadeSplits[i] : -FLT_MAX;
+	depthReduceUbo->viewportScale = mainUboGlobal->viewportScale;
+}
+
+void ResetDepthReduction(PipelineDepthReduce::SBO *result){
+	for(uint32_t i=0; i<shadowQuality.cascadeCount; ++i){
+		for(int j=0; j<4; ++j){
+			result->lightMin[i][j] = PipelineDepthReduce::EncodeOrderedFloat(FLT_MAX);
+			result->lightMax[i][j] = PipelineDepthReduce::EncodeOrderedFloat(-FLT_MAX);
+		}
+	}
+	result->depthMin = PipelineDepthReduce::EncodeOrderedFloat(FLT_MAX);
+	result->depthMax = PipelineDepthReduce::EncodeOrderedFloat(-FLT_MAX);
+}
+
+bool ReadDepthReduction(const PipelineDepthReduce::SBO *result, SampleBounds &samplesOut){
+	samplesOut.viewDepthMin = PipelineDepthReduce::DecodeOrderedFloat(result->depthMin);
+	samplesOut.viewDepthMax = PipelineDepthReduce::DecodeOrderedFloat(result->depthMax);
+	if(samplesOut.viewDepthMin > samplesOut.viewDepthMax) return false;
+	
+	for(uint32_t i=0; i<shadowQuality.cascadeCount; ++i){
+		samplesOut.light[i] = {
+			.min = {PipelineDepthReduce::DecodeOrderedFloat(result->lightMin[i][0]), PipelineDepthReduce::DecodeOrderedFloat(result->lightMin[i][1]), PipelineDepthReduce::DecodeOrderedFloat(result->lightMin[i][2])},
+			.max = {PipelineDepthReduce::DecodeOrderedFloat(result->lightMax[i][0]), PipelineDepthReduce::DecodeOrderedFloat(result->lightMax[i][1]), PipelineDepthReduce::DecodeOrderedFloat(result->lightMax[i][2])}
+		};
+	}
+	return true;
+}
+#endif
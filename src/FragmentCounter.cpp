@@ -0,0 +1,46 @@
+#include "FragmentCounter.hpp"
+
+FragmentCounter::~FragmentCounter(){
+	for(std::pair<const uint32_t, Flight> &flight : flights) vkDestroyQueryPool(devices->GetLogicalDevice(), flight.second.queryPool, nullptr);
+}
+
+void FragmentCounter::CmdReset(VkCommandBuffer commandBuffer, uint32_t flight){
+	if(!flights.contains(flight)){
+		const VkQueryPoolCreateInfo queryPoolCI = {
+			.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+			.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+			.queryCount = 1,
+			.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT
+		};
+		VkQueryPool queryPool;
+		if(vkCreateQueryPool(devices->GetLogicalDevice(), &queryPoolCI, nullptr, &queryPool) != VK_SUCCESS){
+			std::cout << "Failed to create pipeline statistics query pool.\n";
+			return;
+		}
+		flights[flight] = {queryPool, false};
+	}
+	Flight &f = flights[flight];
+	vkCmdResetQueryPool(commandBuffer, f.queryPool, 0, 1);
+	f.counted = false;
+}
+
+void FragmentCounter::CmdBegin(VkCommandBuffer commandBuffer, uint32_t flight){
+	if(!flights.contains(flight)) return;
+	vkCmdBeginQuery(commandBuffer, flights[flight].queryPool, 0, 0);
+}
+
+void FragmentCounter::CmdEnd(VkCommandBuffer commandBuffer, uint32_t flight){
+	if(!flights.contains(flight)) return;
+	Flight &f = flights[flight];
+	vkCmdEndQuery(commandBuffer, f.queryPool, 0);
+	f.counted = true;
+}
+
+std::optional<uint64_t> FragmentCounter::Read(uint32_t flight) const {
+	const std::map<uint32_t, Flight>::const_iterator it = flights.find(flight);
+	if(it == flights.end() || !it->second.counted) return {};
+	uint64_t count;
+	// not waiting: the flight's fence has been, so the result should be ready
+	if(vkGetQueryPoolResults(devices->GetLogicalDevice(), it->second.queryPool, 0, 1, sizeof(count), &count, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) return {};
+	return count;
+}
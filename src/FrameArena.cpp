@@ -0,0 +1,125 @@
+#include <bit>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+
+#include "FrameArena.hpp"
+
+FrameArena *frameArena = nullptr;
+
+// `bytes` from the heap, aligned to `alignment`, a power of two; freed with `std::free`
+static void *AlignedMalloc(size_t bytes, size_t alignment){
+	if(alignment <= alignof(std::max_align_t)) return std::malloc(bytes ? bytes : 1);
+	// `aligned_alloc` wants a multiple of the alignment
+	return std::aligned_alloc(alignment, bytes ? (bytes + alignment - 1) & ~(alignment - 1) : alignment);
+}
+
+FrameArena::FrameArena(size_t _capacity) : block(static_cast<std::byte *>(std::malloc(_capacity))), capacity(_capacity) {
+	if(!block) throw std::bad_alloc();
+}
+
+FrameArena::~FrameArena(){
+	for(std::byte *spill : spills) std::free(spill);
+	std::free(block);
+}
+
+void FrameArena::Reset(){
+	if(!spills.empty()){
+		// room for everything last frame needed, with some to spare
+		const size_t newCapacity = 2*(used + spilt);
+		if(sceneSettings.printArena) std::cout << "Frame arena grown from " << (capacity >> 10) << " KiB to " << (newCapacity >> 10) << " KiB.\n";
+		for(std::byte *spill : spills) std::free(spill);
+		spills.clear();
+		spilt = 0;
+		std::free(block);
+		block = static_cast<std::byte *>(std::malloc(newCapacity));
+		if(!block) throw std::bad_alloc();
+		capacity = newCapacity;
+	}
+	used = 0;
+}
+
+void *FrameArena::Allocate(size_t bytes, size_t alignment){
+	assert(std::has_single_bit(alignment));
+	// aligning the address rather than the offset, as the block itself is only aligned for standard types
+	const size_t offset = ((reinterpret_cast<uintptr_t>(block) + used + alignment - 1) & ~uintptr_t(alignment - 1)) - reinterpret_cast<uintptr_t>(block);
+	if(offset + bytes <= capacity){
+		used = offset + bytes;
+		return block + offset;
+	}
+	std::byte *const spill = static_cast<std::byte *>(AlignedMalloc(bytes, alignment));
+	if(!spill) throw std::bad_alloc();
+	spills.push_back(spill);
+	spilt += bytes;
+	return spill;
+}
+
+void BeginFrameArena(uint32_t flight){
+	static std::map<uint32_t, FrameArena> arenas {};
+	frameArena = &arenas.try_emplace(flight).first->second;
+	frameArena->Reset();
+}
+
+#ifdef FRAME_HEAP_CHECK
+static thread_local uint64_t heapAllocations = 0;
+
+uint64_t HeapAllocations(){
+	return heapAllocations;
+}
+
+void *operator new(size_t bytes){
+	++heapAllocations;
+	if(void *ret = std::malloc(bytes ? bytes : 1)) return ret;
+	throw std::bad_alloc();
+}
+void *operator new[](size_t bytes){
+	return operator new(bytes);
+}
+void *operator new(size_t bytes, const std::nothrow_t &) noexcept {
+	++heapAllocations;
+	return std::malloc(bytes ? bytes : 1);
+}
+void *operator new[](size_t bytes, const std::nothrow_t &) noexcept {
+	return operator new(bytes, std::nothrow);
+}
+void operator delete(void *pointer) noexcept {
+	std::free(pointer);
+}
+void operator delete[](void *pointer) noexcept {
+	std::free(pointer);
+}
+void operator delete(void *pointer, size_t) noexcept {
+	std::free(pointer);
+}
+void operator delete[](void *pointer, size_t) noexcept {
+	std::free(pointer);
+}
+// the over-aligned forms, which would otherwise go to the library's allocator, uncounted
+void *operator new(size_t bytes, std::align_val_t alignment){
+	++heapAllocations;
+	if(void *ret = AlignedMalloc(bytes, size_t(alignment))) return ret;
+	throw std::bad_alloc();
+}
+void *operator new[](size_t bytes, std::align_val_t alignment){
+	return operator new(bytes, alignment);
+}
+void *operator new(size_t bytes, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+	++heapAllocations;
+	return AlignedMalloc(bytes, size_t(alignment));
+}
+void *operator new[](size_t bytes, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+	return operator new(bytes, alignment, std::nothrow);
+}
+void operator delete(void *pointer, std::align_val_t) noexcept {
+	std::free(pointer);
+}
+void operator delete[](void *pointer, std::align_val_t) noexcept {
+	std::free(pointer);
+}
+void operator delete(void *pointer, size_t, std::align_val_t) noexcept {
+	std::free(pointer);
+}
+void operator delete[](void *pointer, size_t, std::align_val_t) noexcept {
+	std::free(pointer);
+}
+#endif
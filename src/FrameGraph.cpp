@@ -0,0 +1,145 @@
+#include <sstream>
+
+#include "FrameGraph.hpp"
+
+static constexpr VkAccessFlags writeAccess = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+void FrameGraph::Clear(FrameArena &_arena, uint32_t _flight){
+	arena = &_arena;
+	flight = _flight;
+	resources.clear();
+	passes.clear();
+	accesses.clear();
+	kept = {};
+	barriers = {};
+}
+
+FrameGraph::ResourceId FrameGraph::AddResource(const char *name, bool transient){
+	resources.push_back({name, transient, false});
+	return ResourceId(resources.size() - 1);
+}
+
+FrameGraph::ResourceId FrameGraph::AddFlightResource(const char *name){
+	resources.push_back({name, false, true});
+	return ResourceId(resources.size() - 1);
+}
+
+void FrameGraph::AddPass(const char *name, std::initializer_list<Access> passAccesses, Record record, bool sideEffects){
+	passes.push_back({name, uint32_t(accesses.size()), uint32_t(passAccesses.size()), record, sideEffects});
+	accesses.insert(accesses.end(), passAccesses);
+}
+
+void FrameGraph::AddAccess(const Access &access){
+	accesses.push_back(access);
+	++passes.back().accessesN;
+}
+
+void FrameGraph::Compile(){
+	Cull();
+	PlaceBarriers();
+}
+
+void FrameGraph::Cull(){
+	// from the last pass back: a pass is needed if it has side effects or writes something a needed pass after it reads
+	kept = arena->NewSpan<bool>(passes.size());
+	const std::span<bool> read = arena->NewSpan<bool>(resources.size());
+	for(size_t i=passes.size(); i--;){
+		const Pass &pass = passes[i];
+		bool needed = pass.sideEffects;
+		for(const Access &access : Accesses(pass)) if((access.access & writeAccess) && read[access.resource]) needed = true;
+		if(!needed) continue;
+		kept[i] = true;
+		for(const Access &access : Accesses(pass)) if(access.access & ~writeAccess) read[access.resource] = true;
+	}
+}
+
+void FrameGraph::PlaceBarriers(){
+	const std::span<State> states = arena->NewSpan<State>(resources.size());
+	for(size_t i=0; i<resources.size(); ++i){
+		if(resources[i].transient) continue;
+		if(const auto it = carried.find(CarriedKey(resources[i])); it != carried.end()) states[i] = it->second;
+	}
+	
+	barriers = arena->NewSpan<Barrier>(passes.size());
+	for(size_t i=0; i<passes.size(); ++i){
+		if(!kept[i]) continue;
+		Barrier &barrier = barriers[i];
+		
+		// accesses within a pass are its own to synchronise, so all are checked against the state before it
+		for(const Access &access : Accesses(passes[i])){
+			if(access.synchronised) continue;
+			const State &state = states[access.resource];
+			const VkAccessFlags reads = access.access & ~writeAccess;
+			const VkAccessFlags writes = access.access & writeAccess;
+			if(state.written && reads && ((access.stages & ~state.visibleStages) || (reads & ~state.visibleAccess))){
+				barrier.srcStages |= state.writeStages;
+				barrier.srcAccess |= state.writeAccess;
+				barrier.dstStages |= access.stages;
+				barrier.dstAccess |= reads;
+			}
+			if(writes){
+				if(state.written){
+					barrier.srcStages |= state.writeStages;
+					barrier.srcAccess |= state.writeAccess;
+					barrier.dstStages |= access.stages;
+					barrier.dstAccess |= writes;
+				}
+				// reads only need to have finished
+				if(state.readStages){
+					barrier.srcStages |= state.readStages;
+					barrier.dstStages |= access.stages;
+				}
+			}
+		}
+		
+		for(const Access &access : Accesses(passes[i])){
+			State &state = states[access.resource];
+			const VkAccessFlags reads = access.access & ~writeAccess;
+			const VkAccessFlags writes = access.access & writeAccess;
+			if(writes){
+				state = {
+					.written = true,
+					.writeStages = access.stages,
+					.writeAccess = writes,
+					.readStages = 0,
+					.visibleStages = access.synchronised ? access.visibleStages : 0,
+					.visibleAccess = access.synchronised ? access.visibleAccess : 0
+				};
+			} else if(reads && !access.synchronised){
+				state.visibleStages |= access.stages;
+				state.visibleAccess |= reads;
+			}
+			if(reads) state.readStages |= access.stages;
+		}
+	}
+	
+	for(size_t i=0; i<resources.size(); ++i) if(!resources[i].transient) carried[CarriedKey(resources[i])] = states[i];
+}
+
+void FrameGraph::Execute(VkCommandBuffer commandBuffer) const {
+	for(size_t i=0; i<passes.size(); ++i){
+		if(!kept[i]) continue;
+		const Barrier &barrier = barriers[i];
+		if(barrier.srcStages){
+			const VkMemoryBarrier memoryBarrier = {
+				.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+				.srcAccessMask = barrier.srcAccess,
+				.dstAccessMask = barrier.dstAccess
+			};
+			vkCmdPipelineBarrier(commandBuffer, barrier.srcStages, barrier.dstStages, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		}
+		if(passes[i].record) passes[i].record(commandBuffer, flight);
+	}
+}
+
+std::string FrameGraph::Describe() const {
+	std::ostringstream ret {};
+	ret << std::hex;
+	for(size_t i=0; i<passes.size(); ++i){
+		ret << "\t" << passes[i].name;
+		if(!kept[i]) ret << " (culled)";
+		else if(barriers[i].srcStages) ret << " after barrier 0x" << barriers[i].srcStages << "/0x" << barriers[i].srcAccess << " -> 0x" << barriers[i].dstStages << "/0x" << barriers[i].dstAccess;
+		ret << "\n";
+	}
+	return ret.str();
+}
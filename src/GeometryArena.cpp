@@ -0,0 +1,264 @@
+#include <bit>
+
+#include "GeometryArena.hpp"
+
+RangeAllocator::RangeAllocator(uint32_t _capacity) : capacity(_capacity) {
+	for(uint32_t fl=0; fl<flN; ++fl) for(uint32_t sl=0; sl<slN; ++sl) freeLists[fl][sl] = none;
+	first = last = NewBlock({
+		.offset = 0,
+		.count = capacity,
+		.free = true,
+		.prevPhysical = none,
+		.nextPhysical = none
+	});
+	if(capacity) InsertFree(first);
+}
+
+std::optional<uint32_t> RangeAllocator::Allocate(uint32_t count){
+	if(count == 0 || count > capacity - used) return {};
+	
+	// Rounded up to the next class, every range of which fits. Failing that, the class `count` is in may still have one that does.
+	uint32_t fl, sl;
+	const uint32_t f = uint32_t(std::bit_width(count)) - 1;
+	const uint64_t rounded = count < slN ? count : uint64_t(count) + (1u << (f - slBits)) - 1;
+	uint32_t block = none;
+	if(rounded <= UINT32_MAX){
+		Classify(uint32_t(rounded), fl, sl);
+		block = FindFree(fl, sl);
+	}
+	if(block == none){
+		Classify(count, fl, sl);
+		for(uint32_t b = freeLists[fl][sl]; b != none; b = blocks[b].nextFree){
+			if(blocks[b].count >= count){
+				block = b;
+				break;
+			}
+		}
+		if(block == none) return {};
+	}
+	
+	RemoveFree(block);
+	if(blocks[block].count > count){
+		// the rest is split off after it
+		const uint32_t rest = NewBlock({
+			.offset = blocks[block].offset + count,
+			.count = blocks[block].count - count,
+			.free = true,
+			.prevPhysical = block,
+			.nextPhysical = blocks[block].nextPhysical
+		});
+		if(blocks[rest].nextPhysical != none) blocks[blocks[rest].nextPhysical].prevPhysical = rest;
+		else last = rest;
+		blocks[block].nextPhysical = rest;
+		blocks[block].count = count;
+		InsertFree(rest);
+	}
+	blocks[block].free = false;
+	allocated[blocks[block].offset] = block;
+	used += count;
+	return blocks[block].offset;
+}
+
+void RangeAllocator::Free(uint32_t offset, uint32_t count){
+	if(count == 0) return;
+	const std::unordered_map<uint32_t, uint32_t>::iterator it = allocated.find(offset);
+	if(it == allocated.end() || blocks[it->second].count != count){
+		std::cout << "Warning: Tried to free a range that wasn't allocated.\n";
+		return;
+	}
+	uint32_t block = it->second;
+	allocated.erase(it);
+	used -= count;
+	blocks[block].free = true;
+	
+	// merging with the following range
+	const uint32_t next = blocks[block].nextPhysical;
+	if(next != none && blocks[next].free){
+		RemoveFree(next);
+		blocks[block].count += blocks[next].count;
+		blocks[block].nextPhysical = blocks[next].nextPhysical;
+		if(blocks[block].nextPhysical != none) blocks[blocks[block].nextPhysical].prevPhysical = block;
+		else last = block;
+		ReleaseBlock(next);
+	}
+	// merging with the preceding range
+	const uint32_t prev = blocks[block].prevPhysical;
+	if(prev != none && blocks[prev].free){
+		RemoveFree(prev);
+		blocks[prev].count += blocks[block].count;
+		blocks[prev].nextPhysical = blocks[block].nextPhysical;
+		if(blocks[prev].nextPhysical != none) blocks[blocks[prev].nextPhysical].prevPhysical = prev;
+		else last = prev;
+		ReleaseBlock(block);
+		block = prev;
+	}
+	InsertFree(block);
+}
+
+uint32_t RangeAllocator::GetEnd() const {
+	return blocks[last].free ? blocks[last].offset : capacity;
+}
+
+RangeAllocator::Statistics RangeAllocator::GetStatistics() const {
+	Statistics ret = {
+		.allocations = uint32_t(allocated.size()),
+		.freeRanges = 0,
+		.free = capacity - used,
+		.largestFree = 0
+	};
+	for(uint32_t b = first; b != none; b = blocks[b].nextPhysical){
+		if(!blocks[b].free || blocks[b].count == 0) continue;
+		++ret.freeRanges;
+		if(blocks[b].count > ret.largestFree) ret.largestFree = blocks[b].count;
+	}
+	return ret;
+}
+
+void RangeAllocator::Classify(uint32_t count, uint32_t &fl, uint32_t &sl){
+	if(count < slN){
+		fl = 0;
+		sl = count;
+		return;
+	}
+	const uint32_t f = uint32_t(std::bit_width(count)) - 1;
+	fl = f - slBits + 1;
+	sl = (count >> (f - slBits)) - slN;
+}
+
+uint32_t RangeAllocator::FindFree(uint32_t fl, uint32_t sl) const {
+	if(fl >= flN) return none;
+	uint32_t slMap = slBitmaps[fl] & (~0u << sl);
+	if(!slMap){
+		const uint32_t flMap = fl + 1 < 32 ? flBitmap & (~0u << (fl + 1)) : 0;
+		if(!flMap) return none;
+		fl = uint32_t(std::countr_zero(flMap));
+		slMap = slBitmaps[fl];
+	}
+	sl = uint32_t(std::countr_zero(slMap));
+	return freeLists[fl][sl];
+}
+
+void RangeAllocator::InsertFree(uint32_t block){
+	uint32_t fl, sl;
+	Classify(blocks[block].count, fl, sl);
+	blocks[block].prevFree = none;
+	blocks[block].nextFree = freeLists[fl][sl];
+	if(freeLists[fl][sl] != none) blocks[freeLists[fl][sl]].prevFree = block;
+	freeLists[fl][sl] = block;
+	flBitmap |= 1u << fl;
+	slBitmaps[fl] |= 1u << sl;
+}
+
+void RangeAllocator::RemoveFree(uint32_t block){
+	uint32_t fl, sl;
+	Classify(blocks[block].count, fl, sl);
+	const uint32_t prev = blocks[block].prevFree;
+	const uint32_t next = blocks[block].nextFree;
+	if(prev != none) blocks[prev].nextFree = next;
+	else freeLists[fl][sl] = next;
+	if(next != none) blocks[next].prevFree = prev;
+	if(freeLists[fl][sl] == none){
+		slBitmaps[fl] &= ~(1u << sl);
+		if(!slBitmaps[fl]) flBitmap &= ~(1u << fl);
+	}
+}
+
+uint32_t RangeAllocator::NewBlock(const Block &block){
+	if(spareBlocks.empty()){
+		blocks.push_back(block);
+		return uint32_t(blocks.size() - 1);
+	}
+	const uint32_t ret = spareBlocks.back();
+	spareBlocks.pop_back();
+	blocks[ret] = block;
+	return ret;
+}
+
+void RangeAllocator::ReleaseBlock(uint32_t block){
+	spareBlocks.push_back(block);
+}
+
+
+GeometryArena::GeometryArena(std::shared_ptr<EVK::Devices> _devices, uint32_t vertexCapacity) : devices(_devices), allocator(vertexCapacity) {}
+
+std::optional<uint32_t> GeometryArena::AddVertices(const PipelineMain::Vertex *data, uint32_t count, std::function<void(uint32_t)> moved){
+	const std::optional<uint32_t> first = allocator.Allocate(count);
+	if(!first){
+		std::cout << "ERROR: Geometry arena is full; " << allocator.GetUsed() << " of " << allocator.GetCapacity() << " vertices used.\n";
+		return {};
+	}
+	if(vertices.size() < first.value() + count) vertices.resize(first.value() + count);
+	memcpy(&vertices[first.value()], data, count * sizeof(PipelineMain::Vertex));
+	ranges[first.value()] = {count, std::move(moved)};
+	vbosCurrent.clear();
+	storageCurrent.clear();
+	return first;
+}
+
+void GeometryArena::FreeVertices(uint32_t first, uint32_t count){
+	allocator.Free(first, count);
+	ranges.erase(first);
+	freed = true;
+	// nothing needs uploading; the range is simply left unreferenced until reused
+	vertices.resize(allocator.GetEnd());
+}
+
+void GeometryArena::Flush(uint32_t flight){
+	if(freed){
+		freed = false;
+		// ranges moved here are only seen by frames recorded from now on, each with its flight's buffer uploaded below first; the frames already in flight draw from their own buffers, at the old offsets
+		if(GetStatistics().Fragmentation() >= GEOMETRY_ARENA_DEFRAGMENT_AT) Defragment();
+	}
+	if(vbosCurrent.contains(flight)) return;
+	std::shared_ptr<EVK::VertexBufferObject> &vbo = vbos[flight];
+	if(!vbo) vbo = std::make_shared<EVK::VertexBufferObject>(devices);
+	if(!vertices.empty()) vbo->Fill((void *)vertices.data(), vertices.size() * sizeof(PipelineMain::Vertex));
+	vbosCurrent.insert(flight);
+}
+
+void GeometryArena::Defragment(){
+	const RangeAllocator::Statistics before = GetStatistics();
+	
+	// Reallocated in order from empty, each range lands at or below where it was, so it can be moved down in place without overwriting any not yet moved
+	allocator = RangeAllocator(allocator.GetCapacity());
+	std::map<uint32_t, std::pair<uint32_t, std::function<void(uint32_t)>>> moved {};
+	uint32_t movedN = 0;
+	for(std::pair<const uint32_t, std::pair<uint32_t, std::function<void(uint32_t)>>> &range : ranges){
+		const uint32_t from = range.first;
+		const uint32_t count = range.second.first;
+		const uint32_t to = allocator.Allocate(count).value();
+		if(to != from){
+			memmove(&vertices[to], &vertices[from], count * sizeof(PipelineMain::Vertex));
+			if(range.second.second) range.second.second(to);
+			++movedN;
+		}
+		moved[to] = std::move(range.second);
+	}
+	ranges = std::move(moved);
+	vertices.resize(allocator.GetEnd());
+	vbosCurrent.clear();
+	storageCurrent.clear();
+	
+	if(sceneSettings.printArena) std::cout << "Defragmented geometry arena: moved " << movedN << " of " << ranges.size() << " ranges, merging " << before.freeRanges << " free ranges of " << before.free << " vertices (the largest " << before.largestFree << ") into one.\n";
+}
+
+bool GeometryArena::CmdBind(VkCommandBuffer commandBuffer, uint32_t flight){
+	const std::map<uint32_t, std::shared_ptr<EVK::VertexBufferObject>>::const_iterator it = vbos.find(flight);
+	if(it == vbos.end() || vertices.empty()) return false;
+	return it->second->CmdBind(commandBuffer, uint32_t(VertexBufferBinding::vertex));
+}
+
+void GeometryArena::EnableStorage(){
+	if(!storage) storage = std::make_shared<EVK::StorageBufferObject<GeometryStorage>>(devices);
+}
+
+void GeometryArena::FlushStorage(uint32_t flight){
+	if(!storage || storageCurrent.contains(flight)) return;
+	uint32_t count = uint32_t(vertices.size());
+	if(count > GEOMETRY_STORAGE_VERTICES){
+		std::cout << "Warning: Geometry arena is past the " << GEOMETRY_STORAGE_VERTICES << " vertices that fit in its storage buffer; later meshes won't be readable by shaders.\n";
+		count = GEOMETRY_STORAGE_VERTICES;
+	}
+	memcpy(storage->GetDataPointer(flight)->vertices, vertices.data(), count * sizeof(PipelineMain::Vertex));
+	storageCurrent.insert(flight);
+}
@@ -0,0 +1,51 @@
+#include "GpuTimer.hpp"
+
+GpuTimer::GpuTimer(std::shared_ptr<EVK::Devices> _devices, uint32_t _sectionsN) : devices(_devices), sectionsN(_sectionsN) {
+	const VkPhysicalDeviceLimits &limits = devices->GetPhysicalDeviceProperties().limits;
+	millisecondsPerTick = 1.0e-6 * double(limits.timestampPeriod);
+	if(!limits.timestampComputeAndGraphics) std::cout << "Warning: Device doesn't support timestamps on all graphics and compute queues; GPU timings may be unavailable.\n";
+}
+
+GpuTimer::~GpuTimer(){
+	for(std::pair<const uint32_t, Flight> &flight : flights) vkDestroyQueryPool(devices->GetLogicalDevice(), flight.second.queryPool, nullptr);
+}
+
+void GpuTimer::CmdReset(VkCommandBuffer commandBuffer, uint32_t flight){
+	if(!flights.contains(flight)){
+		const VkQueryPoolCreateInfo queryPoolCI = {
+			.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+			.queryType = VK_QUERY_TYPE_TIMESTAMP,
+			.queryCount = 2*sectionsN
+		};
+		VkQueryPool queryPool;
+		if(vkCreateQueryPool(devices->GetLogicalDevice(), &queryPoolCI, nullptr, &queryPool) != VK_SUCCESS){
+			std::cout << "Failed to create timestamp query pool.\n";
+			return;
+		}
+		flights[flight] = {queryPool, std::vector<bool>(sectionsN, false)};
+	}
+	Flight &f = flights[flight];
+	vkCmdResetQueryPool(commandBuffer, f.queryPool, 0, 2*sectionsN);
+	f.timed.assign(sectionsN, false);
+}
+
+void GpuTimer::CmdBegin(VkCommandBuffer commandBuffer, uint32_t flight, uint32_t section){
+	if(!flights.contains(flight)) return;
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, flights[flight].queryPool, 2*section);
+}
+
+void GpuTimer::CmdEnd(VkCommandBuffer commandBuffer, uint32_t flight, uint32_t section){
+	if(!flights.contains(flight)) return;
+	Flight &f = flights[flight];
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, f.queryPool, 2*section + 1);
+	f.timed[section] = true;
+}
+
+std::optional<double> GpuTimer::Read(uint32_t flight, uint32_t section) const {
+	const std::map<uint32_t, Flight>::const_iterator it = flights.find(flight);
+	if(it == flights.end() || !it->second.timed[section]) return {};
+	uint64_t timestamps[2];
+	// not waiting: the flight's fence has been, so the results should be ready
+	if(vkGetQueryPoolResults(devices->GetLogicalDevice(), it->second.queryPool, 2*section, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) return {};
+	return millisecondsPerTick * double(timestamps[1] - timestamps[0]);
+}
@@ -1,10 +1,323 @@
+#include <algorithm>
+
 #include "Header.hpp"
 
+const ShadowQuality ShadowQuality::tiers[int(Tier::_COUNT_)] = {
+	{2, 1024, 1}, // low
+	{3, 2048, 2}, // medium
+	{4, 2048, 2}, // high
+	{6, 4096, 3} // ultra
+};
+
+ShadowQuality shadowQuality = ShadowQuality::tiers[int(ShadowQuality::defaultTier)];
+
+ShadowQuality ShadowQuality::FromArguments(int argc, const char *argv[]){
+	ShadowQuality ret = tiers[int(defaultTier)];
+	for(int i=1; i<argc; ++i){
+		static const char *tierPrefix = "--shadows=";
+		static const char *cascadesPrefix = "--shadow-cascades=";
+		static const char *dimPrefix = "--shadow-dim=";
+		if(strncmp(argv[i], tierPrefix, strlen(tierPrefix)) == 0){
+			const char *name = argv[i] + strlen(tierPrefix);
+			bool found = false;
+			for(int t=0; t<int(Tier::_COUNT_); ++t){
+				if(strcmp(name, tierNames[t]) == 0){
+					ret = tiers[t];
+					found = true;
+				}
+			}
+			if(!found) std::cout << "Warning: Unknown shadow quality tier '" << name << "'; ignoring.\n";
+		} else if(strncmp(argv[i], cascadesPrefix, strlen(cascadesPrefix)) == 0){
+			ret.cascadeCount = uint32_t(atoi(argv[i] + strlen(cascadesPrefix)));
+		} else if(strncmp(argv[i], dimPrefix, strlen(dimPrefix)) == 0){
+			ret.mapDim = uint32_t(atoi(argv[i] + strlen(dimPrefix)));
+		}
+	}
+	
+	if(ret.cascadeCount < 1 || ret.cascadeCount > SHADOW_MAP_CASCADE_COUNT_MAX){
+		std::cout << "Warning: Shadow cascade count must be from 1 to " << SHADOW_MAP_CASCADE_COUNT_MAX << "; clamping.\n";
+		ret.cascadeCount = ret.cascadeCount < 1 ? 1 : SHADOW_MAP_CASCADE_COUNT_MAX;
+	}
+	if(ret.mapDim < 256){
+		std::cout << "Warning: Shadow map size must be at least 256; clamping.\n";
+		ret.mapDim = 256;
+	}
+	return ret;
+}
+
+ShadowFilterSettings shadowFilterSettings {};
+
+ShadowFilterSettings ShadowFilterSettings::FromArguments(int argc, const char *argv[]){
+	ShadowFilterSettings ret {};
+	for(int i=1; i<argc; ++i){
+		static const char *filterPrefix = "--shadow-filter=";
+		if(strncmp(argv[i], filterPrefix, strlen(filterPrefix)) == 0){
+			const char *name = argv[i] + strlen(filterPrefix);
+			bool found = false;
+			for(int f=0; f<int(ShadowFilter::_COUNT_); ++f){
+				if(strcmp(name, filterNames[f]) == 0){
+					ret.filter = ShadowFilter(f);
+					found = true;
+				}
+			}
+			if(!found) std::cout << "Warning: Unknown shadow filter '" << name << "'; ignoring.\n";
+		} else if(strcmp(argv[i], "--shadow-benchmark") == 0){
+			ret.benchmark = true;
+		}
+	}
+	return ret;
+}
+
+HdrSettings hdrSettings {};
+
+HdrSettings HdrSettings::FromArguments(int argc, const char *argv[]){
+	HdrSettings ret {};
+	for(int i=1; i<argc; ++i){
+		static const char *formatPrefix = "--hdr-format=";
+		if(strncmp(argv[i], formatPrefix, strlen(formatPrefix)) == 0){
+			const char *name = argv[i] + strlen(formatPrefix);
+			bool found = false;
+			for(int f=0; f<int(HdrFormat::_COUNT_); ++f){
+				if(strcmp(name, formatNames[f]) == 0){
+					ret.format = HdrFormat(f);
+					found = true;
+				}
+			}
+			if(!found) std::cout << "Warning: Unknown HDR format '" << name << "'; ignoring.\n";
+		} else if(strcmp(argv[i], "--hdr-benchmark") == 0){
+			ret.benchmark = true;
+		}
+	}
+	return ret;
+}
+
+void HdrSettings::Validate(const std::shared_ptr<EVK::Devices> &devices){
+	const VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BLEND_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+	if((devices->GetFormatProperties(ColourFormat()).optimalTilingFeatures & needed) == needed) return;
+	std::cout << "Warning: HDR format '" << formatNames[int(format)] << "' can't be rendered to and sampled on this device; using '" << formatNames[int(HdrFormat::rgba16)] << "'.\n";
+	format = HdrFormat::rgba16;
+}
+
+PostSettings postSettings {};
+
+PostSettings PostSettings::FromArguments(int argc, const char *argv[]){
+	PostSettings ret {};
+	for(int i=1; i<argc; ++i){
+		static const char *chainPrefix = "--post=";
+		if(strncmp(argv[i], chainPrefix, strlen(chainPrefix)) == 0){
+			ret.chain.clear();
+			std::string list = argv[i] + strlen(chainPrefix);
+			size_t start = 0;
+			while(start <= list.size()){
+				size_t end = list.find(',', start);
+				if(end == std::string::npos) end = list.size();
+				const std::string name = list.substr(start, end - start);
+				start = end + 1;
+				if(name.empty()) continue;
+				bool found = false;
+				for(int e=0; e<int(PostEffect::_COUNT_); ++e){
+					if(name == effectNames[e]){
+						ret.chain.push_back(PostEffect(e));
+						found = true;
+					}
+				}
+				if(!found) std::cout << "Warning: Unknown post-processing effect '" << name << "'; ignoring.\n";
+			}
+		} else if(strcmp(argv[i], "--post-unfused") == 0){
+			ret.fuse = false;
+		} else if(strcmp(argv[i], "--post-timing") == 0){
+			ret.timing = true;
+		}
+	}
+	
+	if(!ret.chain.empty()){
+		// tonemapping leaves low dynamic range, which nothing after it expects
+		const auto tonemap = std::find(ret.chain.begin(), ret.chain.end(), PostEffect::tonemap);
+		if(tonemap != ret.chain.end() && tonemap + 1 != ret.chain.end()) std::cout << "Warning: Tonemapping must be the last post-processing effect; moving it.\n";
+		ret.chain.erase(std::remove(ret.chain.begin(), ret.chain.end(), PostEffect::tonemap), ret.chain.end());
+		ret.chain.push_back(PostEffect::tonemap);
+	}
+	return ret;
+}
+
+ResolutionSettings resolutionSettings {};
+
+ResolutionSettings ResolutionSettings::FromArguments(int argc, const char *argv[]){
+	ResolutionSettings ret {};
+	for(int i=1; i<argc; ++i){
+		static const char *targetPrefix = "--dynamic-resolution=";
+		static const char *minScalePrefix = "--min-resolution-scale=";
+		static const char *sharpnessPrefix = "--upsample-sharpness=";
+		if(strncmp(argv[i], targetPrefix, strlen(targetPrefix)) == 0){
+			ret.targetMs = float(atof(argv[i] + strlen(targetPrefix)));
+		} else if(strncmp(argv[i], minScalePrefix, strlen(minScalePrefix)) == 0){
+			ret.minScale = float(atof(argv[i] + strlen(minScalePrefix)));
+		} else if(strncmp(argv[i], sharpnessPrefix, strlen(sharpnessPrefix)) == 0){
+			ret.sharpness = float(atof(argv[i] + strlen(sharpnessPrefix)));
+		}
+	}
+	
+	if(ret.targetMs < 0.0f){
+		std::cout << "Warning: The dynamic resolution target can't be negative; drawing at full resolution.\n";
+		ret.targetMs = 0.0f;
+	}
+	if(ret.minScale < 0.25f || ret.minScale > 1.0f){
+		std::cout << "Warning: The minimum resolution scale must be from 0.25 to 1; clamping.\n";
+		ret.minScale = std::clamp(ret.minScale, 0.25f, 1.0f);
+	}
+	ret.sharpness = std::clamp(ret.sharpness, 0.0f, 1.0f);
+	return ret;
+}
+
+SceneSettings sceneSettings {};
+
+SceneSettings SceneSettings::FromArguments(int argc, const char *argv[]){
+	SceneSettings ret {};
+	for(int i=1; i<argc; ++i){
+		static const char *prepassPrefix = "--depth-prepass=";
+		static const char *lightsPrefix = "--lights=";
+		static const char *rendererPrefix = "--renderer=";
+		static const char *fogPrefix = "--fog=";
+		if(strncmp(argv[i], prepassPrefix, strlen(prepassPrefix)) == 0){
+			const char *value = argv[i] + strlen(prepassPrefix);
+			if(strcmp(value, "on") == 0) ret.depthPrepass = true;
+			else if(strcmp(value, "off") == 0) ret.depthPrepass = false;
+			else std::cout << "Warning: Depth pre-pass must be 'on' or 'off', not '" << value << "'; ignoring.\n";
+		} else if(strcmp(argv[i], "--pipeline-statistics") == 0){
+			ret.pipelineStatistics = true;
+		} else if(strncmp(argv[i], lightsPrefix, strlen(lightsPrefix)) == 0){
+			ret.localLights = uint32_t(atoi(argv[i] + strlen(lightsPrefix)));
+		} else if(strncmp(argv[i], rendererPrefix, strlen(rendererPrefix)) == 0){
+			const char *value = argv[i] + strlen(rendererPrefix);
+			if(strcmp(value, "forward") == 0) ret.visibilityBuffer = false;
+			else if(strcmp(value, "visibility") == 0) ret.visibilityBuffer = true;
+			else std::cout << "Warning: Renderer must be 'forward' or 'visibility', not '" << value << "'; ignoring.\n";
+		} else if(strncmp(argv[i], fogPrefix, strlen(fogPrefix)) == 0){
+			const char *value = argv[i] + strlen(fogPrefix);
+			if(strcmp(value, "on") == 0) ret.fog = true;
+			else if(strcmp(value, "off") == 0) ret.fog = false;
+			else std::cout << "Warning: Fog must be 'on' or 'off', not '" << value << "'; ignoring.\n";
+		} else if(strcmp(argv[i], "--frame-graph") == 0){
+			ret.printFrameGraph = true;
+		} else if(strcmp(argv[i], "--arena-statistics") == 0){
+			ret.printArena = true;
+		}
+	}
+	
+	if(ret.localLights > LIGHTS_MAX){
+		std::cout << "Warning: There can be at most " << LIGHTS_MAX << " lights; clamping.\n";
+		ret.localLights = LIGHTS_MAX;
+	}
+	return ret;
+}
+
+DeviceFeatures deviceFeatures = {};
+
+void DeviceFeatures::Request(VkPhysicalDevice physicalDevice, VkDeviceCreateInfo &deviceCI){
+	uint32_t availableN = 0;
+	vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &availableN, nullptr);
+	std::vector<VkExtensionProperties> available(availableN);
+	vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &availableN, available.data());
+	const bool extendedDynamicStateAvailable = std::any_of(available.begin(), available.end(), [](const VkExtensionProperties &extension){
+		return strcmp(extension.extensionName, VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME) == 0;
+	});
+	
+	// the extension's features struct is only chained where the extension is there
+	VkPhysicalDeviceExtendedDynamicStateFeaturesEXT supportedExtendedDynamicState = {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT};
+	VkPhysicalDeviceMultiviewFeatures supportedMultiview = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES,
+		.pNext = extendedDynamicStateAvailable ? &supportedExtendedDynamicState : nullptr
+	};
+	VkPhysicalDeviceFeatures2 supported = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+		.pNext = &supportedMultiview
+	};
+	vkGetPhysicalDeviceFeatures2(physicalDevice, &supported);
+
+#ifdef SHADOW_MULTIVIEW
+	multiview = supportedMultiview.multiview == VK_TRUE;
+#else
+	multiview = false;
+#endif
+	pipelineStatisticsQuery = supported.features.pipelineStatisticsQuery == VK_TRUE;
+	depthClamp = supported.features.depthClamp == VK_TRUE;
+	// The core commands would need the instance and device created for Vulkan 1.3, which EVK chooses, not just a 1.3 physical device, so the extension is always what's asked for. Drivers keep exposing it after its promotion.
+	dynamicDepthState = supportedExtendedDynamicState.extendedDynamicState == VK_TRUE;
+	
+	const void *next = deviceCI.pNext;
+	if(dynamicDepthState){
+		extensionNames.assign(deviceCI.ppEnabledExtensionNames, deviceCI.ppEnabledExtensionNames + deviceCI.enabledExtensionCount);
+		extensionNames.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+		deviceCI.enabledExtensionCount = uint32_t(extensionNames.size());
+		deviceCI.ppEnabledExtensionNames = extensionNames.data();
+		
+		extendedDynamicStateFeatures = {
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT,
+			.pNext = const_cast<void *>(next),
+			.extendedDynamicState = VK_TRUE
+		};
+		next = &extendedDynamicStateFeatures;
+	}
+	
+	// once features are chained, the core ones must be given in the chain too, so whatever EVK asked for is moved there
+	multiviewFeatures = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES,
+		.pNext = const_cast<void *>(next),
+		.multiview = multiview ? VK_TRUE : VK_FALSE
+	};
+	features2 = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+		.pNext = &multiviewFeatures,
+		.features = deviceCI.pEnabledFeatures ? *deviceCI.pEnabledFeatures : VkPhysicalDeviceFeatures{}
+	};
+	features2.features.pipelineStatisticsQuery = pipelineStatisticsQuery ? VK_TRUE : VK_FALSE;
+	features2.features.depthClamp = depthClamp ? VK_TRUE : VK_FALSE;
+	deviceCI.pEnabledFeatures = nullptr;
+	deviceCI.pNext = &features2;
+}
+
+void DeviceFeatures::Load(VkDevice device){
+	if(!dynamicDepthState) return;
+	cmdSetDepthCompareOp = (PFN_vkCmdSetDepthCompareOp)vkGetDeviceProcAddr(device, "vkCmdSetDepthCompareOpEXT");
+	cmdSetDepthWriteEnable = (PFN_vkCmdSetDepthWriteEnable)vkGetDeviceProcAddr(device, "vkCmdSetDepthWriteEnableEXT");
+}
+
 unsigned long UTime(){
 	timeval tv;
 	gettimeofday(&tv, nullptr);
 	return 1000000*(unsigned long)tv.tv_sec + (unsigned long)tv.tv_usec;
 }
 
+bool BoxOutsideFrustum(const mat<4, 4> &viewProjection, const Bounds &box, bool nearPlane){
+	// bit i set if the corner is outside clip plane i: -x, +x, -y, +y, near, far
+	uint32_t outsideAll = nearPlane ? 0b111111 : 0b101111;
+	for(int i=0; i<8; ++i){
+		const vec<3> corner = {i & 1 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y, i & 4 ? box.max.z : box.min.z};
+		const vec<4> clip = viewProjection & (corner | 1.0f);
+		uint32_t outside = 0;
+		if(clip.x < -clip.w) outside |= 1 << 0;
+		if(clip.x >  clip.w) outside |= 1 << 1;
+		if(clip.y < -clip.w) outside |= 1 << 2;
+		if(clip.y >  clip.w) outside |= 1 << 3;
+		if(clip.z < -clip.w) outside |= 1 << 4; // using the OpenGL near plane, which is behind Vulkan's, to stay conservative
+		if(clip.z >  clip.w) outside |= 1 << 5;
+		outsideAll &= outside;
+		if(!outsideAll) return false;
+	}
+	return true;
+}
+
+Bounds TransformBounds(const mat<4, 4> &transform, const Bounds &box){
+	Bounds ret;
+	for(int i=0; i<8; ++i){
+		const vec<3> corner = {i & 1 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y, i & 4 ? box.max.z : box.min.z};
+		const vec<4> transformed = transform & (corner | 1.0f);
+		const vec<3> point = (vec<3>){transformed.x, transformed.y, transformed.z} / transformed.w;
+		if(i == 0) ret.min = ret.max = point;
+		else ret.Expand(point);
+	}
+	return ret;
+}
+
 //int descriptorSetsInitCount = 0;
 
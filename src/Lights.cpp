@@ -0,0 +1,50 @@
+#include "Lights.hpp"
+
+LightBuffer::LightBuffer(std::shared_ptr<EVK::Devices> _devices) : sbo(std::make_shared<EVK::StorageBufferObject<PipelineClusters::LightsSBO>>(_devices)) {}
+
+std::optional<LightBuffer::Handle> LightBuffer::AddPoint(const vec<3> &position, float range, const vec<3> &colour){
+	return Add({
+		.positionRange = position | range,
+		.colourCosInner = colour | -1.0f,
+		.directionCosOuter = {0.0f, 0.0f, -1.0f, -1.0f}
+	});
+}
+
+std::optional<LightBuffer::Handle> LightBuffer::AddSpot(const vec<3> &position, float range, const vec<3> &colour, const vec<3> &direction, float innerAngle, float outerAngle){
+	return Add({
+		.positionRange = position | range,
+		.colourCosInner = colour | cosf(innerAngle),
+		.directionCosOuter = ((1.0f/sqrtf(direction.SqMag()))*direction) | cosf(outerAngle)
+	});
+}
+
+std::optional<LightBuffer::Handle> LightBuffer::Add(const PipelineClusters::Light &light){
+	if(!freeHandles.empty()){
+		const Handle handle = freeHandles.back();
+		freeHandles.pop_back();
+		slots[handle] = {light, true};
+		return handle;
+	}
+	if(slots.size() >= LIGHTS_MAX){
+		std::cout << "Warning: Can't add more than " << LIGHTS_MAX << " lights.\n";
+		return {};
+	}
+	slots.push_back({light, true});
+	return Handle(slots.size() - 1);
+}
+
+void LightBuffer::Remove(Handle handle){
+	if(handle >= slots.size() || !slots[handle].used){
+		std::cout << "Warning: Tried to remove a light that wasn't added.\n";
+		return;
+	}
+	slots[handle].used = false;
+	freeHandles.push_back(handle);
+}
+
+void LightBuffer::Upload(uint32_t flight){
+	PipelineClusters::LightsSBO *const sboPointer = sbo->GetDataPointer(flight);
+	uint32_t count = 0;
+	for(const Slot &slot : slots) if(slot.used) sboPointer->lights[count++] = slot.light;
+	sboPointer->count = count;
+}
@@ -0,0 +1,98 @@
+#include "PipelineState.hpp"
+
+std::shared_ptr<PipelineLibrary> pipelineLibrary {};
+
+size_t PipelineState::Hash() const {
+	// FNV-1a over each field in turn, so padding doesn't count
+	size_t ret = 14695981039346656037ull;
+	const auto add = [&ret](uint64_t value){
+		ret ^= value;
+		ret *= 1099511628211ull;
+	};
+	add(uint64_t(renderPass));
+	add(topology);
+	add(cullMode);
+	add(depthClamp);
+	add(depthBias);
+	add(samples);
+	add(colourAttachments);
+	add(colourWriteMask);
+	add(uint64_t(blend));
+	add(depthTest);
+	add(depthWrite);
+	add(depthCompareOp);
+	add(dynamic);
+	return ret;
+}
+
+PipelineStateCreateInfos::PipelineStateCreateInfos(const PipelineState &_state) : state(_state) {
+	rasterizer = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+		.depthClampEnable = state.depthClamp ? VK_TRUE : VK_FALSE,
+		.rasterizerDiscardEnable = VK_FALSE,
+		.polygonMode = VK_POLYGON_MODE_FILL,
+		.cullMode = state.cullMode,
+		.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+		.depthBiasEnable = state.depthBias ? VK_TRUE : VK_FALSE,
+		.lineWidth = 1.0f
+	};
+	
+	multisampling = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+		.rasterizationSamples = state.samples,
+		.sampleShadingEnable = VK_FALSE
+	};
+	
+	colourBlendAttachment = {
+		.blendEnable = state.blend == PipelineState::Blend::none ? VK_FALSE : VK_TRUE,
+		.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
+		.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+		.colorBlendOp = VK_BLEND_OP_ADD,
+		.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+		.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+		.alphaBlendOp = VK_BLEND_OP_ADD,
+		.colorWriteMask = state.colourWriteMask
+	};
+	colourBlending = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+		.logicOpEnable = VK_FALSE,
+		.attachmentCount = state.colourAttachments,
+		.pAttachments = &colourBlendAttachment
+	};
+	
+	depthStencil = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+		.depthTestEnable = state.depthTest ? VK_TRUE : VK_FALSE,
+		.depthWriteEnable = state.depthWrite ? VK_TRUE : VK_FALSE,
+		.depthCompareOp = state.depthCompareOp,
+		.depthBoundsTestEnable = VK_FALSE,
+		.stencilTestEnable = VK_FALSE
+	};
+	
+	static constexpr VkDynamicState dynamicStateValues[PipelineState::dynamicStatesMax] = {
+		VK_DYNAMIC_STATE_VIEWPORT,
+		VK_DYNAMIC_STATE_SCISSOR,
+		VK_DYNAMIC_STATE_DEPTH_BIAS,
+		VK_DYNAMIC_STATE_DEPTH_COMPARE_OP,
+		VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE
+	};
+	uint32_t dynamicStatesN = 0;
+	for(uint32_t i=0; i<PipelineState::dynamicStatesMax; ++i) if(state.dynamic & (1u << i)) dynamicStates[dynamicStatesN++] = dynamicStateValues[i];
+	dynamicState = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+		.dynamicStateCount = dynamicStatesN,
+		.pDynamicStates = dynamicStates
+	};
+}
+
+EVK::RenderPipelineBlueprint PipelineStateCreateInfos::Blueprint() const {
+	return {
+		.primitiveTopology = state.topology,
+		.pRasterisationStateCI = &rasterizer,
+		.pMultisampleStateCI = &multisampling,
+		.pDepthStencilStateCI = &depthStencil,
+		.pColourBlendStateCI = &colourBlending,
+		.pDynamicStateCI = &dynamicState,
+		.renderPassHandle = state.renderPass
+	};
+}
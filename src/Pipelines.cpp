@@ -42,11 +42,44 @@ std::array<std::shared_ptr<EVK::TextureSampler>, int(Sampler::_COUNT_)> BuildSam
 	samplerInfo.minFilter = shadowmap_filter;
 	ret[(int)Sampler::shadow] = std::make_shared<EVK::TextureSampler>(devices, samplerInfo);
 	
+	// the same, but giving the result of comparing a reference depth against the shadow map, for hardware PCF and comparison gathers
+	samplerInfo.compareEnable = VK_TRUE;
+	samplerInfo.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL; // lit where the reference is no further from the light than the stored depth
+	ret[(int)Sampler::shadowCompare] = std::make_shared<EVK::TextureSampler>(devices, samplerInfo);
+	
+	// EVSM moments are a colour format, which can always be filtered linearly
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.compareEnable = VK_FALSE;
+	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+	ret[(int)Sampler::evsm] = std::make_shared<EVK::TextureSampler>(devices, samplerInfo);
+	
+	// for fetching from integer images, which can't be filtered linearly
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	ret[(int)Sampler::point] = std::make_shared<EVK::TextureSampler>(devices, samplerInfo);
+	
 	return ret;
 }
 
 
-std::shared_ptr<EVK::LayeredBufferedRenderPass<SHADOW_MAP_CASCADE_COUNT>> BuildShadowMapRenderPass(std::shared_ptr<EVK::Devices> devices){
+// instantiates `LayeredRenderPassN` for each possible layer count up to `SHADOW_MAP_CASCADE_COUNT_MAX`, returning the one for `layersN`
+template <uint32_t candidateLayersN=1>
+static std::shared_ptr<LayeredRenderPass> MakeLayeredRenderPass(uint32_t layersN, std::shared_ptr<EVK::Devices> devices, const VkRenderPassCreateInfo *pRenderPassCI, VkImageAspectFlags aspectFlags){
+	if constexpr(candidateLayersN > SHADOW_MAP_CASCADE_COUNT_MAX){
+		std::cout << "Error: Can't make a layered render pass with " << layersN << " layers.\n";
+		return nullptr;
+	} else {
+		if(layersN == candidateLayersN) return std::make_shared<LayeredRenderPassN<candidateLayersN>>(devices, pRenderPassCI, aspectFlags);
+		return MakeLayeredRenderPass<candidateLayersN + 1>(layersN, devices, pRenderPassCI, aspectFlags);
+	}
+}
+
+std::shared_ptr<LayeredRenderPass> BuildShadowMapRenderPass(std::shared_ptr<EVK::Devices> devices){
 	
 	const VkAttachmentDescription lbAttachmentDescription{
 		.format = DEPTH_FORMAT,
@@ -74,7 +107,7 @@ std::shared_ptr<EVK::LayeredBufferedRenderPass<SHADOW_MAP_CASCADE_COUNT>> BuildS
 	VkSubpassDependency lbDependencies[2];
 	lbDependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
 	lbDependencies[0].dstSubpass = 0;
-	lbDependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	lbDependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT; // the main pass and the EVSM prefilter read the cascades
 	lbDependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
 	lbDependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
 	lbDependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
@@ -82,7 +115,7 @@ std::shared_ptr<EVK::LayeredBufferedRenderPass<SHADOW_MAP_CASCADE_COUNT>> BuildS
 	lbDependencies[1].srcSubpass = 0;
 	lbDependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
 	lbDependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-	lbDependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	lbDependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
 	lbDependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 	lbDependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 	lbDependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
@@ -97,12 +130,78 @@ std::shared_ptr<EVK::LayeredBufferedRenderPass<SHADOW_MAP_CASCADE_COUNT>> BuildS
 		.pDependencies = lbDependencies
 	};
 	
-	return std::make_shared<EVK::LayeredBufferedRenderPass<SHADOW_MAP_CASCADE_COUNT>>(devices, &lbBenderPassCreateInfo, VK_IMAGE_ASPECT_DEPTH_BIT);
+	return MakeLayeredRenderPass(shadowQuality.cascadeCount, devices, &lbBenderPassCreateInfo, VK_IMAGE_ASPECT_DEPTH_BIT);
+}
+
+std::shared_ptr<EVK::BufferedRenderPass> BuildShadowMapMultiviewRenderPass(std::shared_ptr<EVK::Devices> devices){
+	
+	const VkAttachmentDescription depthAttachmentDescription{
+		.format = DEPTH_FORMAT,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+		.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+		.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+		.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+	};
+	
+	const VkAttachmentReference depthReference = {
+		.attachment = 0,
+		.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+	};
+	
+	const VkSubpassDescription subpass = {
+		.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+		.colorAttachmentCount = 0,
+		.pDepthStencilAttachment = &depthReference
+	};
+	
+	// same as the layered pass; external dependencies apply to every view
+	VkSubpassDependency dependencies[2];
+	dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[0].dstSubpass = 0;
+	dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT; // the main pass and the EVSM prefilter read the cascades
+	dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	dependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+	dependencies[1].srcSubpass = 0;
+	dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+	
+	// each bit of the view mask is a layer of the attachment written by the subpass
+	const uint32_t viewMask = (1u << shadowQuality.cascadeCount) - 1;
+	const uint32_t correlationMask = viewMask; // the cascades are spatially correlated, which lets implementations render them concurrently
+	const VkRenderPassMultiviewCreateInfo multiviewCI = {
+		.sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO,
+		.subpassCount = 1,
+		.pViewMasks = &viewMask,
+		.correlationMaskCount = 1,
+		.pCorrelationMasks = &correlationMask
+	};
+	
+	const VkRenderPassCreateInfo renderPassCreateInfo = {
+		.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+		.pNext = &multiviewCI,
+		.attachmentCount = 1,
+		.pAttachments = &depthAttachmentDescription,
+		.subpassCount = 1,
+		.pSubpasses = &subpass,
+		.dependencyCount = 2,
+		.pDependencies = dependencies
+	};
+	
+	return std::make_shared<EVK::BufferedRenderPass>(devices, &renderPassCreateInfo);
 }
 
-std::shared_ptr<EVK::BufferedRenderPass> BuildFinalRenderPass(std::shared_ptr<EVK::Devices> devices){
+std::shared_ptr<EVK::BufferedRenderPass> BuildFinalRenderPass(std::shared_ptr<EVK::Devices> devices, bool loadDepth){
 	const VkAttachmentDescription colourAttachment{
-		.format = FINAL_FORMAT,
+		.format = hdrSettings.ColourFormat(),
 #ifdef MSAA
 		.samples = interface->devices->GetMSAASamples(),
 #else
@@ -127,12 +226,20 @@ std::shared_ptr<EVK::BufferedRenderPass> BuildFinalRenderPass(std::shared_ptr<EV
 #else
 		.samples = VK_SAMPLE_COUNT_1_BIT,
 #endif
-		.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+		.loadOp = loadDepth ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR,
+#ifdef SHADOW_SDSM
+		.storeOp = VK_ATTACHMENT_STORE_OP_STORE, // read by the depth reduction
+#else
 		.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+#endif
 		.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
 		.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		.initialLayout = loadDepth ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED,
+#ifdef SHADOW_SDSM
+		.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+#else
 		.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+#endif
 	};
 	const VkAttachmentReference depthAttachmentRef{
 		.attachment = 1,
@@ -147,7 +254,7 @@ std::shared_ptr<EVK::BufferedRenderPass> BuildFinalRenderPass(std::shared_ptr<EV
 	};
 	
 	// Use subpass dependencies for layout transitions
-	VkSubpassDependency bDependencies[2];
+	VkSubpassDependency bDependencies[3];
 	bDependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
 	bDependencies[0].dstSubpass = 0;
 	bDependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
@@ -155,6 +262,13 @@ std::shared_ptr<EVK::BufferedRenderPass> BuildFinalRenderPass(std::shared_ptr<EV
 	bDependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
 	bDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
 	bDependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+	if(loadDepth){
+		// the loaded depth was written by the pass before
+		bDependencies[0].srcStageMask |= VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		bDependencies[0].dstStageMask |= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+		bDependencies[0].srcAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		bDependencies[0].dstAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	}
 	bDependencies[1].srcSubpass = 0;
 	bDependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
 	bDependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
@@ -162,6 +276,14 @@ std::shared_ptr<EVK::BufferedRenderPass> BuildFinalRenderPass(std::shared_ptr<EV
 	bDependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
 	bDependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 	bDependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+	// depth written here is read by the depth reduction compute shader
+	bDependencies[2].srcSubpass = 0;
+	bDependencies[2].dstSubpass = VK_SUBPASS_EXTERNAL;
+	bDependencies[2].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	bDependencies[2].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	bDependencies[2].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	bDependencies[2].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	bDependencies[2].dependencyFlags = 0;
 	
 	const VkAttachmentDescription attachments[2] = {colourAttachment, depthAttachment};
 	const VkRenderPassCreateInfo bRenderPassCreateInfo = {
@@ -170,13 +292,102 @@ std::shared_ptr<EVK::BufferedRenderPass> BuildFinalRenderPass(std::shared_ptr<EV
 		.pAttachments = attachments,
 		.subpassCount = 1,
 		.pSubpasses = &subpass,
+#ifdef SHADOW_SDSM
+		.dependencyCount = 3,
+#else
 		.dependencyCount = 2,
+#endif
 		.pDependencies = bDependencies
 	};
 	
 	return std::make_shared<EVK::BufferedRenderPass>(devices, &bRenderPassCreateInfo);
 }
 
+std::shared_ptr<EVK::BufferedRenderPass> BuildVisibilityRenderPass(std::shared_ptr<EVK::Devices> devices){
+	const VkAttachmentDescription visibilityAttachment{
+		.format = VISIBILITY_FORMAT,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+		.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+		.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+		.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+	};
+	const VkAttachmentReference visibilityAttachmentRef{
+		.attachment = 0,
+		.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+	};
+	
+	// kept for the final render pass to load, so the skybox and transparent geometry are tested against it
+	const VkAttachmentDescription depthAttachment{
+		.format = devices->FindDepthFormat(),
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+		.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+		.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+		.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+	};
+	const VkAttachmentReference depthAttachmentRef{
+		.attachment = 1,
+		.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+	};
+	
+	const VkSubpassDescription subpass{
+		.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+		.colorAttachmentCount = 1,
+		.pColorAttachments = &visibilityAttachmentRef,
+		.pDepthStencilAttachment = &depthAttachmentRef
+	};
+	
+	// the visibility buffer is read by the resolve in the final render pass, and was by the last one
+	VkSubpassDependency dependencies[4];
+	dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[0].dstSubpass = 0;
+	dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+	dependencies[1].srcSubpass = 0;
+	dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+	// the depth image is shared with the final render pass, which wrote it last frame and loads it after this; with `SHADOW_SDSM` the depth reduction reads it in a compute shader after each
+	dependencies[2].srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[2].dstSubpass = 0;
+	dependencies[2].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	dependencies[2].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[2].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[2].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[2].dependencyFlags = 0;
+	dependencies[3].srcSubpass = 0;
+	dependencies[3].dstSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[3].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[3].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	dependencies[3].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[3].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT;
+	dependencies[3].dependencyFlags = 0;
+	
+	const VkAttachmentDescription attachments[2] = {visibilityAttachment, depthAttachment};
+	const VkRenderPassCreateInfo renderPassCreateInfo = {
+		.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+		.attachmentCount = 2,
+		.pAttachments = attachments,
+		.subpassCount = 1,
+		.pSubpasses = &subpass,
+		.dependencyCount = 4,
+		.pDependencies = dependencies
+	};
+	
+	return std::make_shared<EVK::BufferedRenderPass>(devices, &renderPassCreateInfo);
+}
+
 
 
 //std::shared_ptr<EVK::Interface> NewBuildPipelines(const EVK::Devices &devices){
@@ -391,8 +602,6 @@ std::shared_ptr<EVK::BufferedRenderPass> BuildFinalRenderPass(std::shared_ptr<EV
 //	int uboMainPerObjectIndex = (int)UBO::mainPerObject;
 //	int uboSkyboxIndex = (int)UBO::skybox;
 //	int skyboxSamplerIndex = (int)Sampler::cube;
-//	int histogramUboIndex = (int)UBO::histogram;
-//	int histogramSboIndex = (int)SBO::histogram;
 //	
 //	EVK::DescriptorSetBlueprint mainDescriptorSetBlueprint = {
 //		(EVK::DescriptorBlueprint){
@@ -698,32 +907,6 @@ std::shared_ptr<EVK::BufferedRenderPass> BuildFinalRenderPass(std::shared_ptr<EV
 //	};
 
 	
-//	EVK::ComputePipelineBlueprint cb;
-//	EVK::DescriptorSetBlueprint histogramDescriptorSetBlueprint = {
-//		{
-//			EVK::DescriptorType::UBO,
-//			Pipeline_Histogram::UBO::binding,
-//			VK_SHADER_STAGE_COMPUTE_BIT,
-//			{histogramUboIndex}
-//		},
-//		{
-//			EVK::DescriptorType::storageImage,
-//			Pipeline_Histogram::hdrImageBinding,
-//			VK_SHADER_STAGE_COMPUTE_BIT,
-//			{int(OtherImage::colour)}
-//		},
-//		{
-//			EVK::DescriptorType::SBO,
-//			Pipeline_Histogram::SBO::binding,
-//			VK_SHADER_STAGE_COMPUTE_BIT,
-//			{histogramSboIndex}
-//		}
-//	};
-//	cb.pipelineBlueprint.descriptorSetBlueprints = {histogramDescriptorSetBlueprint};
-//	cb.pipelineBlueprint.pushConstantRanges = {};
-//	cb.shaderStageCI = shaderStages[0];
-//	cb.shaderStageCI.module = interface->devices.CreateShaderModule("../Resources/Shaders/histogram.spv");
-	
 //	// Creating the shadow mapping render pass
 //	VkAttachmentDescription lbAttachmentDescription{
 //		.format = DEPTH_FORMAT,
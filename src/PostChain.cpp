@@ -0,0 +1,178 @@
+#include "PostChain.hpp"
+
+static constexpr bool effectNeedsNeighbours[int(PostEffect::_COUNT_)] = {true, false, false}; // read the input around each pixel, so have to start a dispatch
+
+PostChain::PostChain(std::shared_ptr<EVK::Devices> _devices, const std::vector<PostEffect> &chain, bool fuse) : devices(_devices) {
+	ubo = std::make_shared<EVK::UniformBufferObject<PipelinePost::UBO, false>>(devices);
+	parameters = {
+		.lift = {0.0f, 0.0f, 0.0f, 0.0f},
+		.gamma = {1.0f, 1.0f, 1.0f, 1.0f},
+		.gain = {1.0f, 1.0f, 1.0f, 1.0f},
+		.contrast = 1.0f,
+		.saturation = 1.0f,
+		.sharpness = 0.5f
+	};
+	
+	// A new dispatch starts where an effect needs its input in memory, or would have to be applied before one already in the dispatch, as a dispatch applies its effects in the order of their bits.
+	int last = -1;
+	for(PostEffect effect : chain){
+		if(dispatches.empty() || !fuse || effectNeedsNeighbours[int(effect)] || int(effect) <= last){
+			dispatches.push_back({0, ""});
+		}
+		Dispatch &dispatch = dispatches.back();
+		dispatch.effects |= 1u << uint32_t(effect);
+		dispatch.name += (dispatch.name.empty() ? "" : "+") + std::string(PostSettings::effectNames[int(effect)]);
+		last = int(effect);
+	}
+	
+	timer = std::make_shared<GpuTimer>(devices, uint32_t(dispatches.size()));
+	timedMs = std::vector<double>(dispatches.size(), 0.0);
+}
+
+std::vector<std::function<void()>> PostChain::PipelineJobs(){
+	std::vector<std::function<void()>> ret;
+	// each writes only its own dispatch
+	for(size_t i=0; i<dispatches.size(); ++i){
+		Dispatch *const dispatch = &dispatches[i];
+		if(i + 1 == dispatches.size()) ret.push_back([this, dispatch](){ dispatch->ldrPipeline = PipelinePost::Build<PipelinePost::ldrType>(devices); });
+		else ret.push_back([this, dispatch](){ dispatch->hdrPipeline = PipelinePost::Build<PipelinePost::hdrType>(devices); });
+	}
+	return ret;
+}
+
+void PostChain::SetImages(const vec<2, uint32_t> &_size, std::shared_ptr<EVK::TextureImage> input, std::shared_ptr<EVK::TextureSampler> sampler){
+	size = _size;
+	
+	VkImageCreateInfo imageCI = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+		.imageType = VK_IMAGE_TYPE_2D,
+		.extent = {
+			.width = size.x,
+			.height = size.y,
+			.depth = 1
+		},
+		.mipLevels = 1,
+		.arrayLayers = 1,
+		.format = VK_FORMAT_R16G16B16A16_SFLOAT,
+		.tiling = VK_IMAGE_TILING_OPTIMAL,
+		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE
+	};
+	const size_t intermediatesN = dispatches.size() < 3 ? dispatches.size() - 1 : 2;
+	for(size_t i=0; i<intermediatesN; ++i) intermediates[i] = std::make_shared<EVK::TextureImage>(devices, EVK::ManualImageBlueprint{imageCI, VK_IMAGE_VIEW_TYPE_2D, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_ASPECT_COLOR_BIT});
+	imageCI.format = VK_FORMAT_R8G8B8A8_UNORM;
+	output = std::make_shared<EVK::TextureImage>(devices, EVK::ManualImageBlueprint{imageCI, VK_IMAGE_VIEW_TYPE_2D, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_ASPECT_COLOR_BIT});
+	
+	// each dispatch reads what the one before wrote
+	std::shared_ptr<EVK::TextureImage> read = input;
+	for(size_t i=0; i<dispatches.size(); ++i){
+		Dispatch &dispatch = dispatches[i];
+		dispatch.target = dispatch.ldrPipeline ? output : intermediates[i % 2];
+		if(dispatch.ldrPipeline){
+			dispatch.ldrPipeline->iDescriptorSet<0>().iDescriptor<0>().Set({{{read, sampler}}});
+			dispatch.ldrPipeline->iDescriptorSet<0>().iDescriptor<1>().Set({{dispatch.target}});
+		} else {
+			dispatch.hdrPipeline->iDescriptorSet<0>().iDescriptor<0>().Set({{{read, sampler}}});
+			dispatch.hdrPipeline->iDescriptorSet<0>().iDescriptor<1>().Set({{dispatch.target}});
+		}
+		read = dispatch.target;
+	}
+}
+
+void PostChain::SetExposure(const std::shared_ptr<EVK::StorageBufferObject<PipelineExposure::SBO>> &sboExposure){
+	for(Dispatch &dispatch : dispatches){
+		if(dispatch.ldrPipeline){
+			dispatch.ldrPipeline->iDescriptorSet<0>().iDescriptor<2>().Set(sboExposure);
+			dispatch.ldrPipeline->iDescriptorSet<0>().iDescriptor<3>().Set(ubo);
+		} else {
+			dispatch.hdrPipeline->iDescriptorSet<0>().iDescriptor<2>().Set(sboExposure);
+			dispatch.hdrPipeline->iDescriptorSet<0>().iDescriptor<3>().Set(ubo);
+		}
+	}
+}
+
+void PostChain::CmdExecute(VkCommandBuffer commandBuffer, uint32_t flight, bool timing){
+	if(timing) StepTiming(flight);
+	timer->CmdReset(commandBuffer, flight);
+	*ubo->GetDataPointer(flight) = parameters;
+	
+	// every dispatch reads the exposure the exposure average has just written
+	const VkMemoryBarrier exposureBarrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT
+	};
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &exposureBarrier, 0, nullptr, 0, nullptr);
+	
+	for(uint32_t i=0; i<uint32_t(dispatches.size()); ++i){
+		const Dispatch &dispatch = dispatches[i];
+		
+		// the target was last sampled by the next dispatch, or by the swapchain pass
+		const VkImageMemoryBarrier toWrite = {
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_SHADER_READ_BIT,
+			.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+			.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+			.newLayout = VK_IMAGE_LAYOUT_GENERAL,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.image = dispatch.target->ImageHandle(),
+			.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1}
+		};
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &toWrite);
+		
+		timer->CmdBegin(commandBuffer, flight, i);
+		const PipelinePost::PushConstants pcs = {dispatch.effects};
+		bool bound;
+		if(dispatch.ldrPipeline){
+			dispatch.ldrPipeline->CmdBind(commandBuffer);
+			bound = dispatch.ldrPipeline->CmdBindDescriptorSets<0, 0>(commandBuffer, flight);
+			if(bound) dispatch.ldrPipeline->CmdPushConstants<0>(commandBuffer, &pcs);
+		} else {
+			dispatch.hdrPipeline->CmdBind(commandBuffer);
+			bound = dispatch.hdrPipeline->CmdBindDescriptorSets<0, 0>(commandBuffer, flight);
+			if(bound) dispatch.hdrPipeline->CmdPushConstants<0>(commandBuffer, &pcs);
+		}
+		if(!bound){
+			std::cout << "Failed to post-process (" << dispatch.name << ").\n";
+			return;
+		}
+		const uint32_t groupSize = PipelinePost::groupSize;
+		vkCmdDispatch(commandBuffer, (size.x + groupSize - 1)/groupSize, (size.y + groupSize - 1)/groupSize, 1);
+		timer->CmdEnd(commandBuffer, flight, i);
+		
+		const VkImageMemoryBarrier toRead = {
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+			.oldLayout = VK_IMAGE_LAYOUT_GENERAL,
+			.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.image = dispatch.target->ImageHandle(),
+			.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1}
+		};
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dispatch.ldrPipeline ? VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &toRead);
+	}
+	timed[flight] = true;
+}
+
+void PostChain::StepTiming(uint32_t flight){
+	if(timed[flight]){
+		for(uint32_t i=0; i<uint32_t(dispatches.size()); ++i) timedMs[i] += timer->Read(flight, i).value_or(0.0);
+		++timedFrames;
+	}
+	
+	const unsigned long now = UTime();
+	if(now - timedSince < 1000000) return;
+	if(timedFrames){
+		std::cout << "Post-processing GPU ms per frame:";
+		for(size_t i=0; i<dispatches.size(); ++i) std::cout << " " << dispatches[i].name << " " << timedMs[i] / double(timedFrames) << ";";
+		std::cout << "\n";
+	}
+	timedMs.assign(dispatches.size(), 0.0);
+	timedFrames = 0;
+	timedSince = now;
+}
@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <cassert>
+
 #include "PipelineMain.hpp"
 #include "ReadProcessedObj.hpp"
 
@@ -5,62 +8,195 @@
 
 namespace Rendered {
 
-Once::Once(std::shared_ptr<EVK::Devices> _devices, const ObjectData &_objData) : devices(_devices), objData(_objData) {
+Mesh::~Mesh(){
+	if(arena) arena->FreeVertices(firstVertex, objData.vertices_n);
+}
+
+std::shared_ptr<Mesh> GetMesh(GeometryArena *arena, const std::string &key, const ObjectData &objData){
+	static std::map<std::string, std::weak_ptr<Mesh>> cache {};
+	
+	if(std::shared_ptr<Mesh> cached = cache[key].lock()) return cached;
+	
+	std::shared_ptr<Mesh> ret = std::make_shared<Mesh>();
+	const std::optional<uint32_t> firstVertex = arena->AddVertices((const PipelineMain::Vertex *)objData.vertices, objData.vertices_n, [mesh = ret.get()](uint32_t first){ mesh->firstVertex = first; });
+	if(!firstVertex) return nullptr;
+	
+	ret->arena = arena;
+	ret->firstVertex = firstVertex.value();
+	ret->objData = objData;
+	const PipelineMain::Vertex *const vertices = (const PipelineMain::Vertex *)objData.vertices;
+	ret->bounds.min = ret->bounds.max = vertices[0].position;
+	for(uint32_t i=1; i<objData.vertices_n; ++i) ret->bounds.Expand(vertices[i].position);
+	cache[key] = ret;
+	return ret;
+}
+
+InstanceList::InstanceList(std::shared_ptr<EVK::Devices> _devices) : devices(_devices) {
 	vbo = std::make_shared<EVK::VertexBufferObject>(devices);
-	vbo->Fill((void *)_objData.vertices, _objData.vertices_n * sizeof(PipelineMain::Vertex));
 }
-Info Once::Render(VkCommandBuffer commandBuffer) {
-	vbo->CmdBind(commandBuffer, uint32_t(VertexBufferBinding::vertex));
+void InstanceList::Build(const PerObject *instanceData, const Bounds *instanceBounds, std::span<const Range> ranges, const std::function<bool(const Bounds &)> &visible){
+	compacted.clear();
+	culledRanges.resize(ranges.size());
+	for(size_t b=0; b<ranges.size(); ++b){
+		culledRanges[b].firstInstance = uint32_t(compacted.size());
+		for(uint32_t i=ranges[b].firstInstance; i<ranges[b].firstInstance + ranges[b].instanceCount; ++i){
+			if(visible(instanceBounds[i])) compacted.push_back(instanceData[i]);
+		}
+		culledRanges[b].instanceCount = uint32_t(compacted.size()) - culledRanges[b].firstInstance;
+	}
+	// an empty list isn't bound, so there's nothing to fill
+	if(!compacted.empty()) vbo->Fill((void *)compacted.data(), compacted.size() * sizeof(PerObject));
+}
+bool InstanceList::CmdBind(VkCommandBuffer commandBuffer){
+	if(compacted.empty()) return false;
+	return vbo->CmdBind(commandBuffer, uint32_t(VertexBufferBinding::instance));
+}
+
+Once::Once(OnceBatcher *_batcher, std::shared_ptr<Mesh> _mesh) : batcher(_batcher), mesh(_mesh) {
+	assert(mesh && "a `Once` needs a mesh; `GetMesh` returns none when the arena is full");
+	_batcher->AddOnce(this);
+}
+Once::~Once(){
+	batcher->RemoveOnce(this);
+}
+
+OnceBatcher::OnceBatcher(std::shared_ptr<EVK::Devices> _devices) : devices(_devices) {
+	vboInstance = std::make_shared<EVK::VertexBufferObject>(devices);
+	for(int i=0; i<SHADOW_CULL_LISTS_N; ++i) cullLists.emplace_back(devices);
+}
+void OnceBatcher::AddOnce(Once *ptr){
+	// each takes a slot in the instance buffer, which has room for `maxN`
+	assert(onces.size() < Globals::MainOnce::maxN && "too many `Once` objects");
+	if(onces.size() >= Globals::MainOnce::maxN){
+		std::cout << "Warning: Too many `Once` objects; not adding.\n";
+		return;
+	}
+	onces.push_back(ptr);
+	instanceData.resize(onces.size());
+	instanceBounds.resize(onces.size());
+	batchesDirty = true;
+}
+void OnceBatcher::RemoveOnce(Once *ptr){
+	std::vector<Once *>::iterator it = std::find(onces.begin(), onces.end(), ptr);
+	if(it == onces.end()){
+		std::cout << "Warning: Tried to remove a `Once` that wasn't added.\n";
+		return;
+	}
+	onces.erase(it);
+	instanceData.resize(onces.size());
+	instanceBounds.resize(onces.size());
+	batchesDirty = true;
+}
+void OnceBatcher::RebuildBatches(){
+	// done lazily rather than in `AddOnce`, as derived constructors set the material after registering
+	std::stable_sort(onces.begin(), onces.end(), [](Once *a, Once *b) -> bool {
+		if(a->GetMesh() != b->GetMesh()) return a->GetMesh() < b->GetMesh();
+		return a->GetShininess() < b->GetShininess();
+	});
+	
+	batches.clear();
+	for(uint32_t i=0; i<onces.size(); ++i){
+		Mesh *const mesh = onces[i]->GetMesh().get();
+		const float shininess = onces[i]->GetShininess();
+		if(!batches.empty() && batches.back().mesh == mesh && batches.back().shininess == shininess){
+			batches.back().instanceCount++;
+		} else {
+			batches.push_back({mesh, shininess, i, 1});
+		}
+	}
+	batchesDirty = false;
+}
+void OnceBatcher::Update(float dT){
+	if(batchesDirty) RebuildBatches();
+	
+	for(size_t i=0; i<onces.size(); ++i){
+		onces[i]->Update(dT, &instanceData[i]);
+		instanceBounds[i] = TransformBounds(instanceData[i].model, onces[i]->GetMesh()->bounds);
+	}
+	vboInstance->Fill((void *)instanceData.data(), instanceData.size() * sizeof(PerObject));
+}
+bool OnceBatcher::CmdBindInstances(VkCommandBuffer commandBuffer){
+	return vboInstance->CmdBind(commandBuffer, uint32_t(VertexBufferBinding::instance));
+}
+Info OnceBatcher::Render(uint32_t batchIndex){
+	const Batch &batch = batches[batchIndex];
+	Bounds bounds = instanceBounds[batch.firstInstance];
+	for(uint32_t i=batch.firstInstance + 1; i<batch.firstInstance + batch.instanceCount; ++i) bounds.Expand(instanceBounds[i]);
 	return {
-		.n = objData.divisionsN,
-		.shininess = 1.0f,
-		.drawFunction = [&](uint32_t index) -> Info::Draw {
+		.n = batch.mesh->objData.divisionsN,
+		.shininess = batch.shininess,
+		.drawFunction = [&batch](uint32_t index) -> Info::Draw {
 			return {
-				.textureId = int(objData.divisionData[index].texture),
-				.vertexCount = uint32_t(objData.divisionData[index].count),
-				.instanceCount = 1,
-				.firstVertex = uint32_t(objData.divisionData[index].start)
+				.textureId = int(batch.mesh->objData.divisionData[index].texture),
+				.vertexCount = uint32_t(batch.mesh->objData.divisionData[index].count),
+				.instanceCount = batch.instanceCount,
+				.firstVertex = batch.mesh->firstVertex + uint32_t(batch.mesh->objData.divisionData[index].start),
+				.firstInstance = batch.firstInstance
+			};
+		},
+		.bounds = bounds,
+		.instances = instanceData.data(),
+		.instanceBounds = instanceBounds.data()
+	};
+}
+void OnceBatcher::Cull(uint32_t list, const std::function<bool(const Bounds &)> &visible){
+	const std::span<InstanceList::Range> ranges = frameArena->NewSpan<InstanceList::Range>(batches.size());
+	for(size_t i=0; i<batches.size(); ++i) ranges[i] = {batches[i].firstInstance, batches[i].instanceCount};
+	cullLists[list].Build(instanceData.data(), instanceBounds.data(), ranges, visible);
+}
+bool OnceBatcher::CmdBindCulledInstances(VkCommandBuffer commandBuffer, uint32_t list){
+	return cullLists[list].CmdBind(commandBuffer);
+}
+Info OnceBatcher::RenderCulled(uint32_t list, uint32_t batchIndex){
+	const Batch &batch = batches[batchIndex];
+	const InstanceList::Range &range = cullLists[list].GetRange(batchIndex);
+	return {
+		.n = range.instanceCount > 0 ? batch.mesh->objData.divisionsN : 0,
+		.shininess = batch.shininess,
+		.drawFunction = [&batch, &range](uint32_t index) -> Info::Draw {
+			return {
+				.textureId = int(batch.mesh->objData.divisionData[index].texture),
+				.vertexCount = uint32_t(batch.mesh->objData.divisionData[index].count),
+				.instanceCount = range.instanceCount,
+				.firstVertex = batch.mesh->firstVertex + uint32_t(batch.mesh->objData.divisionData[index].start),
+				.firstInstance = range.firstInstance
 			};
 		}
 	};
-	
-//	if(vertPcs) interface->GP((int)pipeline).CmdPushConstants<Shared_Main::PushConstants_Vert>((int)Shared_Main::PushConstantRange::vert, vertPcs);
-//	
-//	interface->CmdBindVertexBuffer((uint32_t)VertexBufferBinding::vertex, Globals::MainOnce::vertexVBIndexOffset + index);
-//	for(int i=0; i<objData.divisionsN; ++i){
-//		if(fragPcs){
-//			fragPcs->textureID = (int32_t)objData.divisionData[i].texture;
-//			interface->GP((int)pipeline).CmdPushConstants<Shared_Main::PushConstants_Frag>((int)Shared_Main::PushConstantRange::frag, fragPcs);
-//		}
-//		interface->CmdDraw((uint32_t)objData.divisionData[i].count, 1, objData.divisionData[i].start);
-//	}
 }
 
-InstanceManager::InstanceManager(std::shared_ptr<EVK::Devices> _devices, const ObjectData &_objData) : devices(_devices), objData(_objData) {
-	vboVertex = std::make_shared<EVK::VertexBufferObject>(devices);
+InstanceManager::InstanceManager(std::shared_ptr<EVK::Devices> _devices, std::shared_ptr<Mesh> _mesh) : devices(_devices), mesh(_mesh) {
+	assert(mesh && "an `InstanceManager` needs a mesh; `GetMesh` returns none when the arena is full");
 	vboInstance = std::make_shared<EVK::VertexBufferObject>(devices);
-	vboVertex->Fill((void *)_objData.vertices, _objData.vertices_n * sizeof(PipelineMain::Vertex));
+	for(int i=0; i<SHADOW_CULL_LISTS_N; ++i) cullLists.emplace_back(devices);
 }
 void InstanceManager::Update(float dT){
 	for(int i=0; i<instanceCount; ++i){
 		instances[i]->Update(dT, &instanceData[i]);
+		instanceBounds[i] = TransformBounds(instanceData[i].model, mesh->bounds);
 	}
 	vboInstance->Fill((void *)instanceData, instanceCount * sizeof(PerObject));
 }
-Info InstanceManager::Render(VkCommandBuffer commandBuffer){
-	vboVertex->CmdBind(commandBuffer, uint32_t(VertexBufferBinding::vertex));
-	vboInstance->CmdBind(commandBuffer, uint32_t(VertexBufferBinding::instance));
+bool InstanceManager::CmdBindInstances(VkCommandBuffer commandBuffer){
+	return vboInstance->CmdBind(commandBuffer, uint32_t(VertexBufferBinding::instance));
+}
+Info InstanceManager::Render(){
+	Bounds bounds = instanceCount > 0 ? instanceBounds[0] : mesh->bounds;
+	for(int i=1; i<instanceCount; ++i) bounds.Expand(instanceBounds[i]);
 	return {
-		.n = objData.divisionsN,
+		.n = mesh->objData.divisionsN,
 		.shininess = 1.0f,
 		.drawFunction = [&](uint32_t index) -> Info::Draw {
 			return {
-				.textureId = int(objData.divisionData[index].texture),
-				.vertexCount = uint32_t(objData.divisionData[index].count),
+				.textureId = int(mesh->objData.divisionData[index].texture),
+				.vertexCount = uint32_t(mesh->objData.divisionData[index].count),
 				.instanceCount = uint32_t(instanceCount),
-				.firstVertex = uint32_t(objData.divisionData[index].start)
+				.firstVertex = mesh->firstVertex + uint32_t(mesh->objData.divisionData[index].start)
 			};
-		}
+		},
+		.bounds = bounds,
+		.instances = instanceData,
+		.instanceBounds = instanceBounds
 	};
 	
 //	if(vertPcs){ interface->GP((int)pipeline).CmdPushConstants<Shared_Main::PushConstants_Vert>((int)Shared_Main::PushConstantRange::vert, vertPcs);
@@ -76,6 +212,128 @@ Info InstanceManager::Render(VkCommandBuffer commandBuffer){
 //		interface->CmdDraw((uint32_t)objData.divisionData[i].count, instanceCount, objData.divisionData[i].start);
 //	}
 }
+void InstanceManager::Cull(uint32_t list, const std::function<bool(const Bounds &)> &visible){
+	const InstanceList::Range all = {0, uint32_t(instanceCount)};
+	cullLists[list].Build(instanceData, instanceBounds, {&all, 1}, visible);
+}
+Info InstanceManager::RenderCulled(VkCommandBuffer commandBuffer, uint32_t list){
+	if(!cullLists[list].CmdBind(commandBuffer)) return {.n = 0, .shininess = 1.0f};
+	const InstanceList::Range &range = cullLists[list].GetRange(0);
+	return {
+		.n = mesh->objData.divisionsN,
+		.shininess = 1.0f,
+		.drawFunction = [this, &range](uint32_t index) -> Info::Draw {
+			return {
+				.textureId = int(mesh->objData.divisionData[index].texture),
+				.vertexCount = uint32_t(mesh->objData.divisionData[index].count),
+				.instanceCount = range.instanceCount,
+				.firstVertex = mesh->firstVertex + uint32_t(mesh->objData.divisionData[index].start),
+				.firstInstance = range.firstInstance
+			};
+		}
+	};
+}
+
+StaticBatcher::StaticBatcher(std::shared_ptr<EVK::Devices> _devices, GeometryArena *_arena, float _cellSize) : devices(_devices), arena(_arena), cellSize(_cellSize) {
+	identity = {
+		.model = mat<4, 4, float32_t>::Identity(),
+		.modelInvT = mat<4, 4, float32_t>::Identity()
+	};
+	vboIdentity = std::make_shared<EVK::VertexBufferObject>(devices);
+	vboIdentity->Fill((void *)&identity, sizeof(PerObject));
+}
+StaticBatcher::~StaticBatcher(){
+	for(const Batch &batch : batches) arena->FreeVertices(batch.firstVertex, batch.vertexCount);
+}
+void StaticBatcher::Add(const ObjectData &objData, const mat<4, 4> &model, float shininess){
+	const mat<4, 4> modelInvT = model.Inverted().Transposed();
+	const PipelineMain::Vertex *const vertices = (const PipelineMain::Vertex *)objData.vertices;
+	
+	for(int d=0; d<objData.divisionsN; ++d){
+		const ObjectDivisionData &division = objData.divisionData[d];
+		for(int t=0; t + 2<division.count; t+=3){
+			PipelineMain::Vertex triangle[3];
+			vec<3> centre = {0.0f, 0.0f, 0.0f};
+			for(int v=0; v<3; ++v){
+				const PipelineMain::Vertex &in = vertices[division.start + t + v];
+				const vec<4> position = model & (in.position | 1.0f);
+				const vec<4> normal = modelInvT & (in.normal | 0.0f);
+				triangle[v] = {
+					.position = {position.x, position.y, position.z},
+					.normal = {normal.x, normal.y, normal.z},
+					.texCoord = in.texCoord
+				};
+				centre += triangle[v].position;
+			}
+			centre *= 1.0f/3.0f;
+			
+			// triangles go in the cell containing their centre, and the cell's bounds grow to contain the whole triangle
+			const Key key = {
+				.cellX = int32_t(floorf(centre.x / cellSize)),
+				.cellY = int32_t(floorf(centre.y / cellSize)),
+				.texture = division.texture,
+				.shininess = shininess
+			};
+			const bool isNew = !pending.contains(key);
+			Pending &cell = pending[key];
+			if(isNew) cell.bounds.min = cell.bounds.max = triangle[0].position;
+			for(int v=0; v<3; ++v){
+				cell.vertices.push_back(triangle[v]);
+				cell.bounds.Expand(triangle[v].position);
+			}
+		}
+	}
+}
+bool StaticBatcher::Build(){
+	uint32_t droppedN = 0; // vertices
+	for(const std::pair<const Key, Pending> &entry : pending){
+		const std::optional<uint32_t> firstVertex = arena->AddVertices(entry.second.vertices.data(), uint32_t(entry.second.vertices.size()), [this, index = batches.size()](uint32_t first){ batches[index].firstVertex = first; });
+		// smaller batches after this one may still fit
+		if(!firstVertex){
+			droppedN += uint32_t(entry.second.vertices.size());
+			continue;
+		}
+		batches.push_back({
+			.texture = entry.first.texture,
+			.shininess = entry.first.shininess,
+			.firstVertex = firstVertex.value(),
+			.vertexCount = uint32_t(entry.second.vertices.size()),
+			.bounds = entry.second.bounds
+		});
+	}
+	pending.clear();
+	if(droppedN){
+		std::cout << "ERROR: No room in the geometry arena for " << droppedN << " vertices of static geometry.\n";
+		return false;
+	}
+	return true;
+}
+void StaticBatcher::Cull(uint32_t list, const std::function<bool(const Bounds &)> &visible){
+	cullLists[list].clear();
+	for(uint32_t i=0; i<batches.size(); ++i){
+		if(visible(batches[i].bounds)) cullLists[list].push_back(i);
+	}
+}
+bool StaticBatcher::CmdBindInstances(VkCommandBuffer commandBuffer){
+	return vboIdentity->CmdBind(commandBuffer, uint32_t(VertexBufferBinding::instance));
+}
+Info StaticBatcher::Render(uint32_t batchIndex){
+	const Batch &batch = batches[batchIndex];
+	return {
+		.n = 1,
+		.shininess = batch.shininess,
+		.drawFunction = [&batch](uint32_t index) -> Info::Draw {
+			return {
+				.textureId = int(batch.texture),
+				.vertexCount = batch.vertexCount,
+				.instanceCount = 1,
+				.firstVertex = batch.firstVertex
+			};
+		},
+		.bounds = batch.bounds,
+		.instances = &identity
+	};
+}
 
 Instance::Instance(InstanceManager *_manager) : manager(_manager) {
 	_manager->AddInstance(this);
@@ -1,4 +1,7 @@
+#include <algorithm>
+
 #include <evk/Interface.hpp>
+#include <SDL2/SDL_image.h>
 
 #include "Header.hpp"
 #include "RenderObjects.hpp"
@@ -8,10 +11,21 @@
 #include "PipelineShadow.hpp"
 #include "PipelineSkybox.hpp"
 #include "PipelineFinal.hpp"
+#include "PipelineDepthReduce.hpp"
+#include "PipelineEvsm.hpp"
+#include "PipelineClusters.hpp"
+#include "PipelineVisibility.hpp"
+#include "PipelineExposure.hpp"
 #include "CascadedShadowMap.hpp"
+#include "GpuTimer.hpp"
+#include "PipelineState.hpp"
+#include "FragmentCounter.hpp"
+#include "Lights.hpp"
+#include "PostChain.hpp"
+#include "FrameArena.hpp"
+#include "FrameGraph.hpp"
 
 const int Globals::MainInstanced::renderedN;
-const int Globals::MainOnce::renderedN;
 
 
 static const int planeSize = 1000.0f;
@@ -97,7 +111,66 @@ int imageIndex = OTHER_IMAGES_N;
 
 std::map<std::string, uint32_t> materialDictionary = {};
 std::array<std::shared_ptr<EVK::TextureImage>, PNGS_N> pngsArray; // a texture ID is the index in this array at which the texture image index (in the `Vulkan` devices.instance) is stored
+std::array<MaterialClass, PNGS_N> materialClasses; // indexed by texture ID
 int pngIndexIndex = 0;
+// Whether a PNG can have any alpha other than 255, from its header and the chunks before its image data, so textures without an alpha channel aren't decoded just to be classified. `EVK::PNGImageBlueprint` doesn't give out the pixels it decodes, so those with one still are.
+bool PNGMayHaveAlpha(const char *filename){
+	SDL_RWops *const file = SDL_RWFromFile(filename, "rb");
+	if(!file) return true;
+	SDL_RWseek(file, 8, RW_SEEK_SET); // signature
+	bool ret = true;
+	for(;;){
+		const Uint32 length = SDL_ReadBE32(file);
+		char type[4];
+		if(SDL_RWread(file, type, 1, 4) != 4) break;
+		if(memcmp(type, "IHDR", 4) == 0){
+			SDL_RWseek(file, 9, RW_SEEK_CUR); // width, height and bit depth
+			const Uint8 colourType = SDL_ReadU8(file);
+			if(colourType == 4 || colourType == 6) break; // grey or RGB with alpha
+			ret = false;
+			SDL_RWseek(file, length - 10 + 4, RW_SEEK_CUR); // the rest, and the CRC
+			continue;
+		}
+		if(memcmp(type, "tRNS", 4) == 0){ // transparency for a palette or a colour key
+			ret = true;
+			break;
+		}
+		if(memcmp(type, "IDAT", 4) == 0) break; // transparency chunks come before the image data
+		SDL_RWseek(file, Sint64(length) + 4, RW_SEEK_CUR);
+	}
+	SDL_RWclose(file);
+	return ret;
+}
+MaterialClass ClassifyTexture(const char *filename){
+	if(!PNGMayHaveAlpha(filename)) return MaterialClass::opaque;
+	
+	SDL_Surface *const loaded = IMG_Load(filename);
+	// only converted where it isn't decoded as 8 bit RGBA already
+	SDL_Surface *const rgba = !loaded || loaded->format->format == SDL_PIXELFORMAT_RGBA32 ? loaded : SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_RGBA32, 0);
+	if(loaded && rgba != loaded) SDL_FreeSurface(loaded);
+	if(!rgba){
+		std::cout << "Warning: Couldn't read '" << filename << "' to classify its material; treating it as opaque.\n";
+		return MaterialClass::opaque;
+	}
+	
+	MaterialClass ret = MaterialClass::opaque;
+	SDL_LockSurface(rgba);
+	for(int y=0; y<rgba->h && ret != MaterialClass::transparent; ++y){
+		const uint8_t *const row = (const uint8_t *)rgba->pixels + y*rgba->pitch;
+		for(int x=0; x<rgba->w; ++x){
+			const uint8_t alpha = row[4*x + 3];
+			if(alpha == 255) continue;
+			if(alpha > 0){
+				ret = MaterialClass::transparent;
+				break;
+			}
+			ret = MaterialClass::alphaTested;
+		}
+	}
+	SDL_UnlockSurface(rgba);
+	SDL_FreeSurface(rgba);
+	return ret;
+}
 uint32_t GetTextureIdFromMtl(const char *usemtl){
 	if(materialDictionary.contains(std::string(usemtl))) return materialDictionary[std::string(usemtl)];
 	
@@ -111,6 +184,7 @@ uint32_t GetTextureIdFromMtl(const char *usemtl){
 	memcpy(buffer + prefixLength, usemtl, nameLength*sizeof(char));
 	memcpy(buffer + prefixLength + nameLength, suffix, suffixLength*sizeof(char));
 	pngsArray[pngIndexIndex] = std::make_shared<EVK::TextureImage>(devices, EVK::PNGImageBlueprint{buffer});
+	materialClasses[pngIndexIndex] = ClassifyTexture(buffer);
 	materialDictionary[std::string(usemtl)] = pngIndexIndex;
 	return pngIndexIndex++;
 }
@@ -118,10 +192,12 @@ uint32_t GetTextureIdFromMtl(const char *usemtl){
 #define OBJ_DATAS_N 4
 enum class ObjData {player, chair, chainsaw, plane};
 ObjectData objDatas[OBJ_DATAS_N];
+std::shared_ptr<GeometryArena> geometryArena; // vertices of every mesh, bound once per pass
+std::shared_ptr<Rendered::Mesh> meshes[OBJ_DATAS_N];
 
 class Player : public Rendered::Once {
 public:
-	Player(std::shared_ptr<EVK::Devices> _devices, const vec<2> &_position) : Rendered::Once(_devices, objDatas[(int)ObjData::player]/*ReadProcessedOBJFile("ProcessedObjFiles/MaleLow.bin", &GetTextureIdFromMtl)*/), position(_position | 50.0f) {
+	Player(Rendered::OnceBatcher *_batcher, const vec<2> &_position) : Rendered::Once(_batcher, meshes[(int)ObjData::player]), position(_position | 50.0f) {
 		SDL_Event event;
 		event.type = SDL_MOUSEMOTION;
 		mmEID = ESDL::AddEventCallback((MemberFunction<Player, void, SDL_Event>){this, &Player::MouseMoved}, event);
@@ -182,10 +258,10 @@ private:
 
 class ChairInstanceManager : public Rendered::InstanceManager {
 public:
-	ChairInstanceManager(std::shared_ptr<EVK::Devices> _devices) : Rendered::InstanceManager(_devices, objDatas[(int)ObjData::chair]/*ReadProcessedOBJFile("ProcessedObjFiles/chair.bin", &GetTextureIdFromMtl)*/){}
+	ChairInstanceManager(std::shared_ptr<EVK::Devices> _devices) : Rendered::InstanceManager(_devices, meshes[(int)ObjData::chair]){}
 	
-	Rendered::Info Render(VkCommandBuffer commandBuffer) override {
-		Rendered::Info ret = Rendered::InstanceManager::Render(commandBuffer);
+	Rendered::Info Render() override {
+		Rendered::Info ret = Rendered::InstanceManager::Render();
 		ret.shininess = 1.0f;
 		return ret;
 	}
@@ -229,7 +305,9 @@ private:
 
 class ChainSaw : public Rendered::Once {
 public:
-	ChainSaw(std::shared_ptr<EVK::Devices> _devices, ChairInstance *_chair) : Rendered::Once(_devices, objDatas[(int)ObjData::chainsaw]/*ReadProcessedOBJFile("ProcessedObjFiles/chainsaw.bin", &GetTextureIdFromMtl)*/), chair(_chair) {}
+	ChainSaw(Rendered::OnceBatcher *_batcher, ChairInstance *_chair) : Rendered::Once(_batcher, meshes[(int)ObjData::chainsaw]), chair(_chair) {
+		shininess = 100.0f;
+	}
 	
 	void Update(float dT, PerObject *perObjectDataPtr) override {
 		*perObjectDataPtr = chair->GetInstanceData();
@@ -243,49 +321,65 @@ public:
 		perObjectDataPtr->modelInvT = perObjectDataPtr->model.Inverted().Transposed();
 	}
 	
-	Rendered::Info Render(VkCommandBuffer commandBuffer) override {
-		Rendered::Info ret = Rendered::Once::Render(commandBuffer);
-		ret.shininess = 100.0f;
-		return ret;
-	}
-	
 private:
 	ChairInstance *chair;
 };
 
-class Plane : public Rendered::Once {
-public:
-	Plane(std::shared_ptr<EVK::Devices> _devices) : Rendered::Once(_devices, objDatas[(int)ObjData::plane]/*planeData*/) {
-		
-	}
-	
-	void Update(float dT, PerObject *perObjectData) override {
-		perObjectData->model = mat<4, 4, float32_t>::Identity();
-		perObjectData->modelInvT = mat<4, 4, float32_t>::Identity();
-	}
-	
-	Rendered::Info Render(VkCommandBuffer commandBuffer) override {
-		Rendered::Info ret = Rendered::Once::Render(commandBuffer);
-		ret.shininess = 1.0f;
-		return ret;
-	}
-};
-
 // pipelines
-std::shared_ptr<PipelineMain::Instanced::type> pipelineMainInstanced;
-std::shared_ptr<PipelineMain::Once::type> pipelineMainOnce;
+std::shared_ptr<PipelineMain::Instanced::type> pipelineMainInstanced; // opaque geometry
+std::shared_ptr<PipelineMain::AlphaTested::type> pipelineMainAlphaTested;
+std::shared_ptr<PipelineMain::Instanced::type> pipelineMainTransparent;
+std::shared_ptr<PipelineMain::DepthPrepass::type> pipelineDepthPrepass;
 std::shared_ptr<PipelineHud::type> pipelineHud;
+#ifdef SHADOW_MULTIVIEW
+std::shared_ptr<PipelineShadow::Multiview::type> pipelineShadowMultiview;
+#else
 std::shared_ptr<PipelineShadow::Instanced::type> pipelineShadowInstanced;
-std::shared_ptr<PipelineShadow::Once::type> pipelineShadowOnce;
+#endif
+#ifdef SHADOW_CACHE
+std::shared_ptr<PipelineShadow::Composite::type> pipelineShadowComposite;
+#endif
 std::shared_ptr<PipelineSkybox::type> pipelineSkybox;
-std::shared_ptr<PipelineFinal::type> pipelineFinal;
+std::shared_ptr<PipelineFinal::type> pipelineFinal; // unless `FinalPassBlits()`
+std::shared_ptr<PipelineFinal::blitType> pipelineFinalBlit; // only if `FinalPassBlits()`
+std::shared_ptr<PostChain> postChain; // only with a `postSettings.chain`
+
+// whether the image reaching the swapchain pass is already tonemapped, so is only copied
+bool FinalPassBlits(){
+	return !postSettings.chain.empty();
+}
+#ifdef SHADOW_SDSM
+std::shared_ptr<PipelineDepthReduce::type> pipelineDepthReduce;
+#endif
+std::shared_ptr<PipelineEvsm::Horizontal::type> pipelineEvsmHorizontal;
+std::shared_ptr<PipelineEvsm::Vertical::type> pipelineEvsmVertical;
+std::shared_ptr<PipelineClusters::type> pipelineClusters;
+std::shared_ptr<PipelineVisibility::Pass::type> pipelineVisibility; // these two only with `sceneSettings.visibilityBuffer`
+std::shared_ptr<PipelineVisibility::Resolve::type> pipelineVisibilityResolve;
+std::shared_ptr<PipelineExposure::Histogram::type> pipelineExposureHistogram;
+std::shared_ptr<PipelineExposure::Average::type> pipelineExposureAverage;
 
 // UBOs
 std::shared_ptr<EVK::UniformBufferObject<PipelineMain::UBO_Global, false>> uboMainGlobal;
-std::shared_ptr<EVK::UniformBufferObject<PerObject, true>> uboPerObject;
 std::shared_ptr<EVK::UniformBufferObject<PipelineShadow::UBO_Global, false>> uboShadowGlobal;
 std::shared_ptr<EVK::UniformBufferObject<PipelineHud::UBO, false>> uboHud;
 std::shared_ptr<EVK::UniformBufferObject<PipelineSkybox::UBO_Global, false>> uboSkyboxGlobal;
+std::shared_ptr<EVK::UniformBufferObject<PipelineClusters::UBO, false>> uboClusters;
+std::shared_ptr<EVK::UniformBufferObject<PipelineExposure::UBO, false>> uboExposure;
+#ifdef SHADOW_SDSM
+std::shared_ptr<EVK::UniformBufferObject<PipelineDepthReduce::UBO, false>> uboDepthReduce;
+#endif
+
+// SBOs
+std::shared_ptr<EVK::StorageBufferObject<PipelineClusters::ClustersSBO>> sboClusters; // one per flight, written by the cluster pass and read by the main pass
+std::shared_ptr<LightBuffer> lightBuffer;
+std::shared_ptr<EVK::StorageBufferObject<PipelineVisibility::RecordsSBO>> sboVisibilityRecords; // one per flight, written as the visibility buffer is drawn
+std::shared_ptr<EVK::StorageBufferObject<PipelineExposure::SBO>> sboExposure; // one per flight, each adapting by itself; only written by the CPU to initialise it
+std::map<uint32_t, unsigned long> exposureUpdated; // when each flight's exposure last adapted, as `UTime`
+#ifdef SHADOW_SDSM
+std::shared_ptr<EVK::StorageBufferObject<PipelineDepthReduce::SBO>> sboDepthReduce; // host visible, one per flight, so results are read once the flight's fence has been waited on
+std::map<uint32_t, bool> depthReduced; // whether each flight has had a reduction recorded, so its results are valid to read
+#endif
 
 // VBOs & IBOs
 std::shared_ptr<EVK::VertexBufferObject> vboHud;
@@ -296,21 +390,60 @@ std::shared_ptr<EVK::VertexBufferObject> vboFinal;
 std::shared_ptr<EVK::IndexBufferObject> iboFinal;
 
 Rendered::InstanceManager *renderedInstanced[Globals::MainInstanced::renderedN];
-Rendered::Once *renderedOnce[Globals::MainOnce::renderedN];
+Rendered::OnceBatcher *onceBatcher; // `Once` objects sharing a mesh and material are drawn as one instanced batch
+Rendered::StaticBatcher *staticBatcher; // level geometry that never moves
+std::vector<Rendered::Once *> renderedOnce;
 Player *player;
 
+#ifdef SHADOW_CACHE
+CascadeSchedule cascadeSchedule; // which cascades are drawn this frame, set in `Update`
+#endif
+
+// With `resolutionSettings.Dynamic()`, the fraction of the window's width and height the scene is drawn at, from the top left of its targets; set by `StepDynamicResolution` at the start of each frame
+float viewportScale = 1.0f;
+
+// the scene's viewport, in whole pixels, so the scale the shaders are given is taken from this rather than `viewportScale`
+VkExtent2D SceneExtent(){
+	return {
+		std::max(1u, uint32_t(float(interface->GetExtentWidth())*viewportScale)),
+		std::max(1u, uint32_t(float(interface->GetExtentHeight())*viewportScale))
+	};
+}
+vec<2> SceneViewportScale(){
+	const VkExtent2D extent = SceneExtent();
+	return {float(extent.width) / float(interface->GetExtentWidth()), float(extent.height) / float(interface->GetExtentHeight())};
+}
+
+// after beginning a scene render pass, so everything is drawn into the scaled viewport
+void CmdSetSceneViewport(VkCommandBuffer commandBuffer){
+	const VkExtent2D extent = SceneExtent();
+	const VkViewport viewport = {0.0f, 0.0f, float(extent.width), float(extent.height), 0.0f, 1.0f};
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+	const VkRect2D scissor = {{0, 0}, extent};
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+}
+
+// for what is drawn over the whole window after the scene
+void CmdSetFullViewport(VkCommandBuffer commandBuffer){
+	const VkExtent2D extent = {uint32_t(interface->GetExtentWidth()), uint32_t(interface->GetExtentHeight())};
+	const VkViewport viewport = {0.0f, 0.0f, float(extent.width), float(extent.height), 0.0f, 1.0f};
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+	const VkRect2D scissor = {{0, 0}, extent};
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+}
+
 void Update(uint32_t flight, float dT, Shared_Main::PushConstants_Vert &vertPcs, Shared_Main::PushConstants_Frag &fragPcs){
 	
 	// UBOs
 	PipelineMain::UBO_Global *const uboGlobalPointer = uboMainGlobal->GetDataPointer(flight);
-	std::vector<PerObject *> uboPerObjectPointers = uboPerObject->GetDataPointers(flight);
 	PipelineShadow::UBO_Global *const uboShadowPointer = uboShadowGlobal->GetDataPointer(flight);
 	PipelineSkybox::UBO_Global *const uboSkyboxPointer = uboSkyboxGlobal->GetDataPointer(flight);
 	PipelineHud::UBO *const uboHudPointer = uboHud->GetDataPointer(flight);
 	
 	// Updating
 	for(int i=0; i<Globals::MainInstanced::renderedN; i++) renderedInstanced[i]->Update(dT);
-	for(int i=0; i<Globals::MainOnce::renderedN; i++) renderedOnce[i]->Update(dT, uboPerObjectPointers[i]);
+	onceBatcher->Update(dT);
+	geometryArena->Flush(flight); // in case meshes were loaded, or enough freed to defragment, since this flight's last frame
 	
 	// Setting main global UBO
 	uboGlobalPointer->viewInv = player->GetViewInverseMatrix();
@@ -320,9 +453,100 @@ void Update(uint32_t flight, float dT, Shared_Main::PushConstants_Vert &vertPcs,
 	const vec<4> sunColour = {0.9882352941f, 0.8980392157f, 0.4392156863f, 1.0f};
 	uboGlobalPointer->lightColour = sunColour;
 	uboGlobalPointer->cameraPosition = player->GetCameraPosition() | 1.0f;
+	uboGlobalPointer->viewportScale = SceneViewportScale();
+	uboGlobalPointer->cascadeCount = int32_t(shadowQuality.cascadeCount);
+	uboGlobalPointer->shadowFilter = int32_t(shadowFilterSettings.filter);
+	uboGlobalPointer->pcfHalfRange = int32_t(shadowQuality.pcfHalfRange);
+	uboGlobalPointer->fog = sceneSettings.fog ? 1 : 0;
+	
+	// Setting cluster UBO and lights
+	PipelineClusters::UBO *const uboClustersPointer = uboClusters->GetDataPointer(flight);
+	uboClustersPointer->clipToView = uboGlobalPointer->proj.Inverted();
+	uboClustersPointer->view = uboGlobalPointer->viewInv;
+	lightBuffer->Upload(flight);
+	
+	// Setting exposure UBO; each flight adapts its own exposure, so by the time since it last ran
+	const unsigned long now = UTime();
+	if(!exposureUpdated.contains(flight)){
+		// the GPU hasn't touched this flight's buffer yet
+		PipelineExposure::SBO *const sboExposurePointer = sboExposure->GetDataPointer(flight);
+		memset(sboExposurePointer->bins, 0, sizeof(sboExposurePointer->bins));
+		sboExposurePointer->adaptedLuminance = EXPOSURE_KEY_VALUE;
+		sboExposurePointer->exposure = 1.0f;
+		exposureUpdated[flight] = now;
+	}
+	PipelineExposure::UBO *const uboExposurePointer = uboExposure->GetDataPointer(flight);
+	uboExposurePointer->minLogLuminance = EXPOSURE_MIN_LOG_LUMINANCE;
+	uboExposurePointer->logLuminanceRange = EXPOSURE_MAX_LOG_LUMINANCE - EXPOSURE_MIN_LOG_LUMINANCE;
+	uboExposurePointer->inverseLogLuminanceRange = 1.0f / uboExposurePointer->logLuminanceRange;
+	uboExposurePointer->adaptation = 1.0f - expf(-EXPOSURE_ADAPTATION_RATE * 0.000001f * float(now - exposureUpdated[flight]));
+	uboExposurePointer->keyValue = EXPOSURE_KEY_VALUE;
+	uboExposurePointer->viewportScale = uboGlobalPointer->viewportScale;
+	exposureUpdated[flight] = now;
+	
+	// F cycles the shadow filter, unless the benchmark is choosing it
+	static bool filterKeyWasDown = false;
+	const bool filterKeyDown = ESDL::GetKeyDown(SDLK_f);
+	if(filterKeyDown && !filterKeyWasDown && !shadowFilterSettings.benchmark){
+		shadowFilterSettings.filter = ShadowFilter((int(shadowFilterSettings.filter) + 1) % int(ShadowFilter::_COUNT_));
+		std::cout << "Shadow filter: " << ShadowFilterSettings::filterNames[int(shadowFilterSettings.filter)] << "\n";
+	}
+	filterKeyWasDown = filterKeyDown;
+	
+	// P toggles the depth pre-pass
+	static bool prepassKeyWasDown = false;
+	const bool prepassKeyDown = ESDL::GetKeyDown(SDLK_p);
+	if(prepassKeyDown && !prepassKeyWasDown){
+		if(deviceFeatures.dynamicDepthState){
+			sceneSettings.depthPrepass = !sceneSettings.depthPrepass;
+			std::cout << "Depth pre-pass: " << (sceneSettings.depthPrepass ? "on" : "off") << "\n";
+		} else std::cout << "Depth pre-pass: unavailable without dynamic depth state\n";
+	}
+	prepassKeyWasDown = prepassKeyDown;
 	
 	// Setting shadow UBO and main lightMats
+#ifdef SHADOW_SDSM
+	// this flight's reduction results are from when it last ran, so are at least a frame old
+	PipelineDepthReduce::SBO *const sboDepthReducePointer = sboDepthReduce->GetDataPointer(flight);
+	SampleBounds samples;
+	const bool samplesValid = depthReduced[flight] && ReadDepthReduction(sboDepthReducePointer, samples);
+	UpdateCascades(uboGlobalPointer, uboShadowPointer, samplesValid ? &samples : nullptr);
+	ResetDepthReduction(sboDepthReducePointer);
+#else
 	UpdateCascades(uboGlobalPointer, uboShadowPointer);
+#endif
+#ifdef SHADOW_CACHE
+	cascadeSchedule = ScheduleCascades(uboGlobalPointer, uboShadowPointer);
+#endif
+
+#ifdef SHADOW_SDSM
+	UpdateDepthReduceUBO(uboDepthReduce->GetDataPointer(flight), uboGlobalPointer);
+#endif
+	
+	// Culling shadow casters against each cascade in light space
+#ifdef SHADOW_MULTIVIEW
+	for(uint32_t list=0; list<SHADOW_CULL_LISTS_N; ++list){
+#else
+	for(uint32_t list=0; list<shadowQuality.cascadeCount; ++list){
+#endif
+#ifdef SHADOW_CACHE
+		if(!cascadeSchedule.redraw[list]) continue;
+#endif
+#ifdef SHADOW_MULTIVIEW
+		// every cascade is drawn from the same list, so it needs anything that casts into any of them
+		const std::function<bool(const Bounds &)> visible = [uboShadowPointer](const Bounds &bounds) -> bool {
+			for(uint32_t c=0; c<shadowQuality.cascadeCount; ++c) if(CasterInCascade(uboShadowPointer, c, bounds)) return true;
+			return false;
+		};
+#else
+		const std::function<bool(const Bounds &)> visible = [uboShadowPointer, list](const Bounds &bounds) -> bool {
+			return CasterInCascade(uboShadowPointer, list, bounds);
+		};
+#endif
+		for(int i=0; i<Globals::MainInstanced::renderedN; ++i) renderedInstanced[i]->Cull(list, visible);
+		onceBatcher->Cull(list, visible);
+		staticBatcher->Cull(list, visible);
+	}
 	
 	// Setting skybox UBO
 	uboSkyboxPointer->viewInv = uboGlobalPointer->viewInv;
@@ -330,6 +554,7 @@ void Update(uint32_t flight, float dT, Shared_Main::PushConstants_Vert &vertPcs,
 	uboSkyboxPointer->proj = uboGlobalPointer->proj;
 	uboSkyboxPointer->proj[2][2] = -1.0f; uboSkyboxPointer->proj[3][2] = 0.0f; // fix the depth at 1.0
 	uboSkyboxPointer->cameraPosition = player->GetCameraPosition() | 1.0f;
+	uboSkyboxPointer->fog = uboGlobalPointer->fog;
 	
 	// vertex shader push constants
 	//currently placeholder
@@ -345,69 +570,532 @@ void Update(uint32_t flight, float dT, Shared_Main::PushConstants_Vert &vertPcs,
 	*uboHudPointer = {(float32_t)interface->GetExtentWidth(), (float32_t)interface->GetExtentHeight(), 30.0f};
 }
 
-void RenderShadowMap(VkCommandBuffer commandBuffer, uint32_t flight, Shared_Main::PushConstants_Vert shadPcs, int cascadeLayer){
+// with `SHADOW_MULTIVIEW` this draws every cascade at once and `cascadeLayer` is ignored
+void RenderShadowMap(VkCommandBuffer commandBuffer, uint32_t flight, Shared_Main::PushConstants_Vert shadPcs, int cascadeLayer, bool dynamicCasters=true, bool staticCasters=true){
+#ifdef SHADOW_MULTIVIEW
+	const uint32_t list = 0;
+	
+	pipelineShadowMultiview->CmdBind(commandBuffer);
+	if(!pipelineShadowMultiview->CmdBindDescriptorSets<0, 0>(commandBuffer, flight) ||
+	   !geometryArena->CmdBind(commandBuffer, flight)) return;
+#else
 	shadPcs.cascadeLayer = cascadeLayer;
 	
 	pipelineShadowInstanced->CmdBind(commandBuffer);
-	if(pipelineShadowInstanced->CmdBindDescriptorSets<0, 0>(commandBuffer, flight)){
-		pipelineShadowInstanced->CmdPushConstants<0>(commandBuffer, &shadPcs);
+	if(!pipelineShadowInstanced->CmdBindDescriptorSets<0, 0>(commandBuffer, flight) ||
+	   !geometryArena->CmdBind(commandBuffer, flight)) return;
+	pipelineShadowInstanced->CmdPushConstants<0>(commandBuffer, &shadPcs);
+	
+	const uint32_t list = uint32_t(cascadeLayer);
+#endif
+	
+	// only casters that passed this cascade's light space cull in `Update` are drawn; an empty list draws nothing
+	if(dynamicCasters){
 		for(int i=0; i<Globals::MainInstanced::renderedN; ++i){
-			Rendered::Info info = renderedInstanced[i]->Render(commandBuffer);
-			for(int j=0; j<info.n; ++j){
+			Rendered::Info info = renderedInstanced[i]->RenderCulled(commandBuffer, list);
+			for(uint32_t j=0; j<info.n; ++j){
 				Rendered::Info::Draw draw = info.drawFunction(j);
 				interface->CmdDraw(draw.vertexCount, draw.instanceCount, draw.firstVertex, draw.firstInstance);
 			}
 		}
+		
+		// `Once` objects go through the same pipeline, batched by mesh and material
+		if(onceBatcher->CmdBindCulledInstances(commandBuffer, list)){
+			for(uint32_t i=0; i<onceBatcher->GetBatchCount(); ++i){
+				Rendered::Info info = onceBatcher->RenderCulled(list, i);
+				for(uint32_t j=0; j<info.n; ++j){
+					Rendered::Info::Draw draw = info.drawFunction(j);
+					interface->CmdDraw(draw.vertexCount, draw.instanceCount, draw.firstVertex, draw.firstInstance);
+				}
+			}
+		}
 	}
 	
-	pipelineShadowOnce->CmdBind(commandBuffer);
-	pipelineShadowOnce->CmdPushConstants<0>(commandBuffer, &shadPcs);
-	std::vector<int> indices(1);
-	for(int i=0; i<Globals::MainOnce::renderedN; ++i){
-		indices[0] = i;
-		if(pipelineShadowOnce->CmdBindDescriptorSets<0, 0>(commandBuffer, flight, indices)){
-		   Rendered::Info info = renderedOnce[i]->Render(commandBuffer);
-		   for(int j=0; j<info.n; ++j){
-			   Rendered::Info::Draw draw = info.drawFunction(j);
-			   interface->CmdDraw(draw.vertexCount, draw.instanceCount, draw.firstVertex, draw.firstInstance);
-		   }
+	// static cells are culled against the cascade rather than the camera, as casters outside the camera frustum can still shadow what's inside it
+	if(!staticCasters || !staticBatcher->CmdBindInstances(commandBuffer)) return;
+	for(uint32_t i : staticBatcher->GetCulled(list)){
+		Rendered::Info info = staticBatcher->Render(i);
+		Rendered::Info::Draw draw = info.drawFunction(0);
+		interface->CmdDraw(draw.vertexCount, draw.instanceCount, draw.firstVertex, draw.firstInstance);
+	}
+}
+
+#ifdef SHADOW_CACHE
+// fills the cascade being drawn with its cached static casters, for the dynamic casters to be drawn over
+void CompositeStaticShadowMap(VkCommandBuffer commandBuffer, uint32_t flight, int cascadeLayer){
+	const Shared_Main::PushConstants_Vert pcs = {.cascadeLayer = cascadeLayer};
+	
+	pipelineShadowComposite->CmdBind(commandBuffer);
+	if(pipelineShadowComposite->CmdBindDescriptorSets<0, 0>(commandBuffer, flight) &&
+	   vboFinal->CmdBind(commandBuffer, 0) &&
+	   iboFinal->CmdBind(commandBuffer, VK_INDEX_TYPE_UINT32)){
+		pipelineShadowComposite->CmdPushConstants<0>(commandBuffer, &pcs);
+		interface->CmdDrawIndexed(iboFinal->GetIndexCount().value());
+	} else {
+		std::cout << "Failed to composite static shadow casters.\n";
+	}
+}
+#endif
+
+std::shared_ptr<EVK::TextureImage> evsmIntermediate; // one cascade's moments, blurred horizontally
+std::shared_ptr<EVK::TextureImage> evsmMoments; // a layer per cascade, sampled by the main pass with `ShadowFilter::evsm`
+bool evsmLayoutsReady = false; // whether every layer of the moments has been prefiltered into, so is in the layout the main pass samples it in
+bool evsmStale = true; // the moments are only prefiltered while in use, so may be out of date with their cascades
+
+VkImageMemoryBarrier LayerBarrier(VkImage image, uint32_t layer, VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask){
+	return {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.srcAccessMask = srcAccessMask,
+		.dstAccessMask = dstAccessMask,
+		.oldLayout = oldLayout,
+		.newLayout = newLayout,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = image,
+		.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, layer, 1}
+	};
+}
+
+// warps and blurs the cascades with `cascades[i]` set, or every cascade if `cascades` is null, into their layers of `evsmMoments`. Every layer written is entirely overwritten, so its previous contents are discarded.
+void PrefilterEvsm(VkCommandBuffer commandBuffer, uint32_t flight, const bool *cascades=nullptr){
+	const uint32_t groupSize = PipelineEvsm::groupSize;
+	const uint32_t groupsN = (shadowQuality.EvsmDim() + groupSize - 1)/groupSize;
+	
+	for(uint32_t i=0; i<shadowQuality.cascadeCount; ++i){
+		if(cascades && !cascades[i]) continue;
+		const PipelineEvsm::PushConstants pcs = {.layer = int32_t(i)};
+		
+		// the intermediate was last read by the previous cascade's vertical pass
+		const VkImageMemoryBarrier toWrite = LayerBarrier(evsmIntermediate->ImageHandle(), 0, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &toWrite);
+		pipelineEvsmHorizontal->CmdBind(commandBuffer);
+		if(!pipelineEvsmHorizontal->CmdBindDescriptorSets<0, 0>(commandBuffer, flight)){
+			std::cout << "Failed to prefilter EVSM.\n";
+			return;
 		}
+		pipelineEvsmHorizontal->CmdPushConstants<0>(commandBuffer, &pcs);
+		vkCmdDispatch(commandBuffer, groupsN, groupsN, 1);
+		
+		// the layer of the moments was last read by the main pass
+		const VkImageMemoryBarrier toVertical[2] = {
+			LayerBarrier(evsmIntermediate->ImageHandle(), 0, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT),
+			LayerBarrier(evsmMoments->ImageHandle(), uint32_t(i), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
+		};
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 2, toVertical);
+		pipelineEvsmVertical->CmdBind(commandBuffer);
+		if(!pipelineEvsmVertical->CmdBindDescriptorSets<0, 0>(commandBuffer, flight)){
+			std::cout << "Failed to prefilter EVSM.\n";
+			return;
+		}
+		pipelineEvsmVertical->CmdPushConstants<0>(commandBuffer, &pcs);
+		vkCmdDispatch(commandBuffer, groupsN, groupsN, 1);
+		
+		const VkImageMemoryBarrier toSample = LayerBarrier(evsmMoments->ImageHandle(), uint32_t(i), VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &toSample);
 	}
 }
 
-void RenderScene(VkCommandBuffer commandBuffer, uint32_t flight, Shared_Main::PushConstants_Vert vertPcs, Shared_Main::PushConstants_Frag fragPcs){
-	pipelineMainInstanced->CmdBind(commandBuffer);
-	if(pipelineMainInstanced->CmdBindDescriptorSets<0, 0>(commandBuffer, flight)){
-		for(int i=0; i<Globals::MainInstanced::renderedN; ++i){
-			Rendered::Info info = renderedInstanced[i]->Render(commandBuffer);
-			fragPcs.shininess = info.shininess;
-			for(int j=0; j<info.n; ++j){
-				Rendered::Info::Draw draw = info.drawFunction(j);
-				fragPcs.textureID = draw.textureId;
-				pipelineMainInstanced->CmdPushConstants<0>(commandBuffer, &fragPcs);
-				interface->CmdDraw(draw.vertexCount, draw.instanceCount, draw.firstVertex, draw.firstInstance);
+// GPU timing, for comparing shadow filters and choosing the resolution
+enum class TimedSection {mainPass, shadowPrefilter, finalPass, exposure, frame, _COUNT_};
+std::shared_ptr<GpuTimer> gpuTimer;
+std::map<uint32_t, ShadowFilter> timedFilter; // the filter each flight was last recorded with, which its timings are of
+
+#define SHADOW_BENCHMARK_WARMUP_FRAMES 60
+#define SHADOW_BENCHMARK_FRAMES 300
+struct ShadowBenchmark {
+	ShadowFilter returnTo; // the filter to go back to once finished
+	uint32_t frame = 0; // frames since the current filter was selected
+	double mainPassMs[int(ShadowFilter::_COUNT_)] = {};
+	double prefilterMs[int(ShadowFilter::_COUNT_)] = {};
+	uint32_t samples[int(ShadowFilter::_COUNT_)] = {};
+	bool done = false;
+};
+ShadowBenchmark shadowBenchmark;
+
+// With `--shadow-benchmark`, gives each filter a turn of a fixed number of frames, averaging the GPU time of the main pass and of any prefiltering. Call at the start of each frame, before its timings are reset.
+void StepShadowBenchmark(uint32_t flight){
+	if(!shadowFilterSettings.benchmark || shadowBenchmark.done) return;
+	
+	const int current = int(shadowFilterSettings.filter);
+	// timings from before the filter was switched, or while it was warming up, are discarded
+	if(timedFilter.contains(flight) && int(timedFilter[flight]) == current && shadowBenchmark.frame > SHADOW_BENCHMARK_WARMUP_FRAMES){
+		const std::optional<double> mainPass = gpuTimer->Read(flight, uint32_t(TimedSection::mainPass));
+		if(mainPass){
+			shadowBenchmark.mainPassMs[current] += mainPass.value();
+			shadowBenchmark.prefilterMs[current] += gpuTimer->Read(flight, uint32_t(TimedSection::shadowPrefilter)).value_or(0.0);
+			++shadowBenchmark.samples[current];
+		}
+	}
+	
+	if(++shadowBenchmark.frame < SHADOW_BENCHMARK_WARMUP_FRAMES + SHADOW_BENCHMARK_FRAMES) return;
+	shadowBenchmark.frame = 0;
+	if(current + 1 < int(ShadowFilter::_COUNT_)){
+		shadowFilterSettings.filter = ShadowFilter(current + 1);
+		return;
+	}
+	
+	std::cout << "Shadow filter benchmark (" << shadowQuality.cascadeCount << " cascades of " << shadowQuality.mapDim << "^2; mean GPU ms per frame):\n";
+	for(int f=0; f<int(ShadowFilter::_COUNT_); ++f){
+		const uint32_t n = shadowBenchmark.samples[f];
+		if(!n){
+			std::cout << "\t" << ShadowFilterSettings::filterNames[f] << ": no timings\n";
+			continue;
+		}
+		const double mainPass = shadowBenchmark.mainPassMs[f] / double(n);
+		const double prefilter = shadowBenchmark.prefilterMs[f] / double(n);
+		std::cout << "\t" << ShadowFilterSettings::filterNames[f] << ": main pass " << mainPass << ", prefilter " << prefilter << ", total " << mainPass + prefilter << " (" << n << " frames)\n";
+	}
+	shadowBenchmark.done = true;
+	shadowFilterSettings.filter = shadowBenchmark.returnTo;
+}
+
+// Auto-exposure, from the HDR target just drawn to the exposure the final pass reads, in two passes of the frame graph: binning the target's luminance into this flight's histogram, which was last cleared by its average pass, then averaging it.
+void CmdBuildHistogram(VkCommandBuffer commandBuffer, uint32_t flight){
+	pipelineExposureHistogram->CmdBind(commandBuffer);
+	if(!pipelineExposureHistogram->CmdBindDescriptorSets<0, 0>(commandBuffer, flight)){
+		std::cout << "Failed to build luminance histogram.\n";
+		return;
+	}
+	const uint32_t pixelsPerGroup = 2*PipelineExposure::histogramGroupSize;
+	const VkExtent2D extent = SceneExtent(); // only what was drawn is binned
+	vkCmdDispatch(commandBuffer, (extent.width + pixelsPerGroup - 1)/pixelsPerGroup, (extent.height + pixelsPerGroup - 1)/pixelsPerGroup, 1);
+}
+void CmdAverageExposure(VkCommandBuffer commandBuffer, uint32_t flight){
+	pipelineExposureAverage->CmdBind(commandBuffer);
+	if(!pipelineExposureAverage->CmdBindDescriptorSets<0, 0>(commandBuffer, flight)){
+		std::cout << "Failed to average exposure.\n";
+		return;
+	}
+	vkCmdDispatch(commandBuffer, 1, 1, 1);
+}
+
+#define HDR_BENCHMARK_WARMUP_FRAMES 60
+#define HDR_BENCHMARK_FRAMES 600
+struct HdrBenchmark {
+	uint32_t frame = 0;
+	unsigned long since; // when timing started, after the warm-up
+	double mainPassMs = 0.0;
+	double finalPassMs = 0.0;
+	double exposureMs = 0.0;
+	uint32_t samples = 0;
+	bool done = false;
+};
+HdrBenchmark hdrBenchmark;
+
+// With `--hdr-benchmark`, averages the frame time and the GPU time of the passes that write and read the HDR target, then prints them with the target's traffic. The format is fixed at startup, so compare formats over separate runs. Call at the start of each frame, before its timings are reset.
+void StepHdrBenchmark(uint32_t flight){
+	if(!hdrSettings.benchmark || hdrBenchmark.done) return;
+	
+	++hdrBenchmark.frame;
+	if(hdrBenchmark.frame <= HDR_BENCHMARK_WARMUP_FRAMES){
+		hdrBenchmark.since = UTime();
+		return;
+	}
+	if(const std::optional<double> mainPass = gpuTimer->Read(flight, uint32_t(TimedSection::mainPass)); mainPass){
+		hdrBenchmark.mainPassMs += mainPass.value();
+		hdrBenchmark.finalPassMs += gpuTimer->Read(flight, uint32_t(TimedSection::finalPass)).value_or(0.0);
+		hdrBenchmark.exposureMs += gpuTimer->Read(flight, uint32_t(TimedSection::exposure)).value_or(0.0);
+		++hdrBenchmark.samples;
+	}
+	if(hdrBenchmark.frame < HDR_BENCHMARK_WARMUP_FRAMES + HDR_BENCHMARK_FRAMES) return;
+	
+	const double frameMs = 0.001*double(UTime() - hdrBenchmark.since) / double(HDR_BENCHMARK_FRAMES);
+	const double n = double(hdrBenchmark.samples ? hdrBenchmark.samples : 1);
+	// the least the target costs: cleared and written by the main pass, then sampled once by the final pass; blending and overdraw add to this
+	const double targetMB = double(interface->GetExtentWidth()) * double(interface->GetExtentHeight()) * double(hdrSettings.BytesPerPixel()) / (1024.0*1024.0);
+	std::cout << "HDR benchmark (" << HdrSettings::formatNames[int(hdrSettings.format)] << ", " << interface->GetExtentWidth() << "x" << interface->GetExtentHeight() << "; mean ms per frame):\n";
+	std::cout << "\tframe " << frameMs << " (" << 1000.0/frameMs << " fps), main pass " << hdrBenchmark.mainPassMs/n << ", exposure " << hdrBenchmark.exposureMs/n << ", final pass " << hdrBenchmark.finalPassMs/n << " (" << hdrBenchmark.samples << " frames)\n";
+	std::cout << "\ttarget " << targetMB << " MB, at least " << 2.0*targetMB << " MB per frame, " << 2.0*targetMB*1000.0/(frameMs*1024.0) << " GB/s\n";
+	hdrBenchmark.done = true;
+}
+
+#define RESOLUTION_SMOOTHING 0.1f // weight of each frame in the smoothed ideal scale the resolution grows towards
+#define RESOLUTION_HEADROOM 0.1f // the fraction under the target frames must be for the resolution to grow, so it doesn't hover at the edge
+#define RESOLUTION_MAX_STEP 0.02f // the most the scale grows by per frame
+std::map<uint32_t, float> timedScale; // the viewport scale each flight was last recorded with, which its frame time is of
+float idealScale = 1.0f;
+
+// With `resolutionSettings.Dynamic()`, moves the viewport scale towards one that would have drawn this flight's last frame in the target time. The scene's cost is taken to go with its pixel count, so the square of the scale; what doesn't is corrected for over the following frames. Over the target the scale drops at once, and under it grows back gradually. Call at the start of each frame, before its timings are reset.
+void StepDynamicResolution(uint32_t flight){
+	if(!resolutionSettings.Dynamic() || !timedScale.contains(flight)) return;
+	const std::optional<double> frameMs = gpuTimer->Read(flight, uint32_t(TimedSection::frame));
+	if(!frameMs || frameMs.value() <= 0.0) return;
+	
+	const float ms = float(frameMs.value());
+	const float target = resolutionSettings.targetMs;
+	// aiming inside the headroom, so the scale settles where it neither has to drop nor may grow
+	const float ideal = timedScale[flight]*sqrtf((1.0f - 0.5f*RESOLUTION_HEADROOM)*target/ms);
+	idealScale += RESOLUTION_SMOOTHING*(ideal - idealScale);
+	if(ms > target) viewportScale = std::min(viewportScale, ideal);
+	else if(ms < (1.0f - RESOLUTION_HEADROOM)*target && idealScale > viewportScale) viewportScale += std::min(idealScale - viewportScale, RESOLUTION_MAX_STEP);
+	viewportScale = std::clamp(viewportScale, resolutionSettings.minScale, 1.0f);
+}
+
+// the final pass's upsampling of the scene; sharpened more the lower the resolution
+PipelineFinal::FragmentShader::PushConstants FinalPushConstants(){
+	const float range = 1.0f - resolutionSettings.minScale;
+	return {
+		SceneViewportScale(),
+		range > 0.0f ? resolutionSettings.sharpness*(1.0f - viewportScale)/range : 0.0f
+	};
+}
+
+// fragment shader invocations in the main pass, for measuring what the depth pre-pass saves
+std::shared_ptr<FragmentCounter> fragmentCounter;
+std::map<uint32_t, bool> countedPrepass; // whether each flight was last recorded with the pre-pass, which its count is of
+struct FragmentStatistics {
+	uint64_t invocations = 0;
+	uint32_t frames = 0;
+	unsigned long since = UTime();
+};
+FragmentStatistics fragmentStatistics;
+
+// with `--pipeline-statistics`, prints the mean invocations per frame each second. Call at the start of each frame, before the count is reset.
+void StepFragmentStatistics(uint32_t flight){
+	if(!sceneSettings.pipelineStatistics) return;
+	
+	// counts from before the pre-pass was toggled are discarded
+	if(countedPrepass.contains(flight) && countedPrepass[flight] == sceneSettings.depthPrepass){
+		if(const std::optional<uint64_t> count = fragmentCounter->Read(flight); count){
+			fragmentStatistics.invocations += count.value();
+			++fragmentStatistics.frames;
+		}
+	}
+	
+	const unsigned long now = UTime();
+	if(now - fragmentStatistics.since < 1000000) return;
+	if(fragmentStatistics.frames) std::cout << "Fragment shader invocations per frame: " << fragmentStatistics.invocations / fragmentStatistics.frames << " (depth pre-pass " << (sceneSettings.depthPrepass ? "on" : "off") << ")\n";
+	fragmentStatistics = {0, 0, now};
+}
+
+// A draw of the main pass, recorded once every draw of the frame has been gathered and sorted
+struct SceneDraw {
+	MaterialClass materialClass;
+	float distance; // squared, from the camera to the centre of the bounds of what is drawn
+	int source; // which instance buffer the draw needs: an index into `renderedInstanced`, or one of the below
+	float shininess;
+	Rendered::Info::Draw draw;
+	const PerObject *instances; // as `Rendered::Info::instances`
+	
+	static constexpr int sourceOnces = -1;
+	static constexpr int sourceStatics = -2;
+};
+std::vector<SceneDraw> sceneDraws; // reused each frame
+
+// Sorts opaque draws front to back, so the depth test rejects as much as it can before shading, then alpha-tested draws the same way, then transparent draws back to front, so they blend in the right order. Transparent draws are split into one per instance, and sorted by each instance's bounds; triangles within an instance, or within a static batch, aren't sorted, so a transparent mesh that overlaps itself can still blend out of order. Call once per frame after `Update`.
+void GatherSceneDraws(uint32_t flight){
+	sceneDraws.clear();
+	
+	const vec<3> cameraPosition = player->GetCameraPosition();
+	const auto add = [&](int source, const Rendered::Info &info){
+		const float distance = (info.bounds.Centre() - cameraPosition).SqMag();
+		for(uint32_t j=0; j<info.n; ++j){
+			const Rendered::Info::Draw draw = info.drawFunction(j);
+			const MaterialClass materialClass = materialClasses[draw.textureId];
+			if(materialClass != MaterialClass::transparent || !info.instanceBounds || draw.instanceCount == 1){
+				sceneDraws.push_back({materialClass, distance, source, info.shininess, draw, info.instances});
+				continue;
+			}
+			// transparent instances are drawn one at a time, so they blend in order among themselves as well as with other draws
+			for(uint32_t k=0; k<draw.instanceCount; ++k){
+				Rendered::Info::Draw instanceDraw = draw;
+				instanceDraw.instanceCount = 1;
+				instanceDraw.firstInstance = draw.firstInstance + k;
+				const float instanceDistance = (info.instanceBounds[instanceDraw.firstInstance].Centre() - cameraPosition).SqMag();
+				sceneDraws.push_back({materialClass, instanceDistance, source, info.shininess, instanceDraw, info.instances});
 			}
 		}
-	} else {
-		std::cout << "Failed to draw main instanced.\n";
+	};
+	
+	for(int i=0; i<Globals::MainInstanced::renderedN; ++i) add(i, renderedInstanced[i]->Render());
+	
+	// `Once` objects go through the same pipelines, batched by mesh and material
+	for(uint32_t i=0; i<onceBatcher->GetBatchCount(); ++i) add(SceneDraw::sourceOnces, onceBatcher->Render(i));
+	
+	// static geometry, culled by cell against the camera frustum
+	const PipelineMain::UBO_Global *const uboGlobalPointer = uboMainGlobal->GetDataPointer(flight);
+	const mat<4, 4> viewProjection = uboGlobalPointer->proj & uboGlobalPointer->viewInv;
+	for(uint32_t i=0; i<staticBatcher->GetBatchCount(); ++i){
+		if(staticBatcher->IsVisible(i, viewProjection)) add(SceneDraw::sourceStatics, staticBatcher->Render(i));
 	}
 	
-	pipelineMainOnce->CmdBind(commandBuffer);
-	std::vector<int> indices(1);
-	for(int i=0; i<Globals::MainOnce::renderedN; ++i){
-		indices[0] = i;
-		if(pipelineMainOnce->CmdBindDescriptorSets<0, 0>(commandBuffer, flight, indices)){
-			Rendered::Info info = renderedOnce[i]->Render(commandBuffer);
-			fragPcs.shininess = info.shininess;
-			for(int j=0; j<info.n; ++j){
-				Rendered::Info::Draw draw = info.drawFunction(j);
-				fragPcs.textureID = draw.textureId;
-				pipelineMainOnce->CmdPushConstants<0>(commandBuffer, &fragPcs);
-				interface->CmdDraw(draw.vertexCount, draw.instanceCount, draw.firstVertex, draw.firstInstance);
+	std::sort(sceneDraws.begin(), sceneDraws.end(), [](const SceneDraw &a, const SceneDraw &b){
+		if(a.materialClass != b.materialClass) return a.materialClass < b.materialClass;
+		return a.materialClass == MaterialClass::transparent ? a.distance > b.distance : a.distance < b.distance;
+	});
+}
+
+bool CmdBindSceneSource(VkCommandBuffer commandBuffer, int source){
+	if(source == SceneDraw::sourceOnces) return onceBatcher->CmdBindInstances(commandBuffer);
+	if(source == SceneDraw::sourceStatics) return staticBatcher->CmdBindInstances(commandBuffer);
+	return renderedInstanced[source]->CmdBindInstances(commandBuffer);
+}
+
+// Binds the pipeline `materialClass` is drawn with in the main pass, and sets its depth state where that is dynamic; without dynamic depth state there is no pre-pass and the pipelines' static state is used. Alpha-tested geometry isn't in the depth pre-pass, as it can only be cut out by a fragment shader, so it is always tested `LESS` with writes.
+bool CmdBindMainPipeline(VkCommandBuffer commandBuffer, uint32_t flight, MaterialClass materialClass, bool afterDepthPrepass){
+	bool ret = false;
+	switch(materialClass){
+		case MaterialClass::opaque:
+			pipelineMainInstanced->CmdBind(commandBuffer);
+			ret = pipelineMainInstanced->CmdBindDescriptorSets<0, 0>(commandBuffer, flight);
+			break;
+		case MaterialClass::alphaTested:
+			pipelineMainAlphaTested->CmdBind(commandBuffer);
+			ret = pipelineMainAlphaTested->CmdBindDescriptorSets<0, 0>(commandBuffer, flight);
+			break;
+		case MaterialClass::transparent:
+			pipelineMainTransparent->CmdBind(commandBuffer);
+			ret = pipelineMainTransparent->CmdBindDescriptorSets<0, 0>(commandBuffer, flight);
+			break;
+	}
+	if(deviceFeatures.dynamicDepthState){
+		const bool equal = materialClass == MaterialClass::opaque && afterDepthPrepass;
+		deviceFeatures.cmdSetDepthCompareOp(commandBuffer, equal ? VK_COMPARE_OP_EQUAL : VK_COMPARE_OP_LESS);
+		deviceFeatures.cmdSetDepthWriteEnable(commandBuffer, equal || materialClass == MaterialClass::transparent ? VK_FALSE : VK_TRUE);
+	}
+	return ret;
+}
+
+void CmdPushMainConstants(VkCommandBuffer commandBuffer, MaterialClass materialClass, Shared_Main::PushConstants_Frag &fragPcs){
+	switch(materialClass){
+		case MaterialClass::opaque: pipelineMainInstanced->CmdPushConstants<0>(commandBuffer, &fragPcs); break;
+		case MaterialClass::alphaTested: pipelineMainAlphaTested->CmdPushConstants<0>(commandBuffer, &fragPcs); break;
+		case MaterialClass::transparent: pipelineMainTransparent->CmdPushConstants<0>(commandBuffer, &fragPcs); break;
+	}
+}
+
+// Records `sceneDraws`, so `GatherSceneDraws` must have been called this frame. With `depthOnly`, this is the depth pre-pass: only the depth of opaque geometry is written, with nothing shaded. Otherwise everything from `firstClass` on is shaded, and if `afterDepthPrepass` opaque geometry is tested `EQUAL` without writes, so only its visible fragments are.
+void RenderScene(VkCommandBuffer commandBuffer, uint32_t flight, Shared_Main::PushConstants_Vert vertPcs, Shared_Main::PushConstants_Frag fragPcs, bool depthOnly=false, bool afterDepthPrepass=false, MaterialClass firstClass=MaterialClass::opaque){
+	if(!geometryArena->CmdBind(commandBuffer, flight)){
+		std::cout << "Failed to bind geometry for the main pass.\n";
+		return;
+	}
+	if(depthOnly){
+		pipelineDepthPrepass->CmdBind(commandBuffer);
+		if(!pipelineDepthPrepass->CmdBindDescriptorSets<0, 0>(commandBuffer, flight)){
+			std::cout << "Failed to draw depth pre-pass.\n";
+			return;
+		}
+	}
+	
+	std::optional<MaterialClass> boundClass;
+	std::optional<int> boundSource;
+	for(const SceneDraw &sceneDraw : sceneDraws){
+		if(depthOnly && sceneDraw.materialClass != MaterialClass::opaque) break; // sorted, so nothing after is opaque either
+		if(sceneDraw.materialClass < firstClass) continue;
+		
+		if(!depthOnly && sceneDraw.materialClass != boundClass){
+			if(!CmdBindMainPipeline(commandBuffer, flight, sceneDraw.materialClass, afterDepthPrepass)){
+				std::cout << "Failed to bind main pipeline.\n";
+				return;
+			}
+			boundClass = sceneDraw.materialClass;
+		}
+		if(sceneDraw.source != boundSource){
+			if(!CmdBindSceneSource(commandBuffer, sceneDraw.source)){
+				std::cout << "Failed to bind instances for the main pass.\n";
+				return;
+			}
+			boundSource = sceneDraw.source;
+		}
+		
+		if(!depthOnly){
+			fragPcs.shininess = sceneDraw.shininess;
+			fragPcs.textureID = sceneDraw.draw.textureId;
+			CmdPushMainConstants(commandBuffer, sceneDraw.materialClass, fragPcs);
+		}
+		interface->CmdDraw(sceneDraw.draw.vertexCount, sceneDraw.draw.instanceCount, sceneDraw.draw.firstVertex, sceneDraw.draw.firstInstance);
+	}
+}
+
+// Rasterises the IDs of the opaque and alpha-tested draws of `sceneDraws`, writing a record for each instance for the resolve to shade from
+void RenderVisibility(VkCommandBuffer commandBuffer, uint32_t flight){
+	pipelineVisibility->CmdBind(commandBuffer);
+	if(!pipelineVisibility->CmdBindDescriptorSets<0, 0>(commandBuffer, flight) ||
+	   !geometryArena->CmdBind(commandBuffer, flight)){
+		std::cout << "Failed to draw visibility buffer.\n";
+		return;
+	}
+	
+	PipelineVisibility::RecordsSBO *const recordsPointer = sboVisibilityRecords->GetDataPointer(flight);
+	uint32_t recordsN = 0;
+	std::optional<int> boundSource;
+	for(const SceneDraw &sceneDraw : sceneDraws){
+		if(sceneDraw.materialClass == MaterialClass::transparent) break; // sorted, so nothing after is opaque or alpha-tested either
+		
+		const Rendered::Info::Draw &draw = sceneDraw.draw;
+		if(recordsN + draw.instanceCount > VISIBILITY_RECORDS_MAX){
+			std::cout << "Warning: More than " << VISIBILITY_RECORDS_MAX << " instances in the visibility buffer; the rest aren't drawn.\n";
+			break;
+		}
+		if(draw.vertexCount/3 > (1u << VISIBILITY_TRIANGLE_BITS)){
+			std::cout << "Warning: A draw has too many triangles for the visibility buffer; skipping it.\n";
+			continue;
+		}
+		if(sceneDraw.source != boundSource){
+			if(!CmdBindSceneSource(commandBuffer, sceneDraw.source)){
+				std::cout << "Failed to bind instances for the visibility buffer.\n";
+				return;
 			}
-		} else {
-			std::cout << "Failed to draw main onces.\n";
+			boundSource = sceneDraw.source;
+		}
+		
+		PipelineVisibility::Pass::PushConstants pcs = {
+			.firstRecord = recordsN,
+			.firstInstance = draw.firstInstance,
+			.textureID = draw.textureId,
+			.alphaTest = sceneDraw.materialClass == MaterialClass::alphaTested
+		};
+		for(uint32_t i=0; i<draw.instanceCount; ++i){
+			const PerObject &instance = sceneDraw.instances[draw.firstInstance + i];
+			recordsPointer->records[recordsN++] = {
+				.model = instance.model,
+				.modelInvT = instance.modelInvT,
+				.firstVertex = draw.firstVertex,
+				.textureID = draw.textureId,
+				.shininess = sceneDraw.shininess
+			};
 		}
+		pipelineVisibility->CmdPushConstants<0>(commandBuffer, &pcs);
+		interface->CmdDraw(draw.vertexCount, draw.instanceCount, draw.firstVertex, draw.firstInstance);
+	}
+}
+
+// shades every pixel the visibility buffer has something in once, leaving the rest
+void ResolveVisibility(VkCommandBuffer commandBuffer, uint32_t flight, Shared_Main::PushConstants_Frag fragPcs){
+	const std::shared_ptr<PipelineVisibility::Resolve::type> &pipeline = pipelineVisibilityResolve;
+	pipeline->CmdBind(commandBuffer);
+	if(pipeline->CmdBindDescriptorSets<0, 0>(commandBuffer, flight) &&
+	   vboFinal->CmdBind(commandBuffer, 0) &&
+	   iboFinal->CmdBind(commandBuffer, VK_INDEX_TYPE_UINT32)){
+		pipeline->CmdPushConstants<0>(commandBuffer, &fragPcs);
+		interface->CmdDrawIndexed(iboFinal->GetIndexCount().value());
+	} else {
+		std::cout << "Failed to resolve visibility buffer.\n";
+	}
+}
+
+void RenderSkybox(VkCommandBuffer commandBuffer, uint32_t flight){
+	pipelineSkybox->CmdBind(commandBuffer);
+	pipelineSkybox->CmdBindDescriptorSets<0, 0>(commandBuffer, flight);
+	vboSkybox->CmdBind(commandBuffer, 0);
+	iboSkybox->CmdBind(commandBuffer, VK_INDEX_TYPE_UINT32);
+	interface->CmdDrawIndexed(iboSkybox->GetIndexCount().value());
+}
+
+// Scatters `n` lights evenly over the plane: mostly point lights, with every fourth a spot light shining down. Placement and colour depend only on the index, so runs are comparable.
+void ScatterLights(uint32_t n){
+	static const float intensity = 200.0f;
+	for(uint32_t i=0; i<n; ++i){
+		// an R2 low discrepancy sequence
+		const vec<2> position = {
+			planeSize*(2.0f*fmodf(0.5f + 0.7548776662f*float(i), 1.0f) - 1.0f),
+			planeSize*(2.0f*fmodf(0.5f + 0.5698402910f*float(i), 1.0f) - 1.0f)
+		};
+		const float hue = 2.0f*float(M_PI)*fmodf(0.6180339887f*float(i), 1.0f);
+		const vec<3> colour = intensity*(vec<3>){0.5f + 0.5f*cosf(hue), 0.5f + 0.5f*cosf(hue - 2.0943951f), 0.5f + 0.5f*cosf(hue + 2.0943951f)};
+		if(i % 4 == 3) lightBuffer->AddSpot(position | 40.0f, 80.0f, colour, {0.0f, 0.0f, -1.0f}, 0.3f, 0.5f);
+		else lightBuffer->AddPoint(position | 10.0f, 60.0f, colour);
 	}
 }
 
@@ -435,6 +1123,7 @@ private:;
 
 std::shared_ptr<EVK::TextureImage> otherColourImage;
 std::shared_ptr<EVK::TextureImage> otherDepthImage;
+std::shared_ptr<EVK::TextureImage> otherVisibilityImage; // only with `sceneSettings.visibilityBuffer`
 std::array<std::shared_ptr<EVK::TextureSampler>, int(Sampler::_COUNT_)> samplers;
 
 void CreateOtherImages(const vec<2, uint32_t> &size){
@@ -448,10 +1137,10 @@ void CreateOtherImages(const vec<2, uint32_t> &size){
 		},
 		.mipLevels = 1,
 		.arrayLayers = 1,
-		.format = FINAL_FORMAT,
+		.format = hdrSettings.ColourFormat(),
 		.tiling = VK_IMAGE_TILING_OPTIMAL, // VK_IMAGE_TILING_LINEAR for row-major order if we want to access texels in the memory of the image
 		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-		.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+		.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, // no storage, which nothing uses, and which can stop the driver compressing the target
 #ifdef MSAA
 		.samples = devices.GetMSAASamples(),
 #else
@@ -462,19 +1151,56 @@ void CreateOtherImages(const vec<2, uint32_t> &size){
 	otherColourImage = std::make_shared<EVK::TextureImage>(devices, EVK::ManualImageBlueprint{imageCI, VK_IMAGE_VIEW_TYPE_2D, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_ASPECT_COLOR_BIT});
 	
 	imageCI.format = devices->FindDepthFormat();
+#ifdef SHADOW_SDSM
+	imageCI.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+#else
 	imageCI.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+#endif
 	otherDepthImage = std::make_shared<EVK::TextureImage>(devices, EVK::ManualImageBlueprint{imageCI, VK_IMAGE_VIEW_TYPE_2D, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_ASPECT_DEPTH_BIT});
+	
+	if(sceneSettings.visibilityBuffer){
+		imageCI.format = VISIBILITY_FORMAT;
+		imageCI.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		otherVisibilityImage = std::make_shared<EVK::TextureImage>(devices, EVK::ManualImageBlueprint{imageCI, VK_IMAGE_VIEW_TYPE_2D, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_ASPECT_COLOR_BIT});
+	}
 }
 
 std::shared_ptr<EVK::BufferedRenderPass> finalRenderPass;
+std::shared_ptr<EVK::BufferedRenderPass> visibilityRenderPass; // these two only with `sceneSettings.visibilityBuffer`
+std::shared_ptr<EVK::BufferedRenderPass> finalLoadRenderPass; // as `finalRenderPass`, but keeping the visibility render pass's depth
 
 void ResizeCallback(const vec<2, uint32_t> &size){
 	CreateOtherImages(size);
 	finalRenderPass->SetImages({otherColourImage, otherDepthImage});
-	pipelineFinal->iDescriptorSet<0>().iDescriptor<0>().Set({{{otherColourImage, samplers[int(Sampler::main)]}}});
+	if(sceneSettings.visibilityBuffer){
+		visibilityRenderPass->SetImages({otherVisibilityImage, otherDepthImage});
+		finalLoadRenderPass->SetImages({otherColourImage, otherDepthImage});
+		pipelineVisibilityResolve->iDescriptorSet<0>().iDescriptor<8>().Set({{{otherVisibilityImage, samplers[int(Sampler::point)]}}});
+	}
+	pipelineExposureHistogram->iDescriptorSet<0>().iDescriptor<1>().Set({{{otherColourImage, samplers[int(Sampler::main)]}}});
+	if(postChain){
+		postChain->SetImages(size, otherColourImage, samplers[int(Sampler::main)]);
+		pipelineFinalBlit->iDescriptorSet<0>().iDescriptor<0>().Set({{{postChain->GetOutput(), samplers[int(Sampler::main)]}}});
+	} else {
+		pipelineFinal->iDescriptorSet<0>().iDescriptor<0>().Set({{{otherColourImage, samplers[int(Sampler::main)]}}});
+	}
+#ifdef SHADOW_SDSM
+	pipelineDepthReduce->iDescriptorSet<0>().iDescriptor<1>().Set({{{otherDepthImage, samplers[int(Sampler::shadow)]}}});
+#endif
 };
 
 int main(int argc, const char * argv[]) {
+	shadowQuality = ShadowQuality::FromArguments(argc, argv);
+	shadowFilterSettings = ShadowFilterSettings::FromArguments(argc, argv);
+	sceneSettings = SceneSettings::FromArguments(argc, argv);
+	hdrSettings = HdrSettings::FromArguments(argc, argv);
+	postSettings = PostSettings::FromArguments(argc, argv);
+	resolutionSettings = ResolutionSettings::FromArguments(argc, argv);
+	if(shadowFilterSettings.benchmark){
+		shadowBenchmark.returnTo = shadowFilterSettings.filter;
+		shadowFilterSettings.filter = ShadowFilter(0);
+	}
+	
 	SDL_Init(SDL_INIT_EVERYTHING);
 	
 	SDL_SetRelativeMouseMode(SDL_TRUE);
@@ -501,35 +1227,125 @@ int main(int argc, const char * argv[]) {
 			.width = uint32_t(width),
 			.height = uint32_t(height)
 		};
+	},
+										[](VkPhysicalDevice physicalDevice, VkDeviceCreateInfo &deviceCI){
+		deviceFeatures.Request(physicalDevice, deviceCI);
 	});
+#ifdef SHADOW_MULTIVIEW
+	if(!deviceFeatures.multiview) throw std::runtime_error("SHADOW_MULTIVIEW needs the device's multiview feature, which this device doesn't have; build without it");
+#endif
+	deviceFeatures.Load(devices->GetLogicalDevice());
+	if(sceneSettings.depthPrepass && !deviceFeatures.dynamicDepthState){
+		std::cout << "Warning: The depth pre-pass needs dynamic depth state (VK_EXT_extended_dynamic_state), which this device doesn't have; drawing without it.\n";
+		sceneSettings.depthPrepass = false;
+	}
+#ifdef MSAA
+	// IDs can't be resolved across samples, and the final render pass would load single sampled depth
+	if(sceneSettings.visibilityBuffer && devices->GetMSAASamples() != VK_SAMPLE_COUNT_1_BIT){
+		std::cout << "Warning: The visibility buffer renderer isn't supported with multisampling; drawing forward.\n";
+		sceneSettings.visibilityBuffer = false;
+	}
+#endif
+	if(!deviceFeatures.depthClamp) std::cout << "Warning: This device doesn't have the depthClamp feature; casters between the light and a cascade's near plane won't cast into it.\n";
+	if(sceneSettings.pipelineStatistics && !deviceFeatures.pipelineStatisticsQuery){
+		std::cout << "Warning: This device doesn't have the pipelineStatisticsQuery feature; fragments won't be counted.\n";
+		sceneSettings.pipelineStatistics = false;
+	}
+	hdrSettings.Validate(devices); // before anything is built with the format
 	
+	// settings that depend on others, decided only once every fallback above has settled what is actually drawn
+	if(postSettings.timing && postSettings.fuse){
+		std::cout << "Note: Effects are timed in their own dispatches, so aren't fused with --post-timing.\n";
+		postSettings.fuse = false;
+	}
+	if(resolutionSettings.Dynamic() && FinalPassBlits()){
+		// only the final pass upsamples
+		std::cout << "Warning: Dynamic resolution needs the scene tonemapped in the final pass, without post-processing; drawing at full resolution.\n";
+		resolutionSettings.targetMs = 0.0f;
+	}
 	
-	std::shared_ptr<EVK::LayeredBufferedRenderPass<SHADOW_MAP_CASCADE_COUNT>> shadowMapRenderPass = BuildShadowMapRenderPass(devices);
+#ifdef SHADOW_MULTIVIEW
+	std::shared_ptr<EVK::BufferedRenderPass> shadowMapRenderPass = BuildShadowMapMultiviewRenderPass(devices);
+#else
+	std::shared_ptr<LayeredRenderPass> shadowMapRenderPass = BuildShadowMapRenderPass(devices);
+#endif
+#ifdef SHADOW_CACHE
+	std::shared_ptr<LayeredRenderPass> shadowCacheRenderPass = BuildShadowMapRenderPass(devices);
+#endif
 
 	finalRenderPass = BuildFinalRenderPass(devices);
+	if(sceneSettings.visibilityBuffer){
+		visibilityRenderPass = BuildVisibilityRenderPass(devices);
+		finalLoadRenderPass = BuildFinalRenderPass(devices, true);
+	}
 	
 	interface = std::make_shared<EVK::Interface>(devices);
 	
 	interface->SetResizeCallback(&ResizeCallback);
 	
-	pipelineMainInstanced = PipelineMain::Instanced::Build(devices, finalRenderPass->RenderPassHandle());
-	pipelineMainOnce = PipelineMain::Once::Build(devices, finalRenderPass->RenderPassHandle());
-	pipelineHud = PipelineHud::Build(devices, finalRenderPass->RenderPassHandle());
-	pipelineShadowInstanced = PipelineShadow::Instanced::Build(devices, shadowMapRenderPass->RenderPassHandle());
-	pipelineShadowOnce = PipelineShadow::Once::Build(devices, shadowMapRenderPass->RenderPassHandle());
-	pipelineSkybox = PipelineSkybox::Build(devices, finalRenderPass->RenderPassHandle());
-	pipelineFinal = PipelineFinal::Build(devices, interface->GetRenderPassHandle());
+	// built in turn on this thread, as is every other EVK object
+	const unsigned long pipelinesStart = UTime();
+	pipelineLibrary = std::make_shared<PipelineLibrary>(devices);
+	std::vector<std::function<void()>> pipelineJobs = {
+		[](){ pipelineDepthPrepass = PipelineMain::DepthPrepass::Build(devices, finalRenderPass->RenderPassHandle()); },
+		[](){ pipelineHud = PipelineHud::Build(devices, interface->GetRenderPassHandle()); },
+#ifdef SHADOW_MULTIVIEW
+		[&](){ pipelineShadowMultiview = PipelineShadow::Multiview::Build(devices, shadowMapRenderPass->RenderPassHandle()); },
+#else
+		[&](){ pipelineShadowInstanced = PipelineShadow::Instanced::Build(devices, shadowMapRenderPass->RenderPassHandle()); },
+#endif
+#ifdef SHADOW_CACHE
+		[&](){ pipelineShadowComposite = PipelineShadow::Composite::Build(devices, shadowMapRenderPass->RenderPassHandle()); },
+#endif
+		[](){ pipelineSkybox = PipelineSkybox::Build(devices, finalRenderPass->RenderPassHandle()); },
+		[](){
+			if(FinalPassBlits()) pipelineFinalBlit = PipelineFinal::BuildWithShaders<PipelineFinal::blitType>(devices, interface->GetRenderPassHandle());
+			else pipelineFinal = PipelineFinal::Build(devices, interface->GetRenderPassHandle());
+		},
+#ifdef SHADOW_SDSM
+		[](){ pipelineDepthReduce = PipelineDepthReduce::Build(devices); },
+#endif
+		[](){ pipelineEvsmHorizontal = PipelineEvsm::Horizontal::Build(devices); },
+		[](){ pipelineEvsmVertical = PipelineEvsm::Vertical::Build(devices); },
+		[](){ pipelineClusters = PipelineClusters::Build(devices); },
+		[](){ pipelineExposureHistogram = PipelineExposure::Histogram::Build(devices); },
+		[](){ pipelineExposureAverage = PipelineExposure::Average::Build(devices); }
+	};
+	if(!postSettings.chain.empty()){
+		// its buffers and timer are created here; only its pipelines are jobs
+		postChain = std::make_shared<PostChain>(devices, postSettings.chain, postSettings.fuse);
+		for(std::function<void()> &job : postChain->PipelineJobs()) pipelineJobs.push_back(std::move(job));
+	}
+	if(sceneSettings.visibilityBuffer) pipelineJobs.push_back([](){ pipelineVisibility = PipelineVisibility::Pass::Build(devices, visibilityRenderPass->RenderPassHandle()); });
+	pipelineJobs.push_back([](){ pipelineMainInstanced = PipelineMain::Instanced::Build(devices, finalRenderPass->RenderPassHandle(), false, &pipelineMainInstanced); });
+	pipelineJobs.push_back([](){ pipelineMainAlphaTested = PipelineMain::AlphaTested::Build(devices, finalRenderPass->RenderPassHandle(), &pipelineMainAlphaTested); });
+	pipelineJobs.push_back([](){ pipelineMainTransparent = PipelineMain::Instanced::Build(devices, finalRenderPass->RenderPassHandle(), true, &pipelineMainTransparent); });
+	if(sceneSettings.visibilityBuffer) pipelineJobs.push_back([](){ pipelineVisibilityResolve = PipelineVisibility::Resolve::Build(devices, finalRenderPass->RenderPassHandle(), &pipelineVisibilityResolve); });
+	for(const std::function<void()> &job : pipelineJobs) job();
+	std::cout << "Built pipelines in " << 0.001*double(UTime() - pipelinesStart) << " ms (" << pipelineJobs.size() << " jobs, " << pipelineLibrary->Size() << " render pipelines).\n";
 
 	uboMainGlobal = std::make_shared<EVK::UniformBufferObject<PipelineMain::UBO_Global, false>>(devices);
-	uboPerObject = std::make_shared<EVK::UniformBufferObject<PerObject, true>>(devices, Globals::MainOnce::renderedN);
 	uboShadowGlobal = std::make_shared<EVK::UniformBufferObject<PipelineShadow::UBO_Global, false>>(devices);
 	uboHud = std::make_shared<EVK::UniformBufferObject<PipelineHud::UBO, false>>(devices);
 	uboSkyboxGlobal = std::make_shared<EVK::UniformBufferObject<PipelineSkybox::UBO_Global, false>>(devices);
+	uboClusters = std::make_shared<EVK::UniformBufferObject<PipelineClusters::UBO, false>>(devices);
+	sboClusters = std::make_shared<EVK::StorageBufferObject<PipelineClusters::ClustersSBO>>(devices);
+	uboExposure = std::make_shared<EVK::UniformBufferObject<PipelineExposure::UBO, false>>(devices);
+	sboExposure = std::make_shared<EVK::StorageBufferObject<PipelineExposure::SBO>>(devices);
+	lightBuffer = std::make_shared<LightBuffer>(devices);
+	if(sceneSettings.visibilityBuffer) sboVisibilityRecords = std::make_shared<EVK::StorageBufferObject<PipelineVisibility::RecordsSBO>>(devices);
+#ifdef SHADOW_SDSM
+	uboDepthReduce = std::make_shared<EVK::UniformBufferObject<PipelineDepthReduce::UBO, false>>(devices);
+	sboDepthReduce = std::make_shared<EVK::StorageBufferObject<PipelineDepthReduce::SBO>>(devices);
+#endif
 	
 //	vulkan = NewBuildPipelines(devices);
 	
 	samplers = BuildSamplers(devices);
 	
+	gpuTimer = std::make_shared<GpuTimer>(devices, uint32_t(TimedSection::_COUNT_));
+	if(sceneSettings.pipelineStatistics) fragmentCounter = std::make_shared<FragmentCounter>(devices);
+	
 	CallbackReceiver cr {interface};
 	SDL_Event event;
 	event.type = SDL_WINDOWEVENT;
@@ -550,18 +1366,21 @@ int main(int argc, const char * argv[]) {
 	}
 	
 	std::shared_ptr<EVK::TextureImage> shadowCascades;
+#ifdef SHADOW_CACHE
+	std::shared_ptr<EVK::TextureImage> shadowStaticCascades;
+#endif
 	{
 		// For shadow mapping we only need a depth attachment
 		VkImageCreateInfo imageCI = {
 			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
 			.imageType = VK_IMAGE_TYPE_2D,
 			.extent = {
-				.width = SHADOWMAP_DIM,
-				.height = SHADOWMAP_DIM,
+				.width = shadowQuality.mapDim,
+				.height = shadowQuality.mapDim,
 				.depth = 1
 			},
 			.mipLevels = 1,
-			.arrayLayers = SHADOW_MAP_CASCADE_COUNT,
+			.arrayLayers = shadowQuality.cascadeCount,
 			.format = DEPTH_FORMAT,
 			.tiling = VK_IMAGE_TILING_OPTIMAL, // VK_IMAGE_TILING_LINEAR for row-major order if we want to access texels in the memory of the image
 			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
@@ -570,16 +1389,52 @@ int main(int argc, const char * argv[]) {
 			.sharingMode = VK_SHARING_MODE_EXCLUSIVE
 		};
 		shadowCascades = std::make_shared<EVK::TextureImage>(devices, EVK::ManualImageBlueprint{imageCI, VK_IMAGE_VIEW_TYPE_2D_ARRAY, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_ASPECT_DEPTH_BIT});
+#ifdef SHADOW_CACHE
+		// static casters only, laid out the same
+		shadowStaticCascades = std::make_shared<EVK::TextureImage>(devices, EVK::ManualImageBlueprint{imageCI, VK_IMAGE_VIEW_TYPE_2D_ARRAY, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_ASPECT_DEPTH_BIT});
+#endif
+		
+		// EVSM moments are written by compute and sampled by the main pass
+		imageCI.extent.width = imageCI.extent.height = shadowQuality.EvsmDim();
+		imageCI.format = EVSM_FORMAT;
+		imageCI.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		evsmMoments = std::make_shared<EVK::TextureImage>(devices, EVK::ManualImageBlueprint{imageCI, VK_IMAGE_VIEW_TYPE_2D_ARRAY, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_ASPECT_COLOR_BIT});
+		imageCI.arrayLayers = 1;
+		evsmIntermediate = std::make_shared<EVK::TextureImage>(devices, EVK::ManualImageBlueprint{imageCI, VK_IMAGE_VIEW_TYPE_2D, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_ASPECT_COLOR_BIT});
 	}
 	
 	
 	
-	objDatas[(int)ObjData::player] = ReadProcessedOBJFile("../Resources/ProcessedObjFiles/MaleLow.bin", &GetTextureIdFromMtl);
-	objDatas[(int)ObjData::chair] = ReadProcessedOBJFile("../Resources/ProcessedObjFiles/chair.bin", &GetTextureIdFromMtl);
-	objDatas[(int)ObjData::chainsaw] = ReadProcessedOBJFile("../Resources/ProcessedObjFiles/chainsaw.bin", &GetTextureIdFromMtl);
+	static const char *objFiles[OBJ_DATAS_N] = {
+		"../Resources/ProcessedObjFiles/MaleLow.bin",
+		"../Resources/ProcessedObjFiles/chair.bin",
+		"../Resources/ProcessedObjFiles/chainsaw.bin",
+		nullptr // plane is generated
+	};
+	objDatas[(int)ObjData::player] = ReadProcessedOBJFile(objFiles[(int)ObjData::player], &GetTextureIdFromMtl);
+	objDatas[(int)ObjData::chair] = ReadProcessedOBJFile(objFiles[(int)ObjData::chair], &GetTextureIdFromMtl);
+	objDatas[(int)ObjData::chainsaw] = ReadProcessedOBJFile(objFiles[(int)ObjData::chainsaw], &GetTextureIdFromMtl);
 	planeData.divisionData[0].texture = GetTextureIdFromMtl("concrete-917");
 	objDatas[(int)ObjData::plane] = planeData;
 	
+	// meshes are cached by source file, so objects placed many times share a single range of the arena
+	geometryArena = std::make_shared<GeometryArena>(devices);
+	if(sceneSettings.visibilityBuffer) geometryArena->EnableStorage();
+	for(int i=0; i<OBJ_DATAS_N; ++i){
+		if(!objFiles[i]) continue;
+		meshes[i] = Rendered::GetMesh(geometryArena.get(), objFiles[i], objDatas[i]);
+		// every object placed later needs its mesh, so there's no going on without one
+		if(!meshes[i]) throw std::runtime_error(std::string("no room in the geometry arena for ") + objFiles[i] + "; raise `GEOMETRY_ARENA_VERTICES`");
+	}
+	
+	// static level geometry is baked into world space
+	staticBatcher = new Rendered::StaticBatcher(devices, geometryArena.get());
+	staticBatcher->Add(objDatas[(int)ObjData::plane], mat<4, 4>::Identity(), 1.0f);
+	if(!staticBatcher->Build()) throw std::runtime_error("no room in the geometry arena for the static geometry; raise `GEOMETRY_ARENA_VERTICES`");
+	
+	const RangeAllocator::Statistics arenaStatistics = geometryArena->GetStatistics();
+	std::cout << "Geometry arena: " << arenaStatistics.allocations << " ranges in one buffer, " << GEOMETRY_ARENA_VERTICES - arenaStatistics.free << " of " << GEOMETRY_ARENA_VERTICES << " vertices used.\n";
+	
 	
 //	BuildVkInterfaceStructures(vulkan, pngsIndexArray);
 	
@@ -587,21 +1442,70 @@ int main(int argc, const char * argv[]) {
 //	for(int i=0; i<GRAPHICS_PIPELINES_N; ++i) vulkan->GP(i).UpdateDescriptorSets();
 //	vulkan->CP(0).UpdateDescriptorSets();
 	
-	pipelineMainInstanced->iDescriptorSet<0>().iDescriptor<0>().Set(uboMainGlobal);
-	pipelineMainInstanced->iDescriptorSet<0>().iDescriptor<1>().Set({{samplers[int(Sampler::main)]}});
-	pipelineMainInstanced->iDescriptorSet<0>().iDescriptor<2>().Set(pngsArray);
-	pipelineMainInstanced->iDescriptorSet<0>().iDescriptor<3>().Set({{shadowCascades, samplers[int(Sampler::shadow)]}});
+	// the main pipelines all have the same descriptors
+	const auto setMainDescriptors = [&]<typename pipeline_t>(pipeline_t &pipeline){
+		pipeline.template iDescriptorSet<0>().template iDescriptor<0>().Set(uboMainGlobal);
+		pipeline.template iDescriptorSet<0>().template iDescriptor<1>().Set({{samplers[int(Sampler::main)]}});
+		pipeline.template iDescriptorSet<0>().template iDescriptor<2>().Set(pngsArray);
+		pipeline.template iDescriptorSet<0>().template iDescriptor<3>().Set({{shadowCascades, samplers[int(Sampler::shadow)]}});
+		pipeline.template iDescriptorSet<0>().template iDescriptor<4>().Set({{shadowCascades, samplers[int(Sampler::shadowCompare)]}});
+		pipeline.template iDescriptorSet<0>().template iDescriptor<5>().Set({{evsmMoments, samplers[int(Sampler::evsm)]}});
+		pipeline.template iDescriptorSet<0>().template iDescriptor<6>().Set(lightBuffer->GetSBO());
+		pipeline.template iDescriptorSet<0>().template iDescriptor<7>().Set(sboClusters);
+	};
+	// the resolve shades with the main descriptors, from the visibility buffer (set on resize), the vertices and the records
+	const auto setResolveDescriptors = [&](PipelineVisibility::Resolve::type &pipeline){
+		setMainDescriptors(pipeline);
+		pipeline.iDescriptorSet<0>().iDescriptor<9>().Set(geometryArena->GetStorage());
+		pipeline.iDescriptorSet<0>().iDescriptor<10>().Set(sboVisibilityRecords);
+	};
+	setMainDescriptors(*pipelineMainInstanced);
+	setMainDescriptors(*pipelineMainAlphaTested);
+	setMainDescriptors(*pipelineMainTransparent);
+	if(sceneSettings.visibilityBuffer) setResolveDescriptors(*pipelineVisibilityResolve);
+	
+	if(sceneSettings.visibilityBuffer){
+		
+		pipelineVisibility->iDescriptorSet<0>().iDescriptor<0>().Set(uboMainGlobal);
+		pipelineVisibility->iDescriptorSet<0>().iDescriptor<1>().Set({{samplers[int(Sampler::main)]}});
+		pipelineVisibility->iDescriptorSet<0>().iDescriptor<2>().Set(pngsArray);
+	}
 	
-	pipelineMainOnce->iDescriptorSet<0>().iDescriptor<0>().Set(uboMainGlobal);
-	pipelineMainOnce->iDescriptorSet<1>().iDescriptor<0>().Set(uboPerObject);
-	pipelineMainOnce->iDescriptorSet<0>().iDescriptor<1>().Set({{samplers[int(Sampler::main)]}});
-	pipelineMainOnce->iDescriptorSet<0>().iDescriptor<2>().Set(pngsArray);
-	pipelineMainOnce->iDescriptorSet<0>().iDescriptor<3>().Set({{shadowCascades, samplers[int(Sampler::shadow)]}});
+	pipelineDepthPrepass->iDescriptorSet<0>().iDescriptor<0>().Set(uboMainGlobal);
 	
-	pipelineShadowInstanced->iDescriptorSet<0>().iDescriptor<0>().Set(uboShadowGlobal);
+	pipelineEvsmHorizontal->iDescriptorSet<0>().iDescriptor<0>().Set({{{shadowCascades, samplers[int(Sampler::shadow)]}}});
+	pipelineEvsmHorizontal->iDescriptorSet<0>().iDescriptor<1>().Set({{evsmIntermediate}});
+	pipelineEvsmVertical->iDescriptorSet<0>().iDescriptor<0>().Set({{{evsmIntermediate, samplers[int(Sampler::evsm)]}}});
+	pipelineEvsmVertical->iDescriptorSet<0>().iDescriptor<1>().Set({{evsmMoments}});
+	
+	pipelineClusters->iDescriptorSet<0>().iDescriptor<0>().Set(uboClusters);
+	pipelineClusters->iDescriptorSet<0>().iDescriptor<1>().Set(lightBuffer->GetSBO());
+	pipelineClusters->iDescriptorSet<0>().iDescriptor<2>().Set(sboClusters);
+	
+	// exposure descriptor sets; the HDR target is set on resize
+	pipelineExposureHistogram->iDescriptorSet<0>().iDescriptor<0>().Set(uboExposure);
+	pipelineExposureHistogram->iDescriptorSet<0>().iDescriptor<2>().Set(sboExposure);
+	pipelineExposureAverage->iDescriptorSet<0>().iDescriptor<0>().Set(uboExposure);
+	pipelineExposureAverage->iDescriptorSet<0>().iDescriptor<1>().Set(sboExposure);
+	if(postChain){
+		postChain->SetExposure(sboExposure);
+	} else {
+		pipelineFinal->iDescriptorSet<0>().iDescriptor<1>().Set(sboExposure);
+	}
 	
-	pipelineShadowOnce->iDescriptorSet<0>().iDescriptor<0>().Set(uboShadowGlobal);
-	pipelineShadowOnce->iDescriptorSet<1>().iDescriptor<0>().Set(uboPerObject);
+#ifdef SHADOW_MULTIVIEW
+	pipelineShadowMultiview->iDescriptorSet<0>().iDescriptor<0>().Set(uboShadowGlobal);
+#else
+	pipelineShadowInstanced->iDescriptorSet<0>().iDescriptor<0>().Set(uboShadowGlobal);
+#endif
+#ifdef SHADOW_CACHE
+	pipelineShadowComposite->iDescriptorSet<0>().iDescriptor<0>().Set({{{shadowStaticCascades, samplers[int(Sampler::shadow)]}}});
+#endif
+
+#ifdef SHADOW_SDSM
+	pipelineDepthReduce->iDescriptorSet<0>().iDescriptor<0>().Set(uboDepthReduce);
+	pipelineDepthReduce->iDescriptorSet<0>().iDescriptor<2>().Set(sboDepthReduce);
+#endif
 	
 	pipelineSkybox->iDescriptorSet<0>().iDescriptor<0>().Set(uboSkyboxGlobal);
 	pipelineSkybox->iDescriptorSet<0>().iDescriptor<1>().Set({{{cubemapImage, samplers[int(Sampler::cube)]}}});
@@ -612,7 +1516,14 @@ int main(int argc, const char * argv[]) {
 	
 	// updated buffered render pass
 //	vulkan->UpdateLayeredBufferedRenderPass(0);
+#ifdef SHADOW_MULTIVIEW
+	shadowMapRenderPass->SetImages({shadowCascades}); // the framebuffer takes the whole array view; multiview picks the layers
+#else
 	shadowMapRenderPass->SetImage(shadowCascades);
+#endif
+#ifdef SHADOW_CACHE
+	shadowCacheRenderPass->SetImage(shadowStaticCascades);
+#endif
 	
 	vboHud = std::make_shared<EVK::VertexBufferObject>(devices);
 	vboHud->Fill((void *)hudVertices, sizeof(hudVertices));
@@ -629,17 +1540,43 @@ int main(int argc, const char * argv[]) {
 	iboFinal = std::make_shared<EVK::IndexBufferObject>(devices);
 	iboFinal->Fill((uint32_t *)finalIndices, finalIndicesN);
 	
+	onceBatcher = new Rendered::OnceBatcher(devices);
+	
 	ChairInstanceManager *chairManager;
 	ChairInstance *chair;
 	ChainSaw *chainSaw;
-	Plane *plane;
 	
 	renderedInstanced[0] = chairManager = new ChairInstanceManager(devices);
 	chair = new ChairInstance(chairManager);
 	
-	renderedOnce[0] = chainSaw = new ChainSaw(devices, chair);
-	renderedOnce[1] = plane = new Plane(devices);
-	renderedOnce[2] = player = new Player(devices, {100.0f, 0.0f});
+	renderedOnce.push_back(chainSaw = new ChainSaw(onceBatcher, chair));
+	renderedOnce.push_back(player = new Player(onceBatcher, {100.0f, 0.0f}));
+	
+	ScatterLights(sceneSettings.localLights);
+	
+	FrameGraph frameGraph {}; // declared again each frame, as passes come and go with settings
+	std::string printedFrameGraph {}; // with `sceneSettings.printFrameGraph`
+	
+	// made once, as the render passes take them in vectors
+	const std::vector<VkClearValue> clearVals = {
+		{
+			.color = {{1.0f, 1.0f, 1.0f, 1.0f}}
+		},
+		{
+			.depthStencil = {1.0f, 0}
+		}
+	};
+	const std::vector<VkClearValue> depthClearVals = {clearVals[1]};
+	const std::vector<VkClearValue> visibilityClearVals = {
+		{
+			.color = {.uint32 = {0xFFFFFFFF, 0, 0, 0}}
+		},
+		clearVals[1]
+	};
+	const VkClearColorValue swapchainClearColour = {{1.0f, 1.0f, 1.0f, 1.0f}};
+#ifdef FRAME_HEAP_CHECK
+	uint32_t heapCheckFrames = 0;
+#endif
 	
 	int time = SDL_GetTicks();
 	
@@ -652,75 +1589,245 @@ int main(int argc, const char * argv[]) {
 		Shared_Main::PushConstants_Vert vertPcs;
 		Shared_Main::PushConstants_Frag fragPcs;
 		
-		std::vector<VkClearValue> clearVals = {
-			{
-				.color = {{1.0f, 1.0f, 1.0f, 1.0f}}
-			},
-			{
-				.depthStencil = {1.0f, 0}
-			}
-		};
-		
-		
 		if(std::optional<EVK::Interface::FrameInfo> fi = interface->BeginFrame(); fi.has_value()){
+			BeginFrameArena(fi->frame);
 			
+			StepShadowBenchmark(fi->frame); // reads this flight's timings from when it last ran
+			StepHdrBenchmark(fi->frame);
+			StepDynamicResolution(fi->frame);
+			gpuTimer->CmdReset(fi->cb, fi->frame);
+			gpuTimer->CmdBegin(fi->cb, fi->frame, uint32_t(TimedSection::frame));
+			timedScale[fi->frame] = viewportScale;
+			StepFragmentStatistics(fi->frame);
+			if(fragmentCounter) fragmentCounter->CmdReset(fi->cb, fi->frame);
+			
+#ifdef FRAME_HEAP_CHECK
+			const uint64_t heapAllocationsBefore = HeapAllocations();
+#endif
 			Update(fi->frame, dT, vertPcs, fragPcs);
+			timedFilter[fi->frame] = shadowFilterSettings.filter;
+			countedPrepass[fi->frame] = sceneSettings.depthPrepass;
+			
+			// The frame, as passes declaring what they read and write. They're recorded in the order added; the graph culls those nothing needs and places the barriers between them, while render passes synchronise their attachments with their own dependencies.
+			frameGraph.Clear(*frameArena, fi->frame);
+			const FrameGraph::ResourceId cascades = frameGraph.AddResource("shadow cascades");
+			const FrameGraph::ResourceId moments = frameGraph.AddResource("EVSM moments"); // kept between frames while not in use
+			const FrameGraph::ResourceId momentsIntermediate = frameGraph.AddResource("EVSM intermediate", true);
+			const FrameGraph::ResourceId clusters = frameGraph.AddFlightResource("clusters");
+			const FrameGraph::ResourceId colour = frameGraph.AddResource("scene colour", true);
+			const FrameGraph::ResourceId depth = frameGraph.AddResource("scene depth", true);
+			const FrameGraph::ResourceId visibility = frameGraph.AddResource("visibility", true);
+			const FrameGraph::ResourceId histogram = frameGraph.AddFlightResource("luminance histogram");
+			const FrameGraph::ResourceId exposure = frameGraph.AddFlightResource("exposure");
+			const FrameGraph::ResourceId postIntermediates = frameGraph.AddResource("post intermediates", true);
+			const FrameGraph::ResourceId postOutput = frameGraph.AddResource("post output", true);
 			
-			for(int i=0; i<SHADOW_MAP_CASCADE_COUNT; i++){
-				if(shadowMapRenderPass->CmdBegin(fi->cb, fi->frame, VK_SUBPASS_CONTENTS_INLINE, {clearVals[1]}, i)){
-					//vulkan->CmdSetDepthBias(1.25f, 0.0f, 1.75f); // 1.25, 0.0, 1.75
-					 RenderShadowMap(fi->cb, fi->frame, vertPcs, i);
-					 interface->CmdEndRenderPass();
+			// drawn cascades are left ready for sampling by fragment and compute shaders by the shadow render pass
+			frameGraph.AddPass("shadows", {
+				{cascades, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, true, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT}
+			}, {*frameArena, [&](VkCommandBuffer commandBuffer, uint32_t flight){
+#ifdef SHADOW_MULTIVIEW
+				if(shadowMapRenderPass->CmdBegin(commandBuffer, flight, VK_SUBPASS_CONTENTS_INLINE, depthClearVals)){
+					RenderShadowMap(commandBuffer, flight, vertPcs, 0);
+					interface->CmdEndRenderPass();
 				}
-			}
+#elif defined(SHADOW_CACHE)
+				for(uint32_t i=0; i<shadowQuality.cascadeCount; i++){
+					if(!cascadeSchedule.redraw[i]) continue; // keeps what was drawn last time
+					if(cascadeSchedule.redrawStatic[i] &&
+					   shadowCacheRenderPass->CmdBegin(commandBuffer, flight, VK_SUBPASS_CONTENTS_INLINE, depthClearVals, i)){
+						RenderShadowMap(commandBuffer, flight, vertPcs, i, false, true);
+						interface->CmdEndRenderPass();
+					}
+					if(shadowMapRenderPass->CmdBegin(commandBuffer, flight, VK_SUBPASS_CONTENTS_INLINE, depthClearVals, i)){
+						CompositeStaticShadowMap(commandBuffer, flight, i);
+						RenderShadowMap(commandBuffer, flight, vertPcs, i, true, false);
+						interface->CmdEndRenderPass();
+					}
+				}
+#else
+				for(uint32_t i=0; i<shadowQuality.cascadeCount; i++){
+					if(shadowMapRenderPass->CmdBegin(commandBuffer, flight, VK_SUBPASS_CONTENTS_INLINE, depthClearVals, i)){
+						//vulkan->CmdSetDepthBias(1.25f, 0.0f, 1.75f); // 1.25, 0.0, 1.75
+						RenderShadowMap(commandBuffer, flight, vertPcs, i);
+						interface->CmdEndRenderPass();
+					}
+				}
+#endif
+			}});
 			
-			/*
-			vulkan->BeginFinalRenderPass();
+			// Prefiltering the cascades just drawn for EVSM, culled unless the main pass samples the moments. The first time this happens whatever the filter, so every layer is in the layout the main pass samples it in. It transitions its images itself, leaving the moments ready for sampling by fragment shaders.
+			frameGraph.AddPass("EVSM prefilter", {
+				{cascades, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, true},
+				{momentsIntermediate, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, true},
+				{moments, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, true, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT}
+			}, {*frameArena, [&](VkCommandBuffer commandBuffer, uint32_t flight){
+				gpuTimer->CmdBegin(commandBuffer, flight, uint32_t(TimedSection::shadowPrefilter));
+#ifdef SHADOW_CACHE
+				PrefilterEvsm(commandBuffer, flight, evsmStale ? nullptr : cascadeSchedule.redraw);
+#else
+				PrefilterEvsm(commandBuffer, flight);
+#endif
+				gpuTimer->CmdEnd(commandBuffer, flight, uint32_t(TimedSection::shadowPrefilter));
+				evsmLayoutsReady = true;
+				evsmStale = false;
+			}}, !evsmLayoutsReady);
 			
-			vulkan->GP((int)GraphicsPipeline::skybox).Bind();
-			vulkan->GP((int)GraphicsPipeline::skybox).BindDescriptorSets(0, Pipeline_Skybox::descriptorSetsN);
-			vulkan->CmdBindVertexBuffer(0, Globals::Skybox::vertexVBIndexOffset);
-			vulkan->CmdBindIndexBuffer(Globals::Skybox::IBIndexOffset, VK_INDEX_TYPE_UINT32);
-			vulkan->CmdDrawIndexed(vulkan->GetIndexBufferCount(Globals::Skybox::IBIndexOffset));
+			// binning the local lights into clusters, for the main pass to shade with
+			frameGraph.AddPass("clusters", {
+				{clusters, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT}
+			}, {*frameArena, [&](VkCommandBuffer commandBuffer, uint32_t flight){
+				pipelineClusters->CmdBind(commandBuffer);
+				if(!pipelineClusters->CmdBindDescriptorSets<0, 0>(commandBuffer, flight)){
+					std::cout << "Failed to bin lights into clusters.\n";
+					return;
+				}
+				const uint32_t groupSize = PipelineClusters::groupSize;
+				vkCmdDispatch(commandBuffer, (CLUSTERS_N + groupSize - 1)/groupSize, 1, 1);
+			}});
 			
-			RenderScene(vertPcs, fragPcs);
+			// the scene's render passes, leaving the colour ready for sampling by fragment shaders, and with SDSM the depth by compute shaders
+			frameGraph.AddPass("main pass", {
+				{cascades, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, true},
+				{clusters, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT},
+				{depth, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, true, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT}
+			}, {*frameArena, [&](VkCommandBuffer commandBuffer, uint32_t flight){
+				GatherSceneDraws(flight);
+				
+				gpuTimer->CmdBegin(commandBuffer, flight, uint32_t(TimedSection::mainPass));
+				if(fragmentCounter) fragmentCounter->CmdBegin(commandBuffer, flight);
+				if(sceneSettings.visibilityBuffer){
+					// opaque and alpha-tested geometry is only rasterised here, then resolved in the final render pass
+					geometryArena->FlushStorage(flight);
+					if(visibilityRenderPass->CmdBegin(commandBuffer, flight, VK_SUBPASS_CONTENTS_INLINE, visibilityClearVals)){
+						CmdSetSceneViewport(commandBuffer);
+						RenderVisibility(commandBuffer, flight);
+						interface->CmdEndRenderPass();
+					}
+					if(finalLoadRenderPass->CmdBegin(commandBuffer, flight, VK_SUBPASS_CONTENTS_INLINE, clearVals)){
+						CmdSetSceneViewport(commandBuffer);
+						RenderSkybox(commandBuffer, flight);
+						ResolveVisibility(commandBuffer, flight, fragPcs);
+						RenderScene(commandBuffer, flight, vertPcs, fragPcs, false, false, MaterialClass::transparent);
+						
+						interface->CmdEndRenderPass();
+					}
+				} else if(finalRenderPass->CmdBegin(commandBuffer, flight, VK_SUBPASS_CONTENTS_INLINE, clearVals)){
+					CmdSetSceneViewport(commandBuffer);
+					// before the skybox too, which then only shades where nothing is in front of it
+					if(sceneSettings.depthPrepass) RenderScene(commandBuffer, flight, vertPcs, fragPcs, true);
+					
+					RenderSkybox(commandBuffer, flight);
+					
+					RenderScene(commandBuffer, flight, vertPcs, fragPcs, false, sceneSettings.depthPrepass);
+					
+					interface->CmdEndRenderPass();
+				}
+				if(fragmentCounter) fragmentCounter->CmdEnd(commandBuffer, flight);
+				gpuTimer->CmdEnd(commandBuffer, flight, uint32_t(TimedSection::mainPass));
+			}});
+			if(shadowFilterSettings.filter == ShadowFilter::evsm) frameGraph.AddAccess({moments, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT});
+			if(sceneSettings.visibilityBuffer) frameGraph.AddAccess({visibility, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT, true});
+			frameGraph.AddAccess({colour, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, true, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT});
 			
-			RenderHUD();
-			 */
+#ifdef SHADOW_SDSM
+			// reducing this frame's depth, for fitting the cascades when this flight comes round again
+			const FrameGraph::ResourceId depthReduction = frameGraph.AddFlightResource("depth reduction");
+			frameGraph.AddPass("depth reduce", {
+				{depth, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, true},
+				{depthReduction, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT}
+			}, {*frameArena, [&](VkCommandBuffer commandBuffer, uint32_t flight){
+				pipelineDepthReduce->CmdBind(commandBuffer);
+				if(!pipelineDepthReduce->CmdBindDescriptorSets<0, 0>(commandBuffer, flight)){
+					std::cout << "Failed to reduce depth.\n";
+					return;
+				}
+				const uint32_t groupSize = PipelineDepthReduce::groupSize;
+				const VkExtent2D extent = SceneExtent();
+				vkCmdDispatch(commandBuffer, (extent.width + groupSize - 1)/groupSize, (extent.height + groupSize - 1)/groupSize, 1);
+				depthReduced[flight] = true;
+			}});
+			// nothing to record: the barrier before it is all the host needs
+			frameGraph.AddPass("depth reduction readback", {
+				{depthReduction, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT}
+			}, {}, true);
+#endif
 			
-			if(finalRenderPass->CmdBegin(fi->cb, fi->frame, VK_SUBPASS_CONTENTS_INLINE, clearVals)){
-				pipelineSkybox->CmdBind(fi->cb);
-				pipelineSkybox->CmdBindDescriptorSets<0, 0>(fi->cb, fi->frame);
-				vboSkybox->CmdBind(fi->cb, 0);
-				iboSkybox->CmdBind(fi->cb, VK_INDEX_TYPE_UINT32);
-				interface->CmdDrawIndexed(iboSkybox->GetIndexCount().value());
-				
-				RenderScene(fi->cb, fi->frame, vertPcs, fragPcs);
+			frameGraph.AddPass("luminance histogram", {
+				{colour, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT},
+				{histogram, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT}
+			}, {*frameArena, [&](VkCommandBuffer commandBuffer, uint32_t flight){
+				gpuTimer->CmdBegin(commandBuffer, flight, uint32_t(TimedSection::exposure)); // ended by the average
+				CmdBuildHistogram(commandBuffer, flight);
+			}});
+			frameGraph.AddPass("exposure average", {
+				{histogram, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT},
+				{exposure, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT}
+			}, {*frameArena, [&](VkCommandBuffer commandBuffer, uint32_t flight){
+				CmdAverageExposure(commandBuffer, flight);
+				gpuTimer->CmdEnd(commandBuffer, flight, uint32_t(TimedSection::exposure));
+			}});
+			
+			// it transitions its own images, leaving the output ready for sampling by fragment shaders
+			if(postChain){
+				frameGraph.AddPass("post-processing", {
+					{colour, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT},
+					{exposure, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, true},
+					{postIntermediates, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, true},
+					{postOutput, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, true, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT}
+				}, {*frameArena, [&](VkCommandBuffer commandBuffer, uint32_t flight){
+					postChain->CmdExecute(commandBuffer, flight, postSettings.timing);
+				}});
+			}
+			
+			// into the swapchain image, which `EndFinalRenderPassAndFrame` presents, so left open for the end of the frame's timing
+			frameGraph.AddPass("final pass", {}, {*frameArena, [&](VkCommandBuffer commandBuffer, uint32_t flight){
+				interface->BeginFinalRenderPass(swapchainClearColour);
 				
-				RenderHUD(fi->cb, fi->frame);
+				gpuTimer->CmdBegin(commandBuffer, flight, uint32_t(TimedSection::finalPass));
+				if(FinalPassBlits()){
+					const PipelineFinal::FragmentShader::BlitPushConstants blitPcs = {postChain ? 1 : 0}; // the chain's output is sRGB encoded in a linear format
+					pipelineFinalBlit->CmdBind(commandBuffer);
+					pipelineFinalBlit->CmdBindDescriptorSets<0, 0>(commandBuffer, flight);
+					pipelineFinalBlit->CmdPushConstants<0>(commandBuffer, &blitPcs);
+				} else {
+					const PipelineFinal::FragmentShader::PushConstants finalPcs = FinalPushConstants();
+					pipelineFinal->CmdBind(commandBuffer);
+					pipelineFinal->CmdBindDescriptorSets<0, 0>(commandBuffer, flight);
+					pipelineFinal->CmdPushConstants<0>(commandBuffer, &finalPcs);
+				}
+				vboFinal->CmdBind(commandBuffer, 0);
+				iboFinal->CmdBind(commandBuffer, VK_INDEX_TYPE_UINT32);
+				interface->CmdDrawIndexed(iboFinal->GetIndexCount().value());
 				
-				interface->CmdEndRenderPass();
+				// over the upsampled scene, at the window's resolution whatever the scene's
+				CmdSetFullViewport(commandBuffer);
+				RenderHUD(commandBuffer, flight);
+				gpuTimer->CmdEnd(commandBuffer, flight, uint32_t(TimedSection::finalPass));
+			}}, true);
+			if(postChain){
+				frameGraph.AddAccess({postOutput, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT});
+			} else {
+				frameGraph.AddAccess({colour, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT});
+				frameGraph.AddAccess({exposure, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT});
 			}
 			
+			frameGraph.Compile();
+			frameGraph.Execute(fi->cb);
+#ifdef FRAME_HEAP_CHECK
+			if(++heapCheckFrames > FRAME_HEAP_CHECK_WARMUP_FRAMES) assert(HeapAllocations() == heapAllocationsBefore && "a frame allocated from the general heap");
+#endif
+			if(sceneSettings.printFrameGraph){
+				std::string description = frameGraph.Describe();
+				if(description != printedFrameGraph){
+					std::cout << "Frame graph:\n" << description;
+					printedFrameGraph = std::move(description);
+				}
+			}
+			if(shadowFilterSettings.filter != ShadowFilter::evsm) evsmStale = true;
 			
-			// compute commands recorded with a pipeline image memory barrier
-			// begin compute command buffer
-//			vulkan->BeginCompute();
-//			vulkan->CmdPipelineImageMemoryBarrier(true, int(OtherImage::colour), VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
-//			// submit to compute queue
-//			vulkan->EndCompute();
-			
-			
-			// final render pass recorded with a pipeline buffer memory barrier:
-			interface->BeginFinalRenderPass({{1.0f, 1.0f, 1.0f, 1.0f}}); // begin with a pipeline buffer memory barrier
-				
-			pipelineFinal->CmdBind(fi->cb);
-			pipelineFinal->CmdBindDescriptorSets<0, 0>(fi->cb, fi->frame);
-			vboFinal->CmdBind(fi->cb, 0);
-			iboFinal->CmdBind(fi->cb, VK_INDEX_TYPE_UINT32);
-			interface->CmdDrawIndexed(iboFinal->GetIndexCount().value());
+			gpuTimer->CmdEnd(fi->cb, fi->frame, uint32_t(TimedSection::frame));
 			
-			//
 			interface->EndFinalRenderPassAndFrame();
 		}
 	}
@@ -731,8 +1838,12 @@ int main(int argc, const char * argv[]) {
 	free(objDatas[(int)ObjData::chair].vertices);
 	free(objDatas[(int)ObjData::chainsaw].vertices);
 	for(int i=0; i<Globals::MainInstanced::renderedN; ++i) delete renderedInstanced[i];
-	for(int i=0; i<Globals::MainOnce::renderedN; ++i) delete renderedOnce[i];
-	delete player;
+	for(Rendered::Once *once : renderedOnce) delete once;
+	delete onceBatcher;
+	delete staticBatcher;
+	for(int i=0; i<OBJ_DATAS_N; ++i) meshes[i].reset();
+	geometryArena.reset();
+	pipelineLibrary.reset();
 	
 	return 0;
 }